@@ -0,0 +1,508 @@
+/*
+ * End-to-end throughput of the extraction utilities over a corpus of
+ * binaries: each tool is run on each binary, at each thread count, and
+ * timed from start to exit. Reported per tool and thread count are
+ * functions processed per second (from --stats), MB of .text per
+ * second, and the peak resident set of any one run.
+ *
+ * Results are written as JSON, one result to a line, and may be
+ * compared with those of an earlier run given as a baseline; a drop in
+ * throughput or growth in memory beyond the tolerance is a regression,
+ * and makes the exit status nonzero.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <elf.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "stats.h"
+
+using namespace std;
+
+struct tool {
+    char const* name;
+    char const* args[4];        // before --jobs, NULL terminated
+};
+
+static tool tools[] = {
+    { "ngrams", { "-n", "4", NULL } },
+    { "idioms", { NULL } },
+    { "graphlets", { NULL } },
+    { "supergraphlets", { NULL } },
+    { "calldfa", { NULL } },
+    { "libcalls", { NULL } },
+    { "features", { "--all", "-n", "4", NULL } }
+};
+static const int NTOOLS = sizeof(tools)/sizeof(tools[0]);
+
+struct result {
+    string tool;
+    int jobs;
+    double seconds;
+    unsigned long functions;
+    unsigned long text;         // bytes
+    long peak_rss;              // kB
+    int failures;
+
+    double funcs_per_sec() const {
+        return seconds > 0 ? functions / seconds : 0;
+    }
+    double mb_per_sec() const {
+        return seconds > 0 ? text / 1e6 / seconds : 0;
+    }
+};
+
+struct binary {
+    string path;
+    unsigned long text;
+};
+
+/** corpus **/
+
+/* size of the .text section of the ELF file at path, or 0 if it is not
+   one or has none */
+template<typename Ehdr, typename Shdr>
+static unsigned long text_size(vector<char> const& f)
+{
+    if(f.size() < sizeof(Ehdr))
+        return 0;
+    Ehdr const* eh = (Ehdr const*)f.data();
+    if(eh->e_shoff == 0 || eh->e_shentsize != sizeof(Shdr) ||
+       eh->e_shoff + (unsigned long)eh->e_shnum * sizeof(Shdr) > f.size() ||
+       eh->e_shstrndx >= eh->e_shnum)
+        return 0;
+    Shdr const* sh = (Shdr const*)(f.data() + eh->e_shoff);
+    Shdr const& strs = sh[eh->e_shstrndx];
+    if(strs.sh_offset + strs.sh_size > f.size())
+        return 0;
+    char const* names = f.data() + strs.sh_offset;
+    for(unsigned i=0;i<eh->e_shnum;++i) {
+        if(sh[i].sh_name + 6 <= strs.sh_size &&
+           strcmp(names + sh[i].sh_name,".text") == 0)
+            return sh[i].sh_size;
+    }
+    return 0;
+}
+
+static unsigned long text_size(char const* path)
+{
+    FILE * fp = fopen(path,"rb");
+    if(!fp)
+        return 0;
+    vector<char> f;
+    char buf[65536];
+    size_t n;
+    while((n = fread(buf,1,sizeof(buf),fp)) > 0)
+        f.insert(f.end(),buf,buf+n);
+    fclose(fp);
+
+    if(f.size() < EI_NIDENT || memcmp(f.data(),ELFMAG,SELFMAG) != 0)
+        return 0;
+    if(f[EI_CLASS] == ELFCLASS64)
+        return text_size<Elf64_Ehdr,Elf64_Shdr>(f);
+    if(f[EI_CLASS] == ELFCLASS32)
+        return text_size<Elf32_Ehdr,Elf32_Shdr>(f);
+    return 0;
+}
+
+/* the regular files of a directory, or the paths of a --batch manifest */
+static void add_corpus(char const* arg, vector<string> & paths)
+{
+    struct stat st;
+    if(stat(arg,&st) != 0) {
+        fprintf(stderr,"Can't read %s: %s\n",arg,strerror(errno));
+        exit(1);
+    }
+
+    if(!S_ISDIR(st.st_mode)) {
+        FILE * fp = fopen(arg,"r");
+        char line[4096];
+        while(fp && fgets(line,sizeof(line),fp)) {
+            line[strcspn(line,"\t\r\n")] = '\0';
+            if(line[0])
+                paths.push_back(line);
+        }
+        if(fp)
+            fclose(fp);
+        return;
+    }
+
+    DIR * d = opendir(arg);
+    struct dirent * de;
+    while(d && (de = readdir(d)) != NULL) {
+        string p = string(arg) + "/" + de->d_name;
+        if(stat(p.c_str(),&st) == 0 && S_ISREG(st.st_mode))
+            paths.push_back(p);
+    }
+    if(d)
+        closedir(d);
+}
+
+/** running **/
+
+/* functions processed, from a --stats file */
+static unsigned long processed(char const* file)
+{
+    FILE * fp = fopen(file,"r");
+    if(!fp)
+        return 0;
+    char line[256];
+    unsigned long n = 0;
+    while(fgets(line,sizeof(line),fp)) {
+        char * p = strstr(line,"\"processed\":");
+        if(p)
+            n = strtoul(p + strlen("\"processed\":"),NULL,10);
+    }
+    fclose(fp);
+    return n;
+}
+
+/* Run one tool over one binary; false if it failed */
+static bool run(string const& bindir, tool const& t, int jobs,
+    binary const& b, char const* statsfile, result & r)
+{
+    string prog = bindir + "/" + t.name;
+    char jobsarg[16];
+    snprintf(jobsarg,sizeof(jobsarg),"%d",jobs);
+
+    vector<char const*> argv;
+    argv.push_back(prog.c_str());
+    for(int i=0;t.args[i];++i)
+        argv.push_back(t.args[i]);
+    argv.push_back("--jobs");
+    argv.push_back(jobsarg);
+    argv.push_back("--stats");
+    argv.push_back(statsfile);
+    argv.push_back(b.path.c_str());
+    argv.push_back(NULL);
+
+    unlink(statsfile);
+    double start = extract::stats::now();
+    pid_t pid = fork();
+    if(pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if(pid == 0) {
+        int null = open("/dev/null",O_WRONLY);
+        dup2(null,1);
+        dup2(null,2);
+        execv(prog.c_str(),(char * const*)argv.data());
+        _exit(127);
+    }
+
+    int status;
+    struct rusage ru;
+    while(wait4(pid,&status,0,&ru) < 0) {
+        if(errno != EINTR) {
+            perror("wait4");
+            exit(1);
+        }
+    }
+    double secs = extract::stats::now() - start;
+
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return false;
+
+    r.seconds += secs;
+    r.functions += processed(statsfile);
+    r.text += b.text;
+    r.peak_rss = max(r.peak_rss,(long)ru.ru_maxrss);
+    return true;
+}
+
+/** output **/
+
+static void write_results(FILE * out, vector<binary> const& corpus,
+    vector<result> const& results)
+{
+    unsigned long text = 0;
+    for(unsigned i=0;i<corpus.size();++i)
+        text += corpus[i].text;
+
+    fprintf(out,"{\n");
+    fprintf(out,"  \"binaries\": %lu,\n",(unsigned long)corpus.size());
+    fprintf(out,"  \"text_bytes\": %lu,\n",text);
+    fprintf(out,"  \"results\": [\n");
+    for(unsigned i=0;i<results.size();++i) {
+        result const& r = results[i];
+        fprintf(out,"    { \"tool\": \"%s\", \"jobs\": %d, "
+            "\"seconds\": %.3f, \"functions\": %lu, "
+            "\"functions_per_sec\": %.1f, \"text_mb_per_sec\": %.3f, "
+            "\"peak_rss_kb\": %ld, \"failures\": %d }%s\n",
+            r.tool.c_str(),r.jobs,r.seconds,r.functions,
+            r.funcs_per_sec(),r.mb_per_sec(),r.peak_rss,r.failures,
+            i+1 < results.size() ? "," : "");
+    }
+    fprintf(out,"  ]\n");
+    fprintf(out,"}\n");
+}
+
+static bool field(char const* line, char const* name, double & v)
+{
+    string key = string("\"") + name + "\":";
+    char const* p = strstr(line,key.c_str());
+    if(!p)
+        return false;
+    v = strtod(p + key.size(),NULL);
+    return true;
+}
+
+/* the results of write_results() */
+static bool read_results(char const* file, vector<result> & results)
+{
+    FILE * fp = fopen(file,"r");
+    if(!fp) {
+        fprintf(stderr,"Can't open baseline %s: %s\n",file,strerror(errno));
+        return false;
+    }
+
+    char line[1024];
+    while(fgets(line,sizeof(line),fp)) {
+        char const* p = strstr(line,"\"tool\": \"");
+        if(!p)
+            continue;
+        p += strlen("\"tool\": \"");
+        char const* e = strchr(p,'"');
+        if(!e)
+            continue;
+
+        result r;
+        double jobs, fps, mbps, rss;
+        r.tool.assign(p,e-p);
+        if(!field(line,"jobs",jobs) ||
+           !field(line,"seconds",r.seconds) ||
+           !field(line,"functions_per_sec",fps) ||
+           !field(line,"text_mb_per_sec",mbps) ||
+           !field(line,"peak_rss_kb",rss))
+            continue;
+        r.jobs = (int)jobs;
+        r.peak_rss = (long)rss;
+        // keep the rates, as seconds * rate
+        r.functions = (unsigned long)(fps * r.seconds + 0.5);
+        r.text = (unsigned long)(mbps * 1e6 * r.seconds + 0.5);
+        r.failures = 0;
+        results.push_back(r);
+    }
+    fclose(fp);
+    return true;
+}
+
+/* Print the change from the baseline of each result to stderr; the
+   number of regressions */
+static int compare(vector<result> const& base, vector<result> const& cur,
+    double tolerance)
+{
+    int regressions = 0;
+
+    fprintf(stderr,"%-16s %4s %14s %14s %8s %12s %12s %8s\n",
+        "tool","jobs","base func/s","func/s","change",
+        "base rss kB","rss kB","change");
+    for(unsigned i=0;i<cur.size();++i) {
+        result const& c = cur[i];
+        result const* b = NULL;
+        for(unsigned j=0;j<base.size();++j) {
+            if(base[j].tool == c.tool && base[j].jobs == c.jobs)
+                b = &base[j];
+        }
+        if(!b)
+            continue;
+
+        double dt = b->funcs_per_sec() > 0 ?
+            c.funcs_per_sec() / b->funcs_per_sec() - 1 : 0;
+        double dm = b->peak_rss > 0 ? (double)c.peak_rss / b->peak_rss - 1 : 0;
+        bool bad = dt < -tolerance || dm > tolerance;
+        regressions += bad;
+
+        fprintf(stderr,
+            "%-16s %4d %14.1f %14.1f %+7.1f%% %12ld %12ld %+7.1f%%%s\n",
+            c.tool.c_str(),c.jobs,b->funcs_per_sec(),c.funcs_per_sec(),
+            dt * 100,b->peak_rss,c.peak_rss,dm * 100,
+            bad ? "  REGRESSION" : "");
+    }
+    return regressions;
+}
+
+/** main **/
+
+void usage(char *s)
+{
+    printf("Usage: %s [options] [dir|manifest ...]\n"
+           "       measures the binaries of /usr/bin if none are given\n"
+           "       --bindir <dir> [where the utilities are; default .]\n"
+           "       --tools <t,...> [utilities to run; default all]\n"
+           "       --jobs <n,...> [thread counts; default 1,2,4,8]\n"
+           "       --max <n> [at most n binaries; default 50]\n"
+           "       --out <file> [write results here; default stdout]\n"
+           "       --baseline <file> [compare with earlier results]\n"
+           "       --tolerance <pct> [allowed change; default 5]\n",s);
+}
+
+static vector<string> split(char const* s)
+{
+    vector<string> ret;
+    string cur;
+    for( ; ; ++s) {
+        if(*s == ',' || *s == '\0') {
+            if(!cur.empty())
+                ret.push_back(cur);
+            cur.clear();
+            if(*s == '\0')
+                break;
+        } else
+            cur += *s;
+    }
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    string bindir = ".";
+    vector<string> want;
+    vector<int> jobs;
+    unsigned max_bins = 50;
+    char * outfile = NULL;
+    char * baseline = NULL;
+    double tolerance = 0.05;
+
+    int ch;
+    int option_index = 0;
+    static struct option long_options[] = {
+        {"help",no_argument,0,'h' },
+        {"bindir",required_argument,0,'d' },
+        {"tools",required_argument,0,'t' },
+        {"jobs",required_argument,0,'j' },
+        {"max",required_argument,0,'m' },
+        {"out",required_argument,0,'o' },
+        {"baseline",required_argument,0,'b' },
+        {"tolerance",required_argument,0,'T' },
+        {0,0,0,0 }
+    };
+
+    while((ch=
+        getopt_long(argc,argv,"h",long_options,&option_index)) != -1)
+    {
+        switch(ch) {
+            case 'd':
+                bindir = optarg;
+                break;
+            case 't':
+                want = split(optarg);
+                break;
+            case 'j': {
+                vector<string> j = split(optarg);
+                for(unsigned i=0;i<j.size();++i)
+                    jobs.push_back(atoi(j[i].c_str()));
+                break;
+            }
+            case 'm':
+                max_bins = strtoul(optarg,NULL,10);
+                break;
+            case 'o':
+                outfile = optarg;
+                break;
+            case 'b':
+                baseline = optarg;
+                break;
+            case 'T':
+                tolerance = atof(optarg) / 100;
+                break;
+            default:
+                printf("Illegal option %c\n",ch);
+            case 'h':
+                usage(argv[0]);
+                exit(1);
+        }
+    }
+
+    if(jobs.empty()) {
+        int j[] = { 1, 2, 4, 8 };
+        jobs.assign(j,j+4);
+    }
+
+    // the corpus: ELF files with a .text, in a fixed order
+    vector<string> paths;
+    if(optind == argc)
+        add_corpus("/usr/bin",paths);
+    for(int i=optind;i<argc;++i)
+        add_corpus(argv[i],paths);
+    sort(paths.begin(),paths.end());
+    paths.erase(unique(paths.begin(),paths.end()),paths.end());
+
+    vector<binary> corpus;
+    for(unsigned i=0;i<paths.size() && corpus.size() < max_bins;++i) {
+        binary b;
+        b.path = paths[i];
+        b.text = text_size(paths[i].c_str());
+        if(b.text)
+            corpus.push_back(b);
+    }
+    if(corpus.empty()) {
+        fprintf(stderr,"No binaries to measure\n");
+        exit(1);
+    }
+
+    char statsfile[] = "/tmp/corpus-stats.XXXXXX";
+    int fd = mkstemp(statsfile);
+    if(fd < 0) {
+        perror("mkstemp");
+        exit(1);
+    }
+    close(fd);
+
+    vector<result> results;
+    for(int t=0;t<NTOOLS;++t) {
+        if(!want.empty() &&
+           find(want.begin(),want.end(),tools[t].name) == want.end())
+            continue;
+        for(unsigned j=0;j<jobs.size();++j) {
+            result r;
+            r.tool = tools[t].name;
+            r.jobs = jobs[j];
+            r.seconds = 0;
+            r.functions = 0;
+            r.text = 0;
+            r.peak_rss = 0;
+            r.failures = 0;
+            for(unsigned i=0;i<corpus.size();++i) {
+                if(!run(bindir,tools[t],jobs[j],corpus[i],statsfile,r))
+                    ++r.failures;
+            }
+            fprintf(stderr,"%s --jobs %d: %.1f functions/s, %.3f MB/s\n",
+                r.tool.c_str(),r.jobs,r.funcs_per_sec(),r.mb_per_sec());
+            results.push_back(r);
+        }
+    }
+    unlink(statsfile);
+
+    FILE * out = stdout;
+    if(outfile && !(out = fopen(outfile,"w"))) {
+        fprintf(stderr,"Can't open %s: %s\n",outfile,strerror(errno));
+        exit(1);
+    }
+    write_results(out,corpus,results);
+    if(out != stdout)
+        fclose(out);
+
+    if(baseline) {
+        vector<result> base;
+        if(!read_results(baseline,base))
+            exit(1);
+        if(compare(base,results,tolerance))
+            exit(1);
+    }
+
+    return 0;
+}
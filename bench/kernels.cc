@@ -0,0 +1,348 @@
+/*
+ * Microbenchmarks of the extraction kernels, over fixed inputs: a
+ * synthetic program (see libextract/synth.h), the instructions of its
+ * code, and the graphlets and edge sets taken from it.
+ *
+ * Each benchmark is run in passes until it has been measured for the
+ * minimum time, and this is repeated; the fastest round is reported,
+ * as ns and heap allocations (operator new) per operation.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include <new>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "InstructionDecoder.h"
+#include "Instruction.h"
+
+#include "feature.h"
+
+#include "cfg_parseapi.h"
+#include "colors.h"
+#include "kernels.h"
+#include "outbuf.h"
+#include "stats.h"
+#include "synth.h"
+
+using namespace std;
+using namespace extract;
+using namespace graphlets;
+using namespace Dyninst::InstructionAPI;
+
+/** allocation counting **/
+
+static unsigned long allocs = 0;
+
+void * operator new(size_t n)
+{
+    ++allocs;
+    void * p = malloc(n ? n : 1);
+    if(!p)
+        throw std::bad_alloc();
+    return p;
+}
+void * operator new[](size_t n) { return operator new(n); }
+void operator delete(void * p) noexcept { free(p); }
+void operator delete[](void * p) noexcept { free(p); }
+void operator delete(void * p, size_t) noexcept { free(p); }
+void operator delete[](void * p, size_t) noexcept { free(p); }
+
+/** harness **/
+
+/* Accumulates the time, allocations and operations of the measured
+   parts of each pass */
+class meter {
+ public:
+    meter() : secs(0), allocs(0), ops(0) { }
+
+    void start() {
+        _t = stats::now();
+        _a = ::allocs;
+    }
+    void stop(unsigned long n) {
+        secs += stats::now() - _t;
+        allocs += ::allocs - _a;
+        ops += n;
+    }
+
+    double secs;
+    unsigned long allocs;
+    unsigned long ops;
+ private:
+    double _t;
+    unsigned long _a;
+};
+
+struct benchmark {
+    char const* name;
+    void (*pass)(meter & m);
+};
+
+static double min_time = 0.5;
+static int rounds = 5;
+
+static void run(benchmark const& b)
+{
+    double best = 0;
+    double allocs = 0;
+    unsigned long ops = 0;
+
+    for(int r=0;r<rounds;++r) {
+        meter m;
+        while(m.secs < min_time / rounds || m.ops == 0)
+            b.pass(m);
+        double ns = m.secs * 1e9 / m.ops;
+        if(r == 0 || ns < best) {
+            best = ns;
+            allocs = (double)m.allocs / m.ops;
+            ops = m.ops;
+        }
+    }
+    printf("%-24s %12.1f ns/op %10.2f allocs/op %12lu ops\n",
+        b.name,best,allocs,ops);
+    fflush(stdout);
+}
+
+/** inputs **/
+
+static cfg::program prog;
+static cfg::code_source * src;
+
+/* [start,end) of the blocks of each function */
+static vector< vector< pair<Address,Address> > > func_blocks;
+
+/* every instruction of the code, decoded */
+static vector<Instruction::Ptr> insns;
+
+static vector<edgeset> edgesets;
+static vector<graphlet> glets;
+
+static void setup()
+{
+    cfg::synth_options o;
+    o.funcs = 200;
+    o.blocks = 24;
+    cfg::synthesize(o,prog);
+    src = new cfg::code_source(prog);
+
+    func_blocks.resize(prog.nfuncs());
+    for(uint32_t f=0;f<prog.nfuncs();++f) {
+        for(uint32_t b : prog.blocks(prog.func(f))) {
+            cfg::block const& B = prog.blk(b);
+            func_blocks[f].push_back(make_pair(B.start,B.end));
+
+            InstructionDecoder dec(prog.code(B.start),B.end - B.start,
+                (Dyninst::Architecture)prog.arch());
+            while(Instruction::Ptr insn = dec.decode())
+                insns.push_back(insn);
+        }
+    }
+
+    // edge sets of the sizes and types the graphlet kernels see
+    unsigned seed = 1;
+    for(int i=0;i<4096;++i) {
+        multiset<int> types;
+        int n = rand_r(&seed) % 5;
+        for(int j=0;j<n;++j)
+            types.insert(rand_r(&seed) % 9);
+        edgesets.push_back(edgeset(types));
+    }
+
+    map<graphlet,int> counts;
+    claim_table claims;
+    for(uint32_t f=0;f<prog.nfuncs();++f)
+        mkgraphlets(prog,f,f,counts,claims,true);
+    for(auto it = counts.begin(); it != counts.end(); ++it)
+        glets.push_back(it->first);
+}
+
+/** benchmarks **/
+
+/* one op is the idiom lookup at one instruction, with a cold term map
+   as for each binary */
+static void lookup_idiom(meter & m)
+{
+    FeatureVector fv;
+    m.start();
+    for(unsigned f=0;f<func_blocks.size();++f)
+        fv.eval(src,func_blocks[f],true,false);
+    m.stop(fv.decoded());
+}
+
+/* the same, counted by key as the extractor does, with idioms of len
+   terms */
+static void count_idioms_len(meter & m, int len)
+{
+    FeatureVector fv(len);
+    m.start();
+    for(unsigned f=0;f<func_blocks.size();++f)
+        fv.count_idioms(src,func_blocks[f]);
+    m.stop(fv.decoded());
+}
+
+static void count_idioms(meter & m)
+{
+    count_idioms_len(m,IDIOM_LEN);
+}
+
+static void count_idioms_2(meter & m)
+{
+    count_idioms_len(m,2);
+}
+
+static void count_idioms_4(meter & m)
+{
+    count_idioms_len(m,4);
+}
+
+/* a length with no kernel of its own */
+static void count_idioms_5(meter & m)
+{
+    count_idioms_len(m,5);
+}
+
+static void insn_color(meter & m)
+{
+    unsigned c = 0;
+    m.start();
+    for(unsigned i=0;i<insns.size();++i)
+        c += InsnColor::lookup(insns[i]);
+    m.stop(insns.size());
+    if(c == 0xffffffff)
+        printf("\n");
+}
+
+static void edgeset_less(meter & m)
+{
+    unsigned n = edgesets.size();
+    unsigned lt = 0;
+    m.start();
+    for(unsigned i=0;i<n;++i) {
+        for(unsigned j=0;j<16;++j)
+            lt += edgesets[i] < edgesets[(i*7 + j*131 + 1) % n];
+    }
+    m.stop(n * 16);
+    if(lt == 0xffffffff)
+        printf("\n");
+}
+
+static void graphlet_compact(meter & m)
+{
+    static outbuf out(NULL,4096);
+    m.start();
+    for(unsigned i=0;i<glets.size();++i) {
+        out.clear();
+        glets[i].compact(out,true);
+    }
+    m.stop(glets.size());
+}
+
+/* one op is one 4-byte n-gram, printed */
+static void ngram_print(meter & m)
+{
+    static outbuf out(NULL,1 << 20);
+    vector<int> lens(1,4);
+    vector<skipgram> skips;
+    extent_set visited;
+    unsigned long n = 0;
+    m.start();
+    for(uint32_t f=0;f<prog.nfuncs();++f) {
+        for(cfg::extent const& e : prog.extents(prog.func(f))) {
+            ngram_runs runs;
+            mkngram_runs(e,visited,runs);
+            out.clear();
+            mkngrams(prog,runs,lens,skips,false,out);
+            n += out.size() / (sizeof("<00000000>,") - 1);
+        }
+    }
+    m.stop(n);
+}
+
+/* one op is a merge pass over the supergraph of one function */
+static void graph_compact(meter & m)
+{
+    vector<graph *> graphs;
+    claim_table claims;
+    for(uint32_t f=0;f<prog.nfuncs();++f)
+        graphs.push_back(func_to_graph(prog,f,f,claims,true));
+
+    srand(1);
+    m.start();
+    for(unsigned i=0;i<graphs.size();++i)
+        graphs[i]->compact();
+    m.stop(graphs.size());
+
+    for(unsigned i=0;i<graphs.size();++i)
+        delete graphs[i];
+}
+
+static benchmark benchmarks[] = {
+    { "lookup_idiom", lookup_idiom },
+    { "count_idioms", count_idioms },
+    { "count_idioms/2", count_idioms_2 },
+    { "count_idioms/4", count_idioms_4 },
+    { "count_idioms/5", count_idioms_5 },
+    { "InsnColor::lookup", insn_color },
+    { "edgeset::operator<", edgeset_less },
+    { "graphlet::compact", graphlet_compact },
+    { "mkngrams", ngram_print },
+    { "graph::compact", graph_compact }
+};
+
+void usage(char *s)
+{
+    printf("Usage: %s [options] [benchmark ...]\n"
+           "       --time <secs> [minimum time measured per benchmark]\n"
+           "       --rounds <n> [report the fastest of n rounds]\n",s);
+}
+
+int main(int argc, char **argv)
+{
+    int ch;
+    int option_index = 0;
+
+    static struct option long_options[] = {
+        {"help",no_argument,0,'h' },
+        {"time",required_argument,0,'t' },
+        {"rounds",required_argument,0,'r' },
+        {0,0,0,0 }
+    };
+
+    while((ch=
+        getopt_long(argc,argv,"h",long_options,&option_index)) != -1)
+    {
+        switch(ch) {
+            case 't':
+                min_time = atof(optarg);
+                break;
+            case 'r':
+                rounds = atoi(optarg);
+                if(rounds < 1)
+                    rounds = 1;
+                break;
+            default:
+                printf("Illegal option %c\n",ch);
+            case 'h':
+                usage(argv[0]);
+                exit(1);
+        }
+    }
+
+    setup();
+
+    for(unsigned i=0;i<sizeof(benchmarks)/sizeof(benchmarks[0]);++i) {
+        bool want = optind == argc;
+        for(int a=optind;a<argc;++a)
+            want |= strcmp(argv[a],benchmarks[i].name) == 0;
+        if(want)
+            run(benchmarks[i]);
+    }
+
+    return 0;
+}
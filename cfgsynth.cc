@@ -0,0 +1,181 @@
+/*
+ * Run the graph kernels over a synthetic program (see libextract/synth.h)
+ * and report the time each took, to measure how they scale with the
+ * shape and size of a CFG apart from parsing and output.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include <map>
+#include <string>
+#include <unordered_map>
+
+#include "kernels.h"
+#include "stats.h"
+#include "synth.h"
+
+using namespace std;
+using namespace extract;
+
+void usage(char *s)
+{
+    printf("Usage: %s [options]\n"
+           "       --shape <random|switch|loops|huge> [CFG shape]\n"
+           "       --funcs <n> [number of functions]\n"
+           "       --blocks <n> [blocks per function]\n"
+           "       --fanout <n> [cases per switch]\n"
+           "       --depth <n> [loop nesting]\n"
+           "       --plt <n> [library functions]\n"
+           "       --calls <pct> [share of blocks ending in a call]\n"
+           "       --seed <n> [generator seed]\n"
+           "       --color [color graphlet nodes by instruction class]\n"
+           "       --merge <n> [supergraphlet merge iterations]\n",s);
+}
+
+/* getopt declarations */
+extern char *optarg;
+extern int optind;
+extern int optopt;
+extern int opterr;
+extern int optreset;
+
+/* options */
+cfg::synth_options sopts;
+bool color = false;
+int merge_iters = 0;
+
+int parse_options(int argc, char**argv)
+{
+    int ch;
+
+    static struct option long_options[] = {
+        {"help",no_argument,0,'h' },
+        {"shape",required_argument,0,'s' },
+        {"funcs",required_argument,0,'f' },
+        {"blocks",required_argument,0,'b' },
+        {"fanout",required_argument,0,'o' },
+        {"depth",required_argument,0,'d' },
+        {"plt",required_argument,0,'p' },
+        {"calls",required_argument,0,'c' },
+        {"seed",required_argument,0,'r' },
+        {"color",no_argument,0,'C' },
+        {"merge",required_argument,0,'m' },
+        {0,0,0,0 }
+    };
+
+    int option_index = 0;
+
+    while((ch=
+        getopt_long(argc,argv,"h",long_options,&option_index)) != -1)
+    {
+        switch(ch) {
+            case 's':
+                if(!cfg::parse_shape(optarg,sopts.kind)) {
+                    printf("Unknown shape %s\n",optarg);
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'f':
+                sopts.funcs = strtoul(optarg,NULL,10);
+                break;
+            case 'b':
+                sopts.blocks = strtoul(optarg,NULL,10);
+                break;
+            case 'o':
+                sopts.fanout = strtoul(optarg,NULL,10);
+                break;
+            case 'd':
+                sopts.depth = strtoul(optarg,NULL,10);
+                break;
+            case 'p':
+                sopts.plt = strtoul(optarg,NULL,10);
+                break;
+            case 'c':
+                sopts.calls = strtoul(optarg,NULL,10);
+                break;
+            case 'r':
+                sopts.seed = strtoull(optarg,NULL,10);
+                break;
+            case 'C':
+                color = true;
+                break;
+            case 'm':
+                merge_iters = atoi(optarg);
+                break;
+            default:
+                printf("Illegal option %c\n",ch);
+            case 'h':
+                usage(argv[0]);
+                exit(1);
+        }
+    }
+
+    return optind;
+}
+
+static void report(char const* kernel, double secs, unsigned long funcs,
+    map<graphlets::graphlet,int> const& counts)
+{
+    unsigned long total = 0;
+    for(auto it = counts.begin(); it != counts.end(); ++it)
+        total += it->second;
+    printf("%-16s %10.6f s %10.0f ns/func %8lu distinct %10lu total\n",
+        kernel,secs,funcs ? secs * 1e9 / funcs : 0.0,
+        (unsigned long)counts.size(),total);
+}
+
+int main(int argc, char **argv)
+{
+    parse_options(argc, argv);
+
+    cfg::program p;
+    double t = stats::now();
+    cfg::synthesize(sopts,p);
+    printf("generated %u functions, %u blocks, %u edges in %.6f s\n",
+        p.nfuncs(),p.nblocks(),p.nedges(),stats::now() - t);
+
+    map<graphlets::graphlet,int> counts;
+    claim_table claims;
+
+    t = stats::now();
+    for(uint32_t f=0;f<p.nfuncs();++f)
+        mkgraphlets(p,f,f,counts,claims,color);
+    report("graphlets",stats::now() - t,p.nfuncs(),counts);
+
+    counts.clear();
+    claims.clear();
+    t = stats::now();
+    for(uint32_t f=0;f<p.nfuncs();++f) {
+        graphlets::graph * g = func_to_graph(p,f,f,claims,color);
+        for(int m=0;m<merge_iters;++m)
+            g->compact();
+        g->mkgraphlets(counts,color,false);
+        delete g;
+    }
+    report("supergraphlets",stats::now() - t,p.nfuncs(),counts);
+
+    counts.clear();
+    dyn_hash_map<string,unsigned short> libmap;
+    t = stats::now();
+    for(uint32_t f=0;f<p.nfuncs();++f) {
+        graphlets::graph * g = mkcalldfa(p,f,libmap);
+        g->mkgraphlets(counts,true,false);
+        delete g;
+    }
+    report("calldfa",stats::now() - t,p.nfuncs(),counts);
+
+    map<string,int> pltcnts;
+    unordered_map<string,bool> real_funcs;
+    t = stats::now();
+    for(uint32_t f=0;f<p.nfuncs();++f)
+        mklibcalls(p,f,pltcnts,real_funcs);
+    double secs = stats::now() - t;
+    printf("%-16s %10.6f s %10.0f ns/func %8lu distinct\n",
+        "libcalls",secs,p.nfuncs() ? secs * 1e9 / p.nfuncs() : 0.0,
+        (unsigned long)pltcnts.size());
+
+    return 0;
+}
@@ -0,0 +1,74 @@
+/*
+ * Convert the binary output of the feature utilities (--binary) back to
+ * the text they would have printed without it
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "binfmt.h"
+
+void usage(char *s)
+{
+    printf("Usage: %s [options] [file]\n"
+           "       reads standard input if no file is given\n",s);
+}
+
+/* getopt declarations */
+extern char *optarg;
+extern int optind;
+extern int optopt;
+extern int opterr;
+extern int optreset;
+
+int parse_options(int argc, char**argv)
+{
+    int ch;
+
+    static struct option long_options[] = {
+        {"help",no_argument,0,'h' },
+        {0,0,0,0 }
+    };
+
+    int option_index = 0;
+
+    while((ch=
+        getopt_long(argc,argv,"h",long_options,&option_index)) != -1)
+    {
+        switch(ch) {
+            default:
+                printf("Illegal option %c\n",ch);
+            case 'h':
+                usage(argv[0]);
+                exit(1);
+        }
+    }
+
+    return optind;
+}
+
+int main(int argc, char **argv)
+{
+    int index = parse_options(argc, argv);
+
+    FILE * in = stdin;
+    if(index < argc) {
+        in = fopen(argv[index],"r");
+        if(!in) {
+            fprintf(stderr,"Can't open %s: %s\n",argv[index],strerror(errno));
+            exit(1);
+        }
+    }
+
+    int ret = extract::bin_to_text(in,stdout);
+
+    if(in != stdin)
+        fclose(in);
+    if(ret)
+        exit(1);
+
+    return 0;
+}
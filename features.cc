@@ -0,0 +1,354 @@
+/*
+ * Generates any combination of the ngram, idiom, graphlet, supergraphlet,
+ * call-DFA and library call features from a single parse of the given
+ * program binary. Each family is printed exactly as its stand-alone
+ * utility would print it, in the order listed above.
+ *
+ * With --batch the binaries are instead read from a manifest and each
+ * is written as a single record: its tag followed by ",feature:count"
+ * for every feature of every family (",<ngram>" for ngrams).
+ *
+ * --binary writes the counts in the format of libextract/binfmt.h
+ * instead; feattext turns them back into the text.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "extract.h"
+
+void usage(char *s)
+{
+    printf("Usage: %s [options] <binary>\n"
+           "       %s [options] --batch <manifest>\n"
+           "       -n <n|m-n|list> [ngrams of each length]\n"
+           "       --skip <patterns> [gapped ngrams, e.g. x.x,xx..x]\n"
+           "       --counts [ngrams: print ngram:count, not each one]\n"
+           "       --opcodes [ngrams: of instruction entry IDs, counted]\n"
+           "       --operands [ngrams: opcodes with operand classes]\n"
+           "       --topk <k> [ngrams: the k most frequent, approximately;\n"
+           "                   with --batch, also of the whole corpus]\n"
+           "       --topk-counters <m> [ngrams: in m counters; default 8k]\n"
+           "       --idioms\n"
+           "       --graphlets\n"
+           "       --supergraphlets\n"
+           "       --calldfa\n"
+           "       --libcalls\n"
+           "       --all [all of the above; requires -n]\n"
+           "       --exclude <file> [exclusion list]\n"
+           "       --commasep [comma separated features]\n"
+           "       --class <class tag> [idioms]\n"
+           "       --nort [idioms: skip RT-discovered funcs]\n"
+           "       --noplt [idioms: skip plt funcs]\n"
+           "       --color [graphlets, supergraphlets: color nodes]\n"
+           "       --merge <n> [supergraphlets: merge iterations]\n"
+           "       --anon [supergraphlets: anonymous, collapsed edges]\n"
+           "       --libmap <file> [calldfa: library func list]\n"
+           "       --jobs <n> [extract with n threads;\n"
+           "                   with --batch, n binaries at a time]\n"
+           "       --cache <dir> [keep parsed binaries in dir]\n"
+           "       --raw [ngrams only: functions from the symbol table,\n"
+           "              without parsing]\n"
+           "       --binary [write counts in binary; see feattext]\n"
+           "       --hash-dims <2^k> [hashed counts in 2^k dimensions]\n"
+           "       --stats <file> [write run statistics as JSON]\n"
+           "       --feature-cache <dir> [reuse per-function counts in dir]\n"
+           "       --idiom-list <file> [idioms: count only those listed]\n"
+           "       --idiom-len <n> [idioms: up to n instructions]\n"
+           "       --batch <file> [binaries to process, one per line,\n"
+           "                      optionally followed by a tab and tag]\n"
+           "       --listall [libcalls: list all plt funcs]\n",s,s);
+}
+
+/* getopt declarations */
+extern char *optarg;
+extern int optind;
+extern int optopt;
+extern int opterr;
+extern int optreset;
+
+/* options */
+extract::options opts;
+char * batch = NULL;
+
+int parse_options(int argc, char**argv)
+{
+    int ch;
+
+    static struct option long_options[] = {
+        {"help",no_argument,0,'h' },
+        {"idioms",no_argument,0,'i' },
+        {"graphlets",no_argument,0,'g' },
+        {"supergraphlets",no_argument,0,'s' },
+        {"calldfa",no_argument,0,'d' },
+        {"libcalls",no_argument,0,'L' },
+        {"all",no_argument,0,'A' },
+        {"exclude",required_argument,0,'e' },
+        {"commasep",no_argument,0,'c' },
+        {"class",required_argument,0,'C' },
+        {"nort",no_argument,0,'r' },
+        {"noplt",no_argument,0,'p' },
+        {"color",no_argument,0,'l' },
+        {"merge",required_argument,0,'m' },
+        {"anon",no_argument,0,'a' },
+        {"libmap",required_argument,0,'M' },
+        {"listall",no_argument,0,'x' },
+        {"jobs",required_argument,0,'j' },
+        {"cache",required_argument,0,'K' },
+        {"binary",no_argument,0,'B' },
+        {"hash-dims",required_argument,0,'H' },
+        {"stats",required_argument,0,'S' },
+        {"skip",required_argument,0,'k' },
+        {"counts",no_argument,0,'N' },
+        {"raw",no_argument,0,'R' },
+        {"opcodes",no_argument,0,'O' },
+        {"operands",no_argument,0,'P' },
+        {"topk",required_argument,0,'T' },
+        {"topk-counters",required_argument,0,'W' },
+        {"feature-cache",required_argument,0,'F' },
+        {"idiom-list",required_argument,0,'I' },
+        {"idiom-len",required_argument,0,'E' },
+        {"batch",required_argument,0,'b' },
+        {0,0,0,0 }
+    };
+
+    int option_index = 0;
+
+    while((ch=
+        getopt_long(argc,argv,"hcn:e:",long_options,&option_index)) != -1)
+    {
+        switch(ch) {
+            case 'n':
+                if(!extract::parse_lengths(optarg,opts.ngram_lens)) {
+                    printf("Bad ngram lengths %s\n",optarg);
+                    usage(argv[0]);
+                    exit(1);
+                }
+                opts.families |= extract::NGRAMS;
+                break;
+            case 'i':
+                opts.families |= extract::IDIOMS;
+                break;
+            case 'g':
+                opts.families |= extract::GRAPHLETS;
+                break;
+            case 's':
+                opts.families |= extract::SUPERGRAPHLETS;
+                break;
+            case 'd':
+                opts.families |= extract::CALLDFA;
+                break;
+            case 'L':
+                opts.families |= extract::LIBCALLS;
+                break;
+            case 'A':
+                opts.families |= extract::ALL_FAMILIES;
+                break;
+            case 'e':
+                opts.exclude = optarg;
+                break;
+            case 'j':
+                opts.jobs = atoi(optarg);
+                break;
+            case 'K':
+                opts.cache = optarg;
+                break;
+            case 'B':
+                opts.binary = true;
+                break;
+            case 'S':
+                opts.stats = optarg;
+                break;
+            case 'k':
+                if(!extract::parse_skipgrams(optarg,opts.skipgrams)) {
+                    printf("Bad skip-gram patterns %s\n",optarg);
+                    usage(argv[0]);
+                    exit(1);
+                }
+                opts.families |= extract::NGRAMS;
+                break;
+            case 'N':
+                opts.ngram_counts = true;
+                break;
+            case 'R':
+                opts.raw = true;
+                break;
+            case 'P':
+                opts.ngram_operands = true;
+                // fall through
+            case 'O':
+                opts.ngram_opcodes = true;
+                break;
+            case 'T':
+                if(atoi(optarg) <= 0) {
+                    printf("--topk must be positive\n");
+                    usage(argv[0]);
+                    exit(1);
+                }
+                opts.ngram_topk = atoi(optarg);
+                break;
+            case 'W':
+                if(atoi(optarg) <= 0) {
+                    printf("--topk-counters must be positive\n");
+                    usage(argv[0]);
+                    exit(1);
+                }
+                opts.topk_counters = atoi(optarg);
+                break;
+            case 'H':
+                opts.hash_dims = extract::parse_dims(optarg);
+                if(0 == opts.hash_dims) {
+                    printf("Dimensions must be a power of two\n");
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'F':
+                opts.fcache = optarg;
+                break;
+            case 'I':
+                opts.idiom_list = extract::load_idiom_list(optarg);
+                if(!opts.idiom_list) {
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'E':
+                opts.idiom_len = extract::parse_idiom_len(optarg);
+                if(0 == opts.idiom_len) {
+                    printf("Bad idiom length %s\n",optarg);
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'b':
+                batch = optarg;
+                break;
+            case 'c':
+                opts.commasep = true;
+                break;
+            case 'C':
+                opts.class_tag = optarg;
+                break;
+            case 'r':
+                opts.nort = true;
+                break;
+            case 'p':
+                opts.noplt = true;
+                break;
+            case 'l':
+                opts.color = true;
+                break;
+            case 'm':
+                opts.merge = atoi(optarg);
+                break;
+            case 'a':
+                opts.anon = true;
+                break;
+            case 'M':
+                opts.libmap = optarg;
+                break;
+            case 'x':
+                opts.listall = true;
+                break;
+            default:
+                printf("Illegal option %c\n",ch);
+            case 'h':
+                usage(argv[0]);
+                exit(1);
+        }
+    }
+
+    if(0 == opts.families) {
+        printf("At least one feature family is required\n");
+        usage(argv[0]);
+        exit(1);
+    }
+
+    if(opts.families & extract::NGRAMS && opts.ngram_lens.empty() &&
+       opts.skipgrams.empty()) {
+        printf("Length of ngrams is required\n");
+        usage(argv[0]);
+        exit(1);
+    }
+
+    if(opts.ngram_opcodes && !opts.skipgrams.empty()) {
+        printf("--skip does not apply to --opcodes\n");
+        usage(argv[0]);
+        exit(1);
+    }
+
+    if(opts.ngram_topk && (opts.ngram_opcodes || !opts.skipgrams.empty())) {
+        printf("--topk applies to byte ngrams alone\n");
+        usage(argv[0]);
+        exit(1);
+    }
+
+    if(opts.topk_counters && opts.topk_counters < opts.ngram_topk) {
+        printf("--topk-counters must be at least --topk\n");
+        usage(argv[0]);
+        exit(1);
+    }
+
+    if(opts.raw && opts.ngram_opcodes) {
+        printf("--raw has no instructions for --opcodes\n");
+        usage(argv[0]);
+        exit(1);
+    }
+
+    if(opts.raw && opts.families != extract::NGRAMS) {
+        printf("--raw applies to ngrams alone\n");
+        usage(argv[0]);
+        exit(1);
+    }
+
+    if(opts.binary && opts.families & extract::NGRAMS) {
+        printf("--binary does not apply to ngrams\n");
+        usage(argv[0]);
+        exit(1);
+    }
+
+    if(opts.binary && opts.hash_dims) {
+        printf("--binary and --hash-dims are exclusive\n");
+        usage(argv[0]);
+        exit(1);
+    }
+
+    if(opts.hash_dims && opts.families & extract::NGRAMS) {
+        printf("--hash-dims does not apply to ngrams\n");
+        usage(argv[0]);
+        exit(1);
+    }
+
+    return optind;
+}
+
+int main(int argc, char **argv)
+{
+    double started = extract::stats::now();
+    srand((unsigned int)time(NULL));
+
+    int binindex = parse_options(argc, argv);
+
+    if(batch) {
+        if(extract::run_batch(opts,batch,stdout))
+            exit(1);
+        return 0;
+    }
+
+    if(argc-1<binindex) {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    extract::extractor ex(opts);
+    int ret = ex.run(argv[binindex]);
+    if(opts.stats)
+        extract::write_stats(opts.stats,ex.statistics(),started);
+    if(ret)
+        exit(1);
+
+    return 0;
+}
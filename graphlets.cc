@@ -3,34 +3,11 @@
  * the given program binary. 
  */
 #include <stdio.h>
-#include <sys/types.h>
-#include <sys/stat.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <getopt.h>
-#include <errno.h>
-#include <assert.h>
 
-#include <string>
-#include <vector>
-
-#include "InstructionDecoder.h"
-#include "Instruction.h"
-#include <boost/iterator/filter_iterator.hpp>
-using boost::make_filter_iterator; 
-
-#include "CodeSource.h"
-#include "CodeObject.h"
-#include "Function.h"
-#include "dyntypes.h"
-
-#include "graphlet.h"
-#include "colors.h"
-
-using namespace std;
-using namespace Dyninst;
-using namespace Dyninst::ParseAPI;
-using namespace Dyninst::InstructionAPI;
-using namespace graphlets;
+#include "extract.h"
 
 void usage(char *s)
 {
@@ -39,11 +16,15 @@ void usage(char *s)
            "       --color [color nodes based on instructions]\n"
            "       --nodes <n> [number of nodes]\n"
            "       --byfunc [print functions separately]\n"
+           "       --jobs <n> [extract with n threads]\n"
+           "       --cache <dir> [keep parsed binaries in dir]\n"
+           "       --binary [write counts in binary; see feattext]\n"
+           "       --hash-dims <2^k> [hashed counts in 2^k dimensions]\n"
+           "       --stats <file> [write run statistics as JSON]\n"
+           "       --feature-cache <dir> [reuse per-function counts in dir]\n"
            "       --commasep [comma separated graphlets]\n",s);
 }
 
-FILE * out;
-
 /* getopt declarations */
 extern char *optarg;
 extern int optind;
@@ -52,11 +33,8 @@ extern int opterr;
 extern int optreset;
 
 /* options */
-char * EXCLUDE = NULL;
-bool COMMASEP = false;
-bool COLOR = false;
+extract::options opts;
 int NODES = 3;
-bool BYFUNC = false;
 
 int parse_options(int argc, char**argv)
 {
@@ -68,7 +46,14 @@ int parse_options(int argc, char**argv)
         {"color",no_argument,0,'l'},
         {"nodes",required_argument,0,'n'},
         {"commasep",no_argument,0,'c' },
-        {"byfunc",no_argument,0,'b' }
+        {"byfunc",no_argument,0,'b' },
+        {"jobs",required_argument,0,'j' },
+        {"cache",required_argument,0,'K' },
+        {"binary",no_argument,0,'B' },
+        {"hash-dims",required_argument,0,'H' },
+        {"stats",required_argument,0,'S' },
+        {"feature-cache",required_argument,0,'F' },
+        {0,0,0,0 }
     };
 
     int option_index = 0;
@@ -78,19 +63,42 @@ int parse_options(int argc, char**argv)
     {
         switch(ch) {
             case 'e':
-                EXCLUDE = optarg;
+                opts.exclude = optarg;
+                break;
+            case 'j':
+                opts.jobs = atoi(optarg);
+                break;
+            case 'K':
+                opts.cache = optarg;
+                break;
+            case 'B':
+                opts.binary = true;
+                break;
+            case 'S':
+                opts.stats = optarg;
+                break;
+            case 'H':
+                opts.hash_dims = extract::parse_dims(optarg);
+                if(0 == opts.hash_dims) {
+                    printf("Dimensions must be a power of two\n");
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'F':
+                opts.fcache = optarg;
                 break;
             case 'c':
-                COMMASEP = true;
+                opts.commasep = true;
                 break;
             case 'n':
                 NODES = atoi(optarg);
                 break;
             case 'l':
-                COLOR = true;
+                opts.color = true;
                 break;
             case 'b':
-                BYFUNC = true;
+                opts.byfunc = true;
                 break;
             default:
                 printf("Illegal option %c\n",ch);
@@ -100,262 +108,35 @@ int parse_options(int argc, char**argv)
         }
     }
 
-    if(BYFUNC)
-        COMMASEP=true;
-
-    return optind;
-}
-
-inline void
-chomp(char*s)
-{
-    for( ; *s != '\0'; ++s)
-        if(*s == '\n') {
-            *s = '\0';
-            break;
-        }
-}
-
-
-void load_exclude(dyn_hash_map<string,bool> & exclude)
-{
-    char * buf = NULL;
-    size_t n = 0;
-    ssize_t read;
-
-    FILE * exin = fopen(EXCLUDE,"r");
-    if(!exin) {
-        fprintf(stderr,"Can't open exclude file %s: %s\n",
-            EXCLUDE,strerror(errno));
-        return;
-    }
-
-    while(-1 != (read = getline(&buf,&n,exin))) {
-        chomp(buf);            
-        exclude[string(buf)] = true;
-    }
-    
-    if(buf) 
-        free(buf); 
-}
-
-unsigned short node_color(Block * A)
-{
-    using namespace Dyninst::InstructionAPI;
-    unsigned short ret = 0;
-    
-    CodeRegion * cr = A->region();
-    const unsigned char* bufferBegin =
-            (const unsigned char*)(cr->getPtrToInstruction(A->start()));
-    if(!bufferBegin)
-        return 0;
-
-    InstructionDecoder dec(bufferBegin, A->end() - A->start(), cr->getArch());
-    while(Instruction::Ptr insn = dec.decode()) {
-        InsnColor::insn_color c = InsnColor::lookup(insn);    
-        if(c != InsnColor::NOCOLOR) {
-            assert(c <= 16);
-            ret |= (1 << c); 
-        }
-    }
-    return ret; 
-}
-
-// build edge type sets for A given B and C
-node edge_sets(Block * A, Block * B, Block * C)
-{
-    multiset<int> ins;
-    multiset<int> outs;
-    multiset<int> selfs;
-    unsigned short color = 0;
-
-    Block::edgelist srcs = A->sources();
-    Block::edgelist trgs = A->targets();
-    
-    Block::edgelist::iterator eit;
-
-    for(eit=srcs.begin();eit != srcs.end(); ++eit) {
-        if((*eit)->src() == B || (*eit)->src() == C)
-            ins.insert((*eit)->type());
-        else if((*eit)->src() == A)
-            selfs.insert((*eit)->type());
-    }
-    for(eit=trgs.begin();eit != trgs.end(); ++eit) {
-        if((*eit)->trg() == B || (*eit)->trg() == C)
-            outs.insert((*eit)->type());
-        // don't duplicate self edges
-    }
-
-    if(COLOR)
-        color = node_color(A);
+    if(opts.byfunc)
+        opts.commasep=true;
 
-    return node(ins,outs,selfs,color);
-}
-
-void mkgraphlets(Function * f, 
-    std::map<graphlet,int> & counts,
-    dyn_hash_map<Address,bool> & seen)
-{
-    NoSinkPredicate nosink;
-
-    // Foreach block in the function
-    //   for each pair of its neighboring *blocks*
-    //     make a graphlet describing this triple & record it 
-    auto blocks = f->blocks();
-
-    for(auto bit = blocks.begin(); bit != blocks.end(); ++bit) {
-        Block * b = *bit;
-
-        if(seen.find(b->start()) != seen.end())
-            continue;
-        seen[b->start()] = true;
-
-        Block::edgelist srcs = b->sources();
-        Block::edgelist trgs = b->targets();
-
-        // Step one: reduce the edge set to a block set
-        std::set<Block*> srcblks;
-        std::set<Block*> trgblks;
-  
-        for(auto eit = make_filter_iterator(nosink, srcs.begin(), srcs.end());
-                    eit != make_filter_iterator(nosink, srcs.end(), srcs.end());
-                    eit++) {
-            if((*eit)->src() != b)
-                srcblks.insert((*eit)->src());
-        }
-        for(auto eit = make_filter_iterator(nosink, trgs.begin(), trgs.end());
-                    eit != make_filter_iterator(nosink, trgs.end(), trgs.end());
-                    eit++) {
-            if((*eit)->trg() != b) 
-                trgblks.insert((*eit)->trg());
-        }
-
-        // Step two: build graphlets from various pairs:
-        std::set<Block*>::iterator A;
-        std::set<Block*>::iterator B;
-
-        // 1. source & source
-        for(A=srcblks.begin();A!=srcblks.end();++A) {
-            B=A;++B;
-            for( ; B != srcblks.end(); ++B) {
-                graphlet g;
-                g.addNode( edge_sets(*A,*B,b) );
-                g.addNode( edge_sets(*B,*A,b) );
-                g.addNode( edge_sets(b,*A,*B) );
-                counts[g] += 1; 
-                
-                //printf("1 made graphlet size %d %s\n",g.size(),g.toString().c_str());
-            }
-        } 
-    
-        // 2. trg & trg
-        for(A=trgblks.begin();A!=trgblks.end();++A) {
-            B=A;++B;
-            for( ; B!=trgblks.end();++B) {
-                graphlet g;
-                g.addNode( edge_sets(*A,*B,b) );
-                g.addNode( edge_sets(*B,*A,b) );
-                g.addNode( edge_sets(b,*A,*B) );
-                counts[g] += 1; 
-                //printf("2 made graphlet size %d %s\n",g.size(),g.toString().c_str());
-            }
-        }
-                
-        // 3. source & trg
-        for(A=srcblks.begin();A!=srcblks.end();++A) {
-            for(B=trgblks.begin();B!=trgblks.end();++B) {
-                if(*A == *B)
-                    continue;
-                graphlet g;
-                g.addNode( edge_sets(*A,*B,b) );
-                g.addNode( edge_sets(*B,*A,b) );
-                g.addNode( edge_sets(b,*A,*B) );
-                counts[g] += 1; 
-                //printf("3 made graphlet size %d %s\n",g.size(),g.toString().c_str());
-            }
-        }
-    }
-}
-
-void print(std::map<graphlet,int>& counts)
-{
-    std::map<graphlet,int>::const_iterator cit = counts.begin();
-    for( ; cit != counts.end(); ++cit) {
-        const char * sep;
-        if(COMMASEP)
-            sep = ",";
-        else
-            sep = "\n";
-        printf("%s:%d%s",(cit->first).compact(COLOR).c_str(),cit->second,sep);
+    if(opts.binary && opts.hash_dims) {
+        printf("--binary and --hash-dims are exclusive\n");
+        usage(argv[0]);
+        exit(1);
     }
 
-    if(COMMASEP)
-        printf("\n");
+    return optind;
 }
 
 int main(int argc, char **argv)
 {
-    dyn_hash_map<string, bool> exclude;
-    SymtabCodeSource *sts;
-    CodeObject *co;
-    struct stat sbuf;
-
-    // to ensure we don't duplicate addresses
-    dyn_hash_map<Address,bool> visited;
-
-    // graphlet counts
-    std::map<graphlet,int> counts;
+    double started = extract::stats::now();
+    opts.families = extract::GRAPHLETS;
 
     int binindex = parse_options(argc, argv);
     if(argc-1<binindex) {
         usage(argv[0]);
         exit(1);
     }
-    
-    if(0 != stat(argv[binindex],&sbuf)) {
-        fprintf(stderr,"Failed to stat %s: ",argv[binindex]);
-        perror("");
-        exit(1);
-    }
-    sts = new SymtabCodeSource( argv[binindex] );
-    co = new CodeObject( sts );
-    co->parse();
-
-    auto funcs = co->funcs();
-
-    if(EXCLUDE)
-        load_exclude(exclude);    
-
-    CodeObject::funclist::iterator fit = funcs.begin();
-    for( ; fit != funcs.end(); ++fit) {
-        Function * f = *fit;
-        if(exclude.find(f->name()) != exclude.end()) {
-            //fprintf(stderr,"skipped %s\n",f->name().c_str());
-            continue; 
-        }
 
-        if(strncmp(f->name().c_str(),"std::",5) == 0 ||
-           strncmp(f->name().c_str(),"__gnu_cxx::",11) == 0) {
-            //fprintf(stderr,"skipped %s\n",f->name().c_str());
-            continue;
-        }
-
-        mkgraphlets(f,counts,visited);
-
-        if(BYFUNC) {
-            printf("%lx,",f->addr());
-            print(counts);
-            counts.clear();
-            visited.clear();
-        }
-    }
-
-    if(!BYFUNC)
-        print(counts);
-
-    delete co;
-    delete sts;
+    extract::extractor ex(opts);
+    int ret = ex.run(argv[binindex]);
+    if(opts.stats)
+        extract::write_stats(opts.stats,ex.statistics(),started);
+    if(ret)
+        exit(1);
 
     return 0;
 }
-
@@ -1,29 +1,9 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/types.h>
-#include <sys/stat.h>
 #include <unistd.h>
 #include <getopt.h>
-#include <errno.h>
 
-#include <vector>
-#include <unordered_map>
-#include <map>
-
-#include "InstructionDecoder.h"
-#include "Instruction.h"
-
-#include "CodeSource.h"
-#include "CodeObject.h"
-#include "Function.h"
-
-#include "feature.h"
-
-using namespace std;
-using namespace __gnu_cxx;
-using namespace Dyninst;
-using namespace Dyninst::ParseAPI;
-using namespace Dyninst::InstructionAPI;
+#include "extract.h"
 
 void usage(char *s)
 {
@@ -32,6 +12,14 @@ void usage(char *s)
                 "       --nort     [skip RT-discovered funcs]\n"
                 "       --name     [print name]\n"
                 "       --exclude <file> [exclusion list]\n"
+                "       --jobs <n> [extract with n threads]\n"
+                "       --cache <dir> [keep parsed binaries in dir]\n"
+                "       --binary [write counts in binary; see feattext]\n"
+                "       --hash-dims <2^k> [hashed counts in 2^k dimensions]\n"
+                "       --stats <file> [write run statistics as JSON]\n"
+                "       --feature-cache <dir> [reuse per-function counts in dir]\n"
+                "       --idiom-list <file> [count only the idioms listed]\n"
+                "       --idiom-len <n> [idioms of up to n instructions]\n"
                 "       --help [display this message]\n",s);
 }
 
@@ -42,10 +30,7 @@ extern int optopt;
 extern int opterr;
 extern int optreset;
 
-char * CLASS_TAG = NULL;
-bool NORT = false;
-bool NOPLT = false;
-char * EXCLUDE = NULL;
+extract::options opts;
 
 int parse_options(int argc, char**argv)
 {
@@ -59,6 +44,15 @@ int parse_options(int argc, char**argv)
         {"noprint",0,0,'n'},
         {"help",0,0,'h'},
         {"exclude",required_argument,0,'e'},
+        {"jobs",required_argument,0,'j'},
+        {"cache",required_argument,0,'K'},
+        {"binary",no_argument,0,'B'},
+        {"hash-dims",required_argument,0,'H'},
+        {"stats",required_argument,0,'S'},
+        {"feature-cache",required_argument,0,'F'},
+        {"idiom-list",required_argument,0,'I'},
+        {"idiom-len",required_argument,0,'E'},
+        {0,0,0,0 }
     };
 
     while((ch = 
@@ -66,16 +60,54 @@ int parse_options(int argc, char**argv)
     {
         switch(ch) {
             case 'c':
-                CLASS_TAG = optarg;
+                opts.class_tag = optarg;
                 break;
             case 'r':
-                NORT = true;
+                opts.nort = true;
                 break;
             case 'p':
-                NOPLT = true;
+                opts.noplt = true;
                 break;
             case 'e':
-                EXCLUDE = optarg;
+                opts.exclude = optarg;
+                break;
+            case 'j':
+                opts.jobs = atoi(optarg);
+                break;
+            case 'K':
+                opts.cache = optarg;
+                break;
+            case 'B':
+                opts.binary = true;
+                break;
+            case 'S':
+                opts.stats = optarg;
+                break;
+            case 'H':
+                opts.hash_dims = extract::parse_dims(optarg);
+                if(0 == opts.hash_dims) {
+                    printf("Dimensions must be a power of two\n");
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'F':
+                opts.fcache = optarg;
+                break;
+            case 'I':
+                opts.idiom_list = extract::load_idiom_list(optarg);
+                if(!opts.idiom_list) {
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'E':
+                opts.idiom_len = extract::parse_idiom_len(optarg);
+                if(0 == opts.idiom_len) {
+                    printf("Bad idiom length %s\n",optarg);
+                    usage(argv[0]);
+                    exit(1);
+                }
                 break;
             case 'h':
             default:
@@ -84,118 +116,30 @@ int parse_options(int argc, char**argv)
         }
     }
 
-    return optind;
-} 
-
-inline void
-chomp(char*s)
-{
-    for( ; *s != '\0'; ++s)
-        if(*s == '\n') {
-            *s = '\0';
-            break;
-        }
-}
-
-
-void load_exclude(unordered_map<string,bool> & exclude)
-{
-    char * buf = NULL;
-    size_t n = 0;
-    ssize_t read;
-
-    FILE * exin = fopen(EXCLUDE,"r");
-    if(!exin) {
-        fprintf(stderr,"Can't open exclude file %s: %s\n",
-            EXCLUDE,strerror(errno));
-        return;
-    }
-
-    while(-1 != (read = getline(&buf,&n,exin))) {
-        chomp(buf);
-        exclude[string(buf)] = true;
+    if(opts.binary && opts.hash_dims) {
+        printf("--binary and --hash-dims are exclusive\n");
+        usage(argv[0]);
+        exit(1);
     }
 
-    if(buf)
-        free(buf);
-}
-
-void print(map<string,int>&counts)
-{
-    map<string,int>::const_iterator cit= counts.begin();
-    for( ; cit != counts.end(); ++cit) {
-        printf(",%s:%d",(*cit).first.c_str(),(*cit).second);
-    }
-}
+    return optind;
+} 
 
 int main(int argc, char**argv) {
-    unordered_map<string, bool> exclude;
-    SymtabCodeSource *sts;
-    CodeObject *co;
-    struct stat sbuf;
+    double started = extract::stats::now();
     int binindex;
-    FeatureVector fv;
-    
-    map<string, int> counts;
+
+    opts.families = extract::IDIOMS;
 
     if(argc-1<(binindex=parse_options(argc,argv))) {
         usage(argv[0]);
         exit(1);
     }
 
-    if(0 != stat(argv[binindex],&sbuf)) {
-        fprintf(stderr,"Binary target %s not found\n",argv[binindex]);
-        perror("");
+    extract::extractor ex(opts);
+    int ret = ex.run(argv[binindex]);
+    if(opts.stats)
+        extract::write_stats(opts.stats,ex.statistics(),started);
+    if(ret)
         exit(1);
-    }
-
-    if(EXCLUDE)
-        load_exclude(exclude);
-
-    sts = new SymtabCodeSource(argv[binindex]);
-    co = new CodeObject(sts);
-
-    co->parse();
-    auto funcs = co->funcs();
-    for(CodeObject::funclist::iterator fit = funcs.begin();
-        fit != funcs.end();
-        ++fit)
-    {
-        Function * f = *fit;
-        if(exclude.find(f->name()) != exclude.end()) {
-            //fprintf(stderr,"skipped %s\n",f->name().c_str());
-            continue;
-        }
-
-        if(strncmp(f->name().c_str(),"std::",5) == 0 ||
-           strncmp(f->name().c_str(),"__gnu_cxx::",11) == 0) {
-            //fprintf(stderr,"skipped %s\n",f->name().c_str());
-            continue;
-        }
-
-        if(!(*fit)->blocks().empty()) {
-            if(NORT && (*fit)->src() == RT)
-                continue;
-    
-            if(NOPLT && sts->linkage().find((*fit)->addr()) !=
-                        sts->linkage().end())
-                continue;
-            
-            fv.eval((*fit),true,false);
-            FeatureVector::iterator fvit = fv.begin();
-            for( ; fvit != fv.end(); ++fvit) {
-                counts[(*fvit)->format()] += 1;
-            }
-        }
-    }
-
-    if(CLASS_TAG)
-       printf("%s",CLASS_TAG);
-
-    print(counts); 
-    printf("\n");
-
-    delete co;
-    delete sts;
 }
-
@@ -2,39 +2,25 @@
  * Generate the set of library calls the program makes
  */
 #include <stdio.h>
-#include <sys/types.h>
-#include <sys/stat.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <getopt.h>
-#include <errno.h>
 
-#include <string>
-#include <vector>
-#include <unordered_map>
-
-#include "InstructionDecoder.h"
-#include "Instruction.h"
-
-#include "CodeSource.h"
-#include "CodeObject.h"
-#include "Function.h"
-
-using namespace std;
-using namespace __gnu_cxx;
-using namespace Dyninst;
-using namespace Dyninst::ParseAPI;
-using namespace Dyninst::InstructionAPI;
+#include "extract.h"
 
 void usage(char *s)
 {
     printf("Usage: %s [options] <binary>\n"
            "       --exclude <file> [exclusion list]\n"
            "       --listcall [print all plt funcs]\n"
+           "       --jobs <n> [extract with n threads]\n"
+           "       --cache <dir> [keep parsed binaries in dir]\n"
+           "       --binary [write counts in binary; see feattext]\n"
+           "       --hash-dims <2^k> [hashed counts in 2^k dimensions]\n"
+           "       --stats <file> [write run statistics as JSON]\n"
            "       --commasep [comma separated ngrams]\n",s);
 }
 
-FILE * out;
-
 /* getopt declarations */
 extern char *optarg;
 extern int optind;
@@ -43,9 +29,7 @@ extern int opterr;
 extern int optreset;
 
 /* options */
-char * EXCLUDE = NULL;
-bool COMMASEP = false;
-bool LISTALL = false;
+extract::options opts;
 
 int parse_options(int argc, char**argv)
 {
@@ -55,7 +39,13 @@ int parse_options(int argc, char**argv)
         {"help",no_argument,0,'h' },
         {"exclude",required_argument,0,'e' },
         {"commasep",no_argument,0,'c' },
-        {"listall",no_argument,0,'l' }
+        {"listall",no_argument,0,'l' },
+        {"jobs",required_argument,0,'j' },
+        {"cache",required_argument,0,'K' },
+        {"binary",no_argument,0,'B' },
+        {"hash-dims",required_argument,0,'H' },
+        {"stats",required_argument,0,'S' },
+        {0,0,0,0 }
     };
 
     int option_index = 0;
@@ -65,13 +55,33 @@ int parse_options(int argc, char**argv)
     {
         switch(ch) {
             case 'e':
-                EXCLUDE = optarg;
+                opts.exclude = optarg;
+                break;
+            case 'j':
+                opts.jobs = atoi(optarg);
+                break;
+            case 'K':
+                opts.cache = optarg;
+                break;
+            case 'B':
+                opts.binary = true;
+                break;
+            case 'S':
+                opts.stats = optarg;
+                break;
+            case 'H':
+                opts.hash_dims = extract::parse_dims(optarg);
+                if(0 == opts.hash_dims) {
+                    printf("Dimensions must be a power of two\n");
+                    usage(argv[0]);
+                    exit(1);
+                }
                 break;
             case 'c':
-                COMMASEP = true;
+                opts.commasep = true;
                 break;
             case 'l':
-                LISTALL = true;
+                opts.listall = true;
                 break;
             default:
                 printf("Illegal option %c\n",ch);
@@ -81,129 +91,32 @@ int parse_options(int argc, char**argv)
         }
     }
 
-    return optind;
-}
-
-inline void
-chomp(char*s)
-{
-    for( ; *s != '\0'; ++s)
-        if(*s == '\n') {
-            *s = '\0';
-            break;
-        }
-}
-
-
-void load_exclude(unordered_map<string,bool> & exclude)
-{
-    char * buf = NULL;
-    size_t n = 0;
-    ssize_t read;
-
-    FILE * exin = fopen(EXCLUDE,"r");
-    if(!exin) {
-        fprintf(stderr,"Can't open exclude file %s: %s\n",
-            EXCLUDE,strerror(errno));
-        return;
+    if(opts.binary && opts.hash_dims) {
+        printf("--binary and --hash-dims are exclusive\n");
+        usage(argv[0]);
+        exit(1);
     }
 
-    while(-1 != (read = getline(&buf,&n,exin))) {
-        chomp(buf);            
-        exclude[string(buf)] = true;
-    }
-    
-    if(buf) 
-        free(buf); 
+    return optind;
 }
 
 int main(int argc, char **argv)
 {
-    unordered_map<string, bool> exclude;
-    SymtabCodeSource *sts;
-    CodeObject *co;
-    struct stat sbuf;
+    double started = extract::stats::now();
+    opts.families = extract::LIBCALLS;
 
     int binindex = parse_options(argc, argv);
     if(argc-1<binindex) {
         usage(argv[0]);
         exit(1);
     }
-    
-    if(0 != stat(argv[binindex],&sbuf)) {
-        fprintf(stderr,"Failed to stat %s: ",argv[binindex]);
-        perror("");
-        exit(1);
-    }
-    sts = new SymtabCodeSource( argv[binindex] );
-    co = new CodeObject( sts );
-    co->parse();
-
-    auto funcs = co->funcs();
-
-    if(EXCLUDE)
-        load_exclude(exclude);    
-
-   
-    unordered_map<string, int> pltcnts; 
-
-    if(LISTALL) {
-        std::map<Address, std::string>::iterator pltit =
-            co->cs()->linkage().begin();
-        for( ; pltit != co->cs()->linkage().end(); ++pltit)
-            pltcnts[(*pltit).second] = 0;
-    }
-
-    unordered_map<string,bool> real_funcs;
-
-    CodeObject::funclist::iterator fit = funcs.begin();
-    for( ; fit != funcs.end(); ++fit) {
-        Function * f = *fit;
-        if(exclude.find(f->name()) != exclude.end()) {
-            //fprintf(stderr,"skipped %s\n",f->name().c_str());
-            continue; 
-        }
-
-        if(strncmp(f->name().c_str(),"std::",5) == 0 ||
-           strncmp(f->name().c_str(),"__gnu_cxx::",11) == 0) {
-            //fprintf(stderr,"skipped %s\n",f->name().c_str());
-            continue;
-        }
 
-        auto calls = f->callEdges();
-        Function::edgelist::iterator it = calls.begin();
-        for( ; it != calls.end(); ++it) {
-            Edge * e = *it;
-            std::map<Address, std::string>::iterator pltit =
-                co->cs()->linkage().find(e->trg()->start());
-            if(pltit != co->cs()->linkage().end()) {
-                pltcnts[(*pltit).second] += 1;
-            }      
-        }
-
-        if(co->cs()->linkage().find(f->addr()) == co->cs()->linkage().end()) {
-            real_funcs[f->name()] = true;
-        }
-    }
-
-    unordered_map<string,int>::iterator cit = pltcnts.begin();
-    for( ; cit != pltcnts.end(); ++cit) {
-        char const* sep;
-        if(COMMASEP)
-            sep = ",";
-        else
-            sep = "\n";
-
-
-        if(real_funcs.find((*cit).first) == real_funcs.end())
-            printf("%s:%d%s",(*cit).first.c_str(),(*cit).second,sep);
-    }
-
-    if(COMMASEP)
-        printf("\n");
-
-    delete co;
-    delete sts;
+    extract::extractor ex(opts);
+    int ret = ex.run(argv[binindex]);
+    if(opts.stats)
+        extract::write_stats(opts.stats,ex.statistics(),started);
+    if(ret)
+        exit(1);
 
     return 0;
 }
@@ -0,0 +1,331 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include <string>
+#include <vector>
+
+#include "extract.h"
+#include "binfmt.h"
+
+using namespace std;
+
+/*
+ * Batch extraction over a corpus.
+ *
+ * Dyninst keeps global state while parsing, so binaries are not parsed
+ * concurrently from threads of one process. Instead the parent loads
+ * the exclusion and library lists once and forks worker processes that
+ * inherit them, along with the already-loaded Dyninst libraries. The
+ * workers pull manifest entries from a counter kept in shared memory,
+ * build each record in memory and write it out whole under a shared
+ * lock, so records never interleave.
+ *
+ * A worker that dies (Dyninst does on some malformed inputs) loses only
+ * the binary it was working on; the parent reports it and starts a
+ * replacement. Workers are numbered in the order they are started, and
+ * with binary output each names its dictionary by that number: a
+ * replacement may get the process id of the worker before it, whose
+ * dictionary it must not extend.
+ *
+ * With --topk, each record has the most frequent n-grams of its binary,
+ * and the sketch of each is also merged, under the lock, into one for
+ * the whole corpus kept in the shared memory. Its most frequent n-grams
+ * make up a last record, tagged "*".
+ *
+ * A worker that dies holding the lock may leave a torn record in the
+ * output or a half-merged corpus sketch. The run then counts as failed,
+ * and the corpus record is left out.
+ */
+
+namespace extract {
+
+namespace {
+
+struct entry {
+    string path;
+    string tag;
+};
+
+struct shared_state {
+    pthread_mutex_t lock;
+    size_t next;
+    int failed;
+    bool torn;              // a worker died holding the lock
+    stats st;               // of every worker, with --stats
+};
+
+shared_state * shared;
+long * current;             // per-worker entry in progress, or -1
+char * corpus;              // with --topk, a saved sketch per length
+
+void
+load_manifest(char const* file, vector<entry> & entries)
+{
+    FILE * f = fopen(file,"r");
+    if(!f) {
+        fprintf(stderr,"Failed to open manifest %s: ",file);
+        perror("");
+        exit(1);
+    }
+
+    char * line = NULL;
+    size_t len = 0;
+    while(getline(&line,&len,f) != -1) {
+        chomp(line);
+        if(line[0] == '\0' || line[0] == '#')
+            continue;
+
+        entry e;
+        char * tab = strchr(line,'\t');
+        if(tab) {
+            *tab = '\0';
+            e.tag = tab+1;
+        }
+        e.path = line;
+        entries.push_back(e);
+    }
+    free(line);
+    fclose(f);
+}
+
+void
+lock()
+{
+    // the lock is robust, but what its holder was doing when it died
+    // can't be trusted
+    if(pthread_mutex_lock(&shared->lock) == EOWNERDEAD) {
+        shared->torn = true;
+        ++shared->failed;
+        pthread_mutex_consistent(&shared->lock);
+    }
+}
+
+void
+unlock()
+{
+    pthread_mutex_unlock(&shared->lock);
+}
+
+/* The sketches of each length, one after another from corpus */
+size_t
+corpus_size(vector<topk> const& sketches)
+{
+    size_t sz = 0;
+    for(unsigned i=0;i<sketches.size();++i)
+        sz += topk::footprint(sketches[i].length(),sketches[i].counters());
+    return sz;
+}
+
+void
+save_corpus(vector<topk> const& sketches)
+{
+    char * p = corpus;
+    for(unsigned i=0;i<sketches.size();++i) {
+        sketches[i].save(p);
+        p += topk::footprint(sketches[i].length(),sketches[i].counters());
+    }
+}
+
+void
+load_corpus(vector<topk> & sketches)
+{
+    char * p = corpus;
+    for(unsigned i=0;i<sketches.size();++i) {
+        sketches[i].load(p);
+        p += topk::footprint(sketches[i].length(),sketches[i].counters());
+    }
+}
+
+void
+work(extractor & ex, vector<entry> & entries, int slot, FILE * out)
+{
+    for(;;) {
+        lock();
+        size_t i = shared->next++;
+        unlock();
+
+        if(i >= entries.size())
+            break;
+        current[slot] = i;
+
+        char * buf = NULL;
+        size_t len = 0;
+        FILE * rec = open_memstream(&buf,&len);
+
+        entry & e = entries[i];
+        ex.output(rec);
+        int ret = ex.run(&e.path[0],e.tag.empty() ? NULL : e.tag.c_str());
+        fclose(rec);
+
+        lock();
+        if(ret == 0) {
+            fwrite(buf,1,len,out);
+            fflush(out);
+            if(corpus && !shared->torn) {
+                vector<topk> const& mine = ex.counts().hitters;
+                vector<topk> sum(mine.size());
+                load_corpus(sum);
+                for(unsigned j=0;j<sum.size();++j)
+                    sum[j].merge(mine[j]);
+                save_corpus(sum);
+            }
+        } else
+            ++shared->failed;
+        shared->st.merge(ex.statistics());
+        unlock();
+        ex.clear_statistics();
+        free(buf);
+
+        current[slot] = -1;
+    }
+}
+
+pid_t
+spawn(extractor & ex, vector<entry> & entries, int slot, FILE * out)
+{
+    static uint64_t spawned = 0;
+
+    ++spawned;
+    pid_t pid = fork();
+    if(pid < 0) {
+        perror("fork");
+        exit(1);
+    } else if(pid == 0) {
+        ex.writer(spawned);
+        work(ex,entries,slot,out);
+        _exit(0);
+    }
+    return pid;
+}
+
+}
+
+int
+run_batch(options const& opts, char const* manifest, FILE * out)
+{
+    double started = stats::now();
+
+    vector<entry> entries;
+    load_manifest(manifest,entries);
+
+    options wopts = opts;
+    int nworkers = opts.jobs > 1 ? opts.jobs : 1;
+    wopts.jobs = 1;
+    wopts.record = true;
+
+    extractor ex(wopts,out);
+
+    features sum;
+    sum.count_ngrams(wopts);
+
+    // the sketches are kept 8-byte aligned
+    size_t sz = sizeof(shared_state) + nworkers*sizeof(long);
+    sz = (sz + 7) & ~(size_t)7;
+    size_t corpus_at = sz;
+    if(opts.ngram_topk)
+        sz += corpus_size(sum.hitters);
+
+    void * mem = mmap(NULL,sz,PROT_READ|PROT_WRITE,
+        MAP_SHARED|MAP_ANONYMOUS,-1,0);
+    if(mem == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    shared = (shared_state*)mem;
+    current = (long*)(shared+1);
+    corpus = NULL;
+    if(opts.ngram_topk) {
+        corpus = (char*)mem + corpus_at;
+        save_corpus(sum.hitters);
+    }
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr,PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr,PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&shared->lock,&attr);
+    pthread_mutexattr_destroy(&attr);
+    shared->next = 0;
+    shared->failed = 0;
+    shared->torn = false;
+    shared->st.clear();
+
+    if(opts.binary) {
+        outbuf ob(out,64);
+        bin_writer::header(ob,RECORD,opts.class_tag);
+    }
+
+    // anything still buffered would be written once by every worker
+    fflush(out);
+    fflush(stderr);
+
+    vector<pid_t> pids(nworkers);
+    for(int i=0;i<nworkers;++i) {
+        current[i] = -1;
+        pids[i] = spawn(ex,entries,i,out);
+    }
+
+    int live = nworkers;
+    while(live > 0) {
+        int status;
+        pid_t pid = wait(&status);
+        if(pid < 0) {
+            if(errno == EINTR)
+                continue;
+            perror("wait");
+            break;
+        }
+
+        int slot = 0;
+        while(slot < nworkers && pids[slot] != pid)
+            ++slot;
+        if(slot == nworkers)
+            continue;
+
+        long cur = current[slot];
+        if(cur < 0 || (WIFEXITED(status) && WEXITSTATUS(status) == 0)) {
+            --live;
+            continue;
+        }
+
+        fprintf(stderr,"Failed to process %s\n",entries[cur].path.c_str());
+        lock();
+        ++shared->failed;
+        unlock();
+        current[slot] = -1;
+        pids[slot] = spawn(ex,entries,slot,out);
+    }
+
+    if(shared->torn)
+        fprintf(stderr,"A worker died while writing; output may be damaged\n");
+    else if(corpus) {
+        load_corpus(sum.hitters);
+        outbuf ob(out);
+        ob.put('*');
+        print_ngrams(ob,sum,wopts,RECORD);
+        ob.put('\n');
+        ob.flush();
+    }
+
+    // peak memory is that of the largest worker
+    if(opts.stats)
+        write_stats(opts.stats,shared->st,started);
+
+    int failed = shared->failed;
+    pthread_mutex_destroy(&shared->lock);
+    munmap(mem,sz);
+    shared = NULL;
+    current = NULL;
+    corpus = NULL;
+
+    return failed;
+}
+
+}
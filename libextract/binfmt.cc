@@ -0,0 +1,346 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "binfmt.h"
+
+using namespace std;
+
+namespace extract {
+
+#define BINFMT_MAGIC "ESFB\0\0\0\1"
+
+static void
+put_varint(string & buf, uint64_t v)
+{
+    while(v >= 0x80) {
+        buf.push_back((char)(v | 0x80));
+        v >>= 7;
+    }
+    buf.push_back((char)v);
+}
+
+static void
+put_bytes(string & buf, char const* s, size_t len)
+{
+    put_varint(buf,len);
+    buf.append(s,len);
+}
+
+/** writer **/
+
+bin_writer::bin_writer() :
+    _writer(0),
+    _nnew(0),
+    _kind('R'),
+    _nsections(0),
+    _nitems(0),
+    _family(0)
+{ }
+
+void
+bin_writer::header(outbuf & out, layout l, char const* class_tag)
+{
+    string buf(BINFMT_MAGIC,8);
+    buf.push_back((char)l);
+    buf.push_back(class_tag ? 1 : 0);
+    if(class_tag)
+        put_bytes(buf,class_tag,strlen(class_tag));
+    out.put(buf);
+}
+
+void
+bin_writer::begin(char const* tag)
+{
+    _kind = 'R';
+    _head.clear();
+    put_bytes(_head,tag,strlen(tag));
+    _body.clear();
+    _nsections = 0;
+    _family = 0;
+}
+
+void
+bin_writer::begin(uint64_t addr)
+{
+    _kind = 'F';
+    _head.clear();
+    put_varint(_head,addr);
+    _body.clear();
+    _nsections = 0;
+    _family = 0;
+}
+
+void
+bin_writer::flush_section()
+{
+    if(!_family)
+        return;
+    put_varint(_body,_family);
+    put_varint(_body,_nitems);
+    _body.append(_sec);
+    ++_nsections;
+
+    _sec.clear();
+    _nitems = 0;
+    _family = 0;
+}
+
+void
+bin_writer::section(unsigned family)
+{
+    flush_section();
+    _family = family;
+}
+
+void
+bin_writer::add(string const& feature, int count)
+{
+    unordered_map<string,uint32_t>::iterator it = _dict.find(feature);
+    uint32_t id;
+    if(it == _dict.end()) {
+        id = _dict.size();
+        _dict[feature] = id;
+        put_bytes(_new,feature.data(),feature.size());
+        ++_nnew;
+    } else
+        id = it->second;
+
+    put_varint(_sec,id);
+    put_varint(_sec,count);
+    ++_nitems;
+}
+
+void
+bin_writer::end(outbuf & out)
+{
+    flush_section();
+
+    // named on first use, as batch workers are forked from a parent
+    // holding this same writer (run_batch() names them itself)
+    if(!_writer)
+        _writer = getpid();
+
+    string buf;
+    if(_nnew) {
+        buf.push_back('D');
+        put_varint(buf,_writer);
+        put_varint(buf,_nnew);
+        buf.append(_new);
+        _new.clear();
+        _nnew = 0;
+    }
+
+    buf.push_back(_kind);
+    put_varint(buf,_writer);
+    buf.append(_head);
+    put_varint(buf,_nsections);
+    buf.append(_body);
+    out.put(buf);
+
+    _head.clear();
+    _body.clear();
+    _nsections = 0;
+}
+
+/** reader **/
+
+bin_reader::bin_reader(FILE * in) :
+    _in(in),
+    _error(false),
+    _layout(LINES),
+    _has_tag(false)
+{ }
+
+bool
+bin_reader::varint(uint64_t & v)
+{
+    v = 0;
+    for(int shift = 0; shift < 64; shift += 7) {
+        int c = getc(_in);
+        if(c == EOF)
+            return false;
+        v |= (uint64_t)(c & 0x7f) << shift;
+        if(!(c & 0x80))
+            return true;
+    }
+    return false;
+}
+
+/* Read a chunk at a time, so that a corrupt length runs into the end
+   of the stream rather than into a huge allocation */
+bool
+bin_reader::bytes(string & s)
+{
+    uint64_t len;
+    char buf[4096];
+
+    if(!varint(len))
+        return false;
+    s.clear();
+    while(len > 0) {
+        size_t n = len < sizeof(buf) ? len : sizeof(buf);
+        if(fread(buf,1,n,_in) != n)
+            return false;
+        s.append(buf,n);
+        len -= n;
+    }
+    return true;
+}
+
+bool
+bin_reader::header()
+{
+    char magic[8];
+    int l, t;
+
+    if(fread(magic,1,8,_in) != 8 || memcmp(magic,BINFMT_MAGIC,8) != 0 ||
+       (l = getc(_in)) == EOF || l > RECORD || (t = getc(_in)) == EOF) {
+        _error = true;
+        return false;
+    }
+    _layout = (layout)l;
+    _has_tag = t != 0;
+    if(_has_tag && !bytes(_class_tag)) {
+        _error = true;
+        return false;
+    }
+    return true;
+}
+
+bool
+bin_reader::next(bin_record & r)
+{
+    uint64_t writer, nsec, n, v;
+
+    for(;;) {
+        int kind = getc(_in);
+        if(kind == EOF)
+            return false;
+        if(!varint(writer))
+            break;
+        vector<string> & dict = _dicts[writer];
+
+        if(kind == 'D') {
+            if(!varint(n))
+                break;
+            for( ; n > 0; --n) {
+                dict.push_back(string());
+                if(!bytes(dict.back()))
+                    goto bad;
+            }
+            continue;
+        } else if(kind == 'R') {
+            r.func = false;
+            r.addr = 0;
+            if(!bytes(r.tag))
+                break;
+        } else if(kind == 'F') {
+            r.func = true;
+            r.tag.clear();
+            if(!varint(r.addr))
+                break;
+        } else
+            break;
+
+        r.dict = &dict;
+        r.sections.clear();
+        // grown as they are read, so a corrupt count runs into the end too
+        if(!varint(nsec))
+            break;
+        for( ; nsec > 0; --nsec) {
+            r.sections.push_back(bin_record::section());
+            bin_record::section & s = r.sections.back();
+            uint64_t id, cnt;
+            if(!varint(v) || !varint(n))
+                goto bad;
+            s.family = v;
+            for( ; n > 0; --n) {
+                if(!varint(id) || !varint(cnt) || id >= dict.size())
+                    goto bad;
+                s.counts.push_back(make_pair((uint32_t)id,(int)cnt));
+            }
+        }
+        return true;
+    }
+
+  bad:
+    _error = true;
+    return false;
+}
+
+/** text **/
+
+/* As print_idioms, print_graphlets and print_libcalls would have */
+static void
+print_section(outbuf & out, bin_record const& r,
+    bin_record::section const& s, char const* class_tag, layout l)
+{
+    if(s.family == IDIOMS) {
+        if(class_tag && l != RECORD)
+            out.put(class_tag);
+        for(unsigned i=0;i<s.counts.size();++i) {
+            out.put(',');
+            out.put(r.feature(s.counts[i].first));
+            out.put(':');
+            out.dec(s.counts[i].second);
+        }
+        if(l != RECORD)
+            out.put('\n');
+        return;
+    }
+
+    char const* lead = l == RECORD ? "," : "";
+    char const* sep = l == LINES ? "\n" : l == COMMASEP ? "," : "";
+
+    for(unsigned i=0;i<s.counts.size();++i) {
+        out.put(lead);
+        out.put(r.feature(s.counts[i].first));
+        out.put(':');
+        out.dec(s.counts[i].second);
+        out.put(sep);
+    }
+
+    if(l == COMMASEP)
+        out.put('\n');
+}
+
+int
+bin_to_text(FILE * in, FILE * f)
+{
+    bin_reader rd(in);
+    bin_record r;
+    outbuf out(f);
+
+    if(!rd.header()) {
+        fprintf(stderr,"Not a binary feature stream\n");
+        return -1;
+    }
+
+    while(rd.next(r)) {
+        if(r.func) {
+            out.hex(r.addr);
+            out.put(',');
+            for(unsigned i=0;i<r.sections.size();++i)
+                print_section(out,r,r.sections[i],NULL,COMMASEP);
+            continue;
+        }
+
+        if(rd.text_layout() == RECORD)
+            out.put(r.tag);
+        for(unsigned i=0;i<r.sections.size();++i)
+            print_section(out,r,r.sections[i],rd.class_tag(),
+                rd.text_layout());
+        if(rd.text_layout() == RECORD)
+            out.put('\n');
+    }
+    out.flush();
+
+    if(rd.error()) {
+        fprintf(stderr,"Malformed binary feature stream\n");
+        return -1;
+    }
+    return 0;
+}
+
+}
@@ -0,0 +1,126 @@
+#ifndef _BINFMT_H_
+#define _BINFMT_H_
+
+/*
+ * Binary feature output.
+ *
+ * A stream starts with a header giving the layout and idioms class tag
+ * the text output would have had, followed by chunks of two kinds:
+ *
+ *   'D' writer n (len bytes)*n    features new to writer, numbered from
+ *                                 the size of its dictionary so far
+ *   'R' writer len tag sections   the counts of a binary
+ *   'F' writer addr sections      the counts of one function (--byfunc)
+ *
+ * where sections is a count followed by, for each enabled family in
+ * the order of the text output, the family, the number of features
+ * and that many (feature id, count) pairs. All integers are LEB128
+ * varints. A feature is stored once, as its full text form (with its
+ * SG_ or CD_ prefix), and thereafter referred to by id.
+ *
+ * Each writer has its own dictionary. Batch workers write records
+ * interleaved into the same stream, each naming its own dictionary by
+ * the order it was started in (a lone writer uses its process id), so
+ * every chunk can be written as soon as it is ready.
+ */
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "extract.h"
+#include "outbuf.h"
+
+namespace extract {
+
+class bin_writer {
+ public:
+    bin_writer();
+
+    /* Start a stream whose text form has layout l */
+    static void header(outbuf & out, layout l, char const* class_tag);
+
+    /* Start the record of a binary, or of the function at addr */
+    void begin(char const* tag);
+    void begin(uint64_t addr);
+    void section(unsigned family);
+    void add(std::string const& feature, int count);
+    /* Write the record, preceded by any features new to the stream */
+    void end(outbuf & out);
+
+    /* Name the dictionary, which must not be in use yet; unnamed
+       writers take their process id */
+    void name(uint64_t writer) { _writer = writer; }
+
+ private:
+    void flush_section();
+
+    uint64_t _writer;
+    std::unordered_map<std::string,uint32_t> _dict;
+
+    std::string _new;                   // 'D' chunk body
+    uint32_t _nnew;
+    char _kind;                         // 'R' or 'F'
+    std::string _head;                  // its tag or address
+    std::string _body;                  // its finished sections
+    uint32_t _nsections;
+    std::string _sec;                   // current section's pairs
+    uint32_t _nitems;
+    unsigned _family;
+};
+
+/* A record as read back, with ids into the dictionary of its writer */
+struct bin_record {
+    struct section {
+        unsigned family;
+        std::vector< std::pair<uint32_t,int> > counts;
+    };
+
+    bool func;              // a function of --byfunc output
+    std::string tag;        // for a binary
+    uint64_t addr;          // for a function
+    std::vector<section> sections;
+    std::vector<std::string> const* dict;
+
+    std::string const& feature(uint32_t id) const { return (*dict)[id]; }
+};
+
+class bin_reader {
+ public:
+    bin_reader(FILE * in);
+
+    /* Read the stream header; false if this is not a feature stream */
+    bool header();
+    layout text_layout() const { return _layout; }
+    /* NULL if the idioms had no class tag */
+    char const* class_tag() const {
+        return _has_tag ? _class_tag.c_str() : NULL;
+    }
+
+    /* Read up to and including the next record. Returns false at the
+       end of the stream or on a malformed one; error() tells which. */
+    bool next(bin_record & r);
+    bool error() const { return _error; }
+
+ private:
+    bool varint(uint64_t & v);
+    bool bytes(std::string & s);
+
+    FILE * _in;
+    bool _error;
+    layout _layout;
+    bool _has_tag;
+    std::string _class_tag;
+    std::unordered_map<uint64_t, std::vector<std::string> > _dicts;
+};
+
+/* Rewrite a binary stream as the text output it stands for. Returns 0
+   on success. */
+int bin_to_text(FILE * in, FILE * out);
+
+}
+
+#endif
@@ -0,0 +1,511 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+
+#include "cfg.h"
+#include "hash.h"
+
+using namespace std;
+
+namespace extract {
+namespace cfg {
+
+// bump when the header or the meaning of a record changes; changes in
+// record sizes are caught by file_header::recsize
+#define CFG_MAGIC "ESCFG\0\0\2"
+
+// bytes of padding after the code of each region, so that decoding
+// near the end of a region can't run off the table
+#define CODE_PAD 16
+
+namespace {
+
+enum { NRECORDS = 6 };
+
+struct file_header {
+    char magic[8];
+    uint64_t key;
+    uint32_t arch;
+    uint32_t addr_width;
+    uint32_t recsize[NRECORDS];     // as from record_sizes()
+    sizes n;
+};
+
+void
+record_sizes(uint32_t * r)
+{
+    r[0] = sizeof(function);
+    r[1] = sizeof(block);
+    r[2] = sizeof(edge);
+    r[3] = sizeof(extent);
+    r[4] = sizeof(linkage_entry);
+    r[5] = sizeof(region);
+}
+
+size_t
+align(size_t n)
+{
+    return (n + 7) & ~(size_t)7;
+}
+
+/* Offsets of each table in a cache file with the given sizes, and the
+   total length of the file */
+struct layout {
+    size_t funcs, blocks, edges, lists, extents, linkage, regions, code,
+        strings, total;
+
+    layout(sizes const& n) {
+        size_t off = align(sizeof(file_header));
+        funcs = off;    off += align(n.funcs * sizeof(function));
+        blocks = off;   off += align(n.blocks * sizeof(block));
+        edges = off;    off += align(n.edges * sizeof(edge));
+        lists = off;    off += align(n.lists * sizeof(uint32_t));
+        extents = off;  off += align(n.extents * sizeof(extent));
+        linkage = off;  off += align(n.linkage * sizeof(linkage_entry));
+        regions = off;  off += align(n.regions * sizeof(region));
+        code = off;     off += align(n.code);
+        strings = off;  off += align(n.strings);
+        total = off;
+    }
+};
+
+bool
+write_table(FILE * f, void const* p, size_t len)
+{
+    static const char zeros[8] = { 0 };
+
+    if(len && fwrite(p,1,len,f) != len)
+        return false;
+    if(align(len) != len && fwrite(zeros,1,align(len)-len,f) != align(len)-len)
+        return false;
+    return true;
+}
+
+/* [first,first+n) is within a table of size records */
+bool
+in_range(uint64_t first, uint64_t n, uint64_t size)
+{
+    return first <= size && n <= size - first;
+}
+
+/* Each of the n list entries from first is below limit */
+bool
+check_list(uint32_t const* lists, sizes const& sz, uint32_t first,
+    uint32_t n, uint32_t limit)
+{
+    if(!in_range(first,n,sz.lists))
+        return false;
+    for(uint32_t i=0;i<n;++i)
+        if(lists[first+i] >= limit)
+            return false;
+    return true;
+}
+
+}
+
+/** program **/
+
+program::program() :
+    _map(NULL),
+    _maplen(0)
+{
+    reset();
+}
+
+program::~program()
+{
+    reset();
+}
+
+void
+program::reset()
+{
+    if(_map)
+        munmap(_map,_maplen);
+    _map = NULL;
+    _maplen = 0;
+
+    _own = tables();
+    _arch = 0;
+    _addr_width = 0;
+    point(_own);
+}
+
+void
+program::point(tables const& t)
+{
+    _n.funcs = t.funcs.size();
+    _n.blocks = t.blocks.size();
+    _n.edges = t.edges.size();
+    _n.lists = t.lists.size();
+    _n.extents = t.extents.size();
+    _n.linkage = t.linkage.size();
+    _n.regions = t.regions.size();
+    _n.pad = 0;
+    _n.code = t.code.size();
+    _n.strings = t.strings.size();
+
+    _funcs = t.funcs.data();
+    _blocks = t.blocks.data();
+    _edges = t.edges.data();
+    _lists = t.lists.data();
+    _extents = t.extents.data();
+    _linkage = t.linkage.data();
+    _regions = t.regions.data();
+    _code = t.code.data();
+    _strings = t.strings.data();
+}
+
+bool
+program::load(char const* file, uint64_t key)
+{
+    reset();
+
+    int fd = open(file,O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    struct stat sbuf;
+    if(fstat(fd,&sbuf) != 0 || (size_t)sbuf.st_size < sizeof(file_header)) {
+        close(fd);
+        return false;
+    }
+
+    size_t len = sbuf.st_size;
+    void * map = mmap(NULL,len,PROT_READ,MAP_PRIVATE,fd,0);
+    close(fd);
+    if(map == MAP_FAILED)
+        return false;
+
+    uint32_t recsize[NRECORDS];
+    record_sizes(recsize);
+
+    // the sizes are checked against len first so the layout can't wrap
+    file_header const* h = (file_header const*)map;
+    if(memcmp(h->magic,CFG_MAGIC,sizeof(h->magic)) != 0 ||
+       memcmp(h->recsize,recsize,sizeof(recsize)) != 0 ||
+       h->key != key ||
+       h->n.code > len || h->n.strings > len ||
+       layout(h->n).total != len) {
+        munmap(map,len);
+        return false;
+    }
+
+    layout l(h->n);
+    char const* base = (char const*)map;
+
+    _map = map;
+    _maplen = len;
+    _arch = h->arch;
+    _addr_width = h->addr_width;
+    _n = h->n;
+    _funcs = (function const*)(base + l.funcs);
+    _blocks = (block const*)(base + l.blocks);
+    _edges = (edge const*)(base + l.edges);
+    _lists = (uint32_t const*)(base + l.lists);
+    _extents = (extent const*)(base + l.extents);
+    _linkage = (linkage_entry const*)(base + l.linkage);
+    _regions = (region const*)(base + l.regions);
+    _code = (unsigned char const*)(base + l.code);
+    _strings = (char const*)(base + l.strings);
+
+    if(!check()) {
+        reset();
+        return false;
+    }
+    return true;
+}
+
+/* Every index and offset in the tables is within the table it refers
+   to, so that a corrupt cache file can't send readers off the map */
+bool
+program::check() const
+{
+    if(_n.strings && _strings[_n.strings-1] != '\0')
+        return false;
+
+    for(uint32_t i=0;i<_n.funcs;++i) {
+        function const& f = _funcs[i];
+        if(f.name >= _n.strings ||
+           (f.entry != NONE && f.entry >= _n.blocks) ||
+           !check_list(_lists,_n,f.blocks,f.nblocks,_n.blocks) ||
+           !check_list(_lists,_n,f.calls,f.ncalls,_n.edges) ||
+           !in_range(f.extents,f.nextents,_n.extents))
+            return false;
+    }
+    for(uint32_t i=0;i<_n.blocks;++i) {
+        block const& b = _blocks[i];
+        if(!check_list(_lists,_n,b.sources,b.nsources,_n.edges) ||
+           !check_list(_lists,_n,b.targets,b.ntargets,_n.edges))
+            return false;
+    }
+    for(uint32_t i=0;i<_n.edges;++i) {
+        edge const& e = _edges[i];
+        if(e.src >= _n.blocks || (e.trg != NONE && e.trg >= _n.blocks))
+            return false;
+    }
+    for(uint32_t i=0;i<_n.linkage;++i)
+        if(_linkage[i].name >= _n.strings)
+            return false;
+    for(uint32_t i=0;i<_n.regions;++i) {
+        region const& r = _regions[i];
+        if(r.len > _n.code || !in_range(r.bytes,r.len + CODE_PAD,_n.code))
+            return false;
+    }
+    return true;
+}
+
+bool
+program::save(char const* file, uint64_t key) const
+{
+    file_header h;
+    memset(&h,0,sizeof(h));
+    memcpy(h.magic,CFG_MAGIC,sizeof(h.magic));
+    record_sizes(h.recsize);
+    h.key = key;
+    h.arch = _arch;
+    h.addr_width = _addr_width;
+    h.n = _n;
+
+    char tmp[4096];
+    snprintf(tmp,sizeof(tmp),"%s.%d",file,(int)getpid());
+
+    FILE * f = fopen(tmp,"w");
+    if(!f) {
+        fprintf(stderr,"Can't write CFG cache %s: ",tmp);
+        perror("");
+        return false;
+    }
+
+    bool ok = write_table(f,&h,sizeof(h)) &&
+        write_table(f,_funcs,_n.funcs * sizeof(function)) &&
+        write_table(f,_blocks,_n.blocks * sizeof(block)) &&
+        write_table(f,_edges,_n.edges * sizeof(edge)) &&
+        write_table(f,_lists,_n.lists * sizeof(uint32_t)) &&
+        write_table(f,_extents,_n.extents * sizeof(extent)) &&
+        write_table(f,_linkage,_n.linkage * sizeof(linkage_entry)) &&
+        write_table(f,_regions,_n.regions * sizeof(region)) &&
+        write_table(f,_code,_n.code) &&
+        write_table(f,_strings,_n.strings);
+
+    if(fclose(f) != 0)
+        ok = false;
+
+    if(!ok || rename(tmp,file) != 0) {
+        fprintf(stderr,"Can't write CFG cache %s\n",file);
+        unlink(tmp);
+        return false;
+    }
+    return true;
+}
+
+char const*
+program::linkage_name(addr_t addr) const
+{
+    linkage_entry const* b = _linkage;
+    linkage_entry const* e = _linkage + _n.linkage;
+    linkage_entry const* it = lower_bound(b,e,addr,
+        [](linkage_entry const& l, addr_t a) { return l.addr < a; });
+    if(it == e || it->addr != addr)
+        return NULL;
+    return _strings + it->name;
+}
+
+unsigned char const*
+program::code(addr_t addr) const
+{
+    addr_t len;
+    return code(addr,len);
+}
+
+unsigned char const*
+program::code(addr_t addr, addr_t & len) const
+{
+    // regions are sorted and few; find the last starting at or before addr
+    region const* b = _regions;
+    region const* e = _regions + _n.regions;
+    region const* it = upper_bound(b,e,addr,
+        [](addr_t a, region const& r) { return a < r.start; });
+    len = 0;
+    if(it == b)
+        return NULL;
+    --it;
+    if(addr >= it->start + it->len)
+        return NULL;
+    len = it->start + it->len - addr;
+    return _code + it->bytes + (addr - it->start);
+}
+
+/** builder **/
+
+builder::builder(uint32_t arch, uint32_t addr_width) :
+    _arch(arch),
+    _addr_width(addr_width)
+{
+
+}
+
+uint32_t
+builder::list(vector<uint32_t> const& l)
+{
+    uint32_t ret = _t.lists.size();
+    _t.lists.insert(_t.lists.end(),l.begin(),l.end());
+    return ret;
+}
+
+uint32_t
+builder::intern(string const& s)
+{
+    uint32_t ret = _t.strings.size();
+    _t.strings.insert(_t.strings.end(),s.begin(),s.end());
+    _t.strings.push_back('\0');
+    return ret;
+}
+
+uint32_t
+builder::add_block(addr_t start, addr_t end, addr_t last)
+{
+    block b;
+    memset(&b,0,sizeof(b));
+    b.start = start;
+    b.end = end;
+    b.last = last;
+    _t.blocks.push_back(b);
+    return _t.blocks.size()-1;
+}
+
+uint32_t
+builder::add_edge(uint32_t src, uint32_t trg, uint16_t type, uint16_t flags)
+{
+    edge e;
+    e.src = src;
+    e.trg = trg;
+    e.type = type;
+    e.flags = flags;
+    _t.edges.push_back(e);
+    return _t.edges.size()-1;
+}
+
+void
+builder::set_sources(uint32_t b, vector<uint32_t> const& edges)
+{
+    _t.blocks[b].sources = list(edges);
+    _t.blocks[b].nsources = edges.size();
+}
+
+void
+builder::set_targets(uint32_t b, vector<uint32_t> const& edges)
+{
+    _t.blocks[b].targets = list(edges);
+    _t.blocks[b].ntargets = edges.size();
+}
+
+uint32_t
+builder::add_function(addr_t addr, string const& name, uint32_t entry,
+    uint32_t flags, vector<uint32_t> const& blocks,
+    vector<uint32_t> const& calls, vector<extent> const& extents)
+{
+    function f;
+    memset(&f,0,sizeof(f));
+    f.addr = addr;
+    f.name = intern(name);
+    f.entry = entry;
+    f.flags = flags;
+    f.blocks = list(blocks);
+    f.nblocks = blocks.size();
+    f.calls = list(calls);
+    f.ncalls = calls.size();
+    f.extents = _t.extents.size();
+    f.nextents = extents.size();
+    _t.extents.insert(_t.extents.end(),extents.begin(),extents.end());
+    _t.funcs.push_back(f);
+    return _t.funcs.size()-1;
+}
+
+void
+builder::add_linkage(addr_t addr, string const& name)
+{
+    linkage_entry l;
+    memset(&l,0,sizeof(l));
+    l.addr = addr;
+    l.name = intern(name);
+    _t.linkage.push_back(l);
+}
+
+void
+builder::add_region(addr_t start, unsigned char const* bytes, addr_t len)
+{
+    region r;
+    r.start = start;
+    r.len = len;
+    r.bytes = _t.code.size();
+    _t.regions.push_back(r);
+    _t.code.insert(_t.code.end(),bytes,bytes+len);
+    _t.code.resize(_t.code.size() + CODE_PAD,0);
+}
+
+void
+builder::finish(program & p)
+{
+    sort(_t.regions.begin(),_t.regions.end(),
+        [](region const& a, region const& b) { return a.start < b.start; });
+
+    p.reset();
+    p._own.funcs.swap(_t.funcs);
+    p._own.blocks.swap(_t.blocks);
+    p._own.edges.swap(_t.edges);
+    p._own.lists.swap(_t.lists);
+    p._own.extents.swap(_t.extents);
+    p._own.linkage.swap(_t.linkage);
+    p._own.regions.swap(_t.regions);
+    p._own.code.swap(_t.code);
+    p._own.strings.swap(_t.strings);
+    p._arch = _arch;
+    p._addr_width = _addr_width;
+    p.point(p._own);
+
+    _t = tables();
+}
+
+/** content keys **/
+
+bool
+file_key(char const* path, uint64_t & key)
+{
+    int fd = open(path,O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    struct stat sbuf;
+    if(fstat(fd,&sbuf) != 0) {
+        close(fd);
+        return false;
+    }
+
+    hasher h;
+    size_t len = sbuf.st_size;
+    if(len > 0) {
+        void * map = mmap(NULL,len,PROT_READ,MAP_PRIVATE,fd,0);
+        if(map == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+        madvise(map,len,MADV_SEQUENTIAL);
+        h.add(map,len);
+        munmap(map,len);
+    }
+    close(fd);
+
+    key = h.value();
+    return true;
+}
+
+}
+}
@@ -0,0 +1,288 @@
+#ifndef _CFG_H_
+#define _CFG_H_
+
+/*
+ * A flat copy of the parts of a parsed binary the feature kernels use:
+ * functions, their blocks and extents, the edges between blocks, the
+ * call edges of each function, the PLT linkage map, and the code bytes.
+ *
+ * Everything is held in arrays of fixed-size records that refer to one
+ * another by index, so that a program can be written to a file as is
+ * and later mapped back in without any decoding. A program is built
+ * either by a cfg::builder (see cfg_parseapi.h for the ParseAPI
+ * backend, and synth.h for synthetic programs) or by loading a cache
+ * file; it is immutable afterwards, and may be read from several
+ * threads at once.
+ *
+ * Nothing here depends on Dyninst.
+ */
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+namespace extract {
+namespace cfg {
+
+typedef uint64_t addr_t;
+
+static const uint32_t NONE = 0xffffffff;
+
+/* Dyninst's Arch_x86_64, which synthetic programs claim (checked in
+   cfg_parseapi.cc) */
+static const uint32_t ARCH_X86_64 = 0x18000000;
+
+/* edge types, with the values of ParseAPI::EdgeTypeEnum (checked in
+   cfg_parseapi.cc) */
+enum {
+    EDGE_CALL           = 0,
+    EDGE_COND_TAKEN     = 1,
+    EDGE_COND_NOT_TAKEN = 2,
+    EDGE_INDIRECT       = 3,
+    EDGE_DIRECT         = 4,
+    EDGE_FALLTHROUGH    = 5,
+    EDGE_CATCH          = 6,
+    EDGE_CALL_FT        = 7,
+    EDGE_RET            = 8
+};
+
+/* edge flags */
+enum {
+    EDGE_SINK       = 0x1,      // target is unknown
+    EDGE_INTERPROC  = 0x2       // call, return or tail call
+};
+
+/* function flags */
+enum {
+    FUNC_RT         = 0x1       // discovered by traversal, not a symbol
+};
+
+struct edge {
+    uint32_t src;               // block
+    uint32_t trg;               // block, or NONE for sink edges
+    uint16_t type;              // EDGE_CALL etc.
+    uint16_t flags;
+};
+
+/* sources and targets are ranges of the shared index list */
+struct block {
+    addr_t start;
+    addr_t end;
+    addr_t last;                // address of the last instruction
+    uint32_t sources;
+    uint32_t nsources;
+    uint32_t targets;
+    uint32_t ntargets;
+};
+
+struct extent {
+    addr_t start;
+    addr_t end;
+};
+
+/* blocks and calls (edges) are ranges of the shared index list;
+   extents a range of the extent table */
+struct function {
+    addr_t addr;
+    uint32_t name;              // offset into the string table
+    uint32_t entry;             // block
+    uint32_t blocks;
+    uint32_t nblocks;
+    uint32_t calls;
+    uint32_t ncalls;
+    uint32_t extents;
+    uint32_t nextents;
+    uint32_t flags;
+    uint32_t pad;
+};
+
+struct linkage_entry {
+    addr_t addr;
+    uint32_t name;
+    uint32_t pad;
+};
+
+/* [start,start+len) are at offset `bytes' of the code blob */
+struct region {
+    addr_t start;
+    addr_t len;
+    uint64_t bytes;
+};
+
+/* read-only view of a range of records */
+template<typename T>
+class span {
+ public:
+    span(T const* b, uint32_t n) : b_(b), e_(b+n) { }
+    T const* begin() const { return b_; }
+    T const* end() const { return e_; }
+    uint32_t size() const { return e_ - b_; }
+    bool empty() const { return b_ == e_; }
+    T const& operator[](uint32_t i) const { return b_[i]; }
+ private:
+    T const* b_;
+    T const* e_;
+};
+
+/* Number of records in each table */
+struct sizes {
+    uint32_t funcs;
+    uint32_t blocks;
+    uint32_t edges;
+    uint32_t lists;
+    uint32_t extents;
+    uint32_t linkage;
+    uint32_t regions;
+    uint32_t pad;
+    uint64_t code;
+    uint64_t strings;
+};
+
+/* All the records of a program. Also the layout of a cache file: a
+   header is followed by each table in this order, 8-byte aligned. */
+struct tables {
+    std::vector<function> funcs;
+    std::vector<block> blocks;
+    std::vector<edge> edges;
+    std::vector<uint32_t> lists;
+    std::vector<extent> extents;
+    std::vector<linkage_entry> linkage;
+    std::vector<region> regions;
+    std::vector<unsigned char> code;
+    std::vector<char> strings;
+};
+
+class program {
+ public:
+    program();
+    ~program();
+
+    /* Map the cache file, checking it was made from a binary with the
+       given content key. Returns false if it can't be used. */
+    bool load(char const* file, uint64_t key);
+
+    /* Write the program to file, tagged with key. Written to a
+       temporary name first, so concurrent writers are harmless. */
+    bool save(char const* file, uint64_t key) const;
+
+    uint32_t arch() const { return _arch; }
+    uint32_t addr_width() const { return _addr_width; }
+
+    uint32_t nfuncs() const { return _n.funcs; }
+    uint32_t nblocks() const { return _n.blocks; }
+    uint32_t nedges() const { return _n.edges; }
+
+    function const& func(uint32_t f) const { return _funcs[f]; }
+    block const& blk(uint32_t b) const { return _blocks[b]; }
+    edge const& edg(uint32_t e) const { return _edges[e]; }
+
+    char const* name(function const& f) const { return _strings + f.name; }
+
+    span<uint32_t> blocks(function const& f) const {
+        return span<uint32_t>(_lists + f.blocks,f.nblocks);
+    }
+    span<uint32_t> calls(function const& f) const {
+        return span<uint32_t>(_lists + f.calls,f.ncalls);
+    }
+    span<extent> extents(function const& f) const {
+        return span<extent>(_extents + f.extents,f.nextents);
+    }
+    span<uint32_t> sources(block const& b) const {
+        return span<uint32_t>(_lists + b.sources,b.nsources);
+    }
+    span<uint32_t> targets(block const& b) const {
+        return span<uint32_t>(_lists + b.targets,b.ntargets);
+    }
+
+    /* PLT entries, in address order */
+    span<linkage_entry> linkage() const {
+        return span<linkage_entry>(_linkage,_n.linkage);
+    }
+    char const* linkage_name(linkage_entry const& l) const {
+        return _strings + l.name;
+    }
+    /* name of the PLT entry at addr, or NULL */
+    char const* linkage_name(addr_t addr) const;
+
+    span<region> regions() const {
+        return span<region>(_regions,_n.regions);
+    }
+    /* pointer to the code at addr, or NULL if addr is not in a code
+       region. At least 16 readable bytes follow the end of a region. */
+    unsigned char const* code(addr_t addr) const;
+    /* as above, also giving the number of bytes of the region from addr */
+    unsigned char const* code(addr_t addr, addr_t & len) const;
+
+ private:
+    friend class builder;
+
+    void reset();
+    void point(tables const& t);
+    bool check() const;
+
+    uint32_t _arch;
+    uint32_t _addr_width;
+    sizes _n;
+
+    function const* _funcs;
+    block const* _blocks;
+    edge const* _edges;
+    uint32_t const* _lists;
+    extent const* _extents;
+    linkage_entry const* _linkage;
+    region const* _regions;
+    unsigned char const* _code;
+    char const* _strings;
+
+    // built programs own their tables; loaded ones point into the map
+    tables _own;
+    void * _map;
+    size_t _maplen;
+};
+
+/*
+ * Fills in the tables of a program. Blocks and edges are numbered in
+ * the order they are added; the source and target lists of each block
+ * are given explicitly, since their order is that of the backend.
+ */
+class builder {
+ public:
+    builder(uint32_t arch, uint32_t addr_width);
+
+    uint32_t add_block(addr_t start, addr_t end, addr_t last);
+    uint32_t add_edge(uint32_t src, uint32_t trg, uint16_t type,
+        uint16_t flags);
+    void set_sources(uint32_t b, std::vector<uint32_t> const& edges);
+    void set_targets(uint32_t b, std::vector<uint32_t> const& edges);
+
+    uint32_t add_function(addr_t addr, std::string const& name,
+        uint32_t entry, uint32_t flags,
+        std::vector<uint32_t> const& blocks,
+        std::vector<uint32_t> const& calls,
+        std::vector<extent> const& extents);
+
+    /* entries must be added in address order */
+    void add_linkage(addr_t addr, std::string const& name);
+
+    void add_region(addr_t start, unsigned char const* bytes, addr_t len);
+
+    /* hand the tables over to p; the builder is empty afterwards */
+    void finish(program & p);
+
+ private:
+    uint32_t list(std::vector<uint32_t> const& l);
+    uint32_t intern(std::string const& s);
+
+    uint32_t _arch;
+    uint32_t _addr_width;
+    tables _t;
+};
+
+/* Content key of the file at path, or false if it can't be read */
+bool file_key(char const* path, uint64_t & key);
+
+}
+}
+
+#endif
@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <gelf.h>
+
+#include "dyntypes.h"
+
+#include "cfg_elf.h"
+
+using namespace std;
+using namespace Dyninst;
+
+namespace extract {
+namespace cfg {
+
+struct symbol {
+    addr_t addr;
+    addr_t size;
+    char const* name;
+    size_t order;               // position in the symbol table
+};
+
+static Architecture elf_arch(GElf_Ehdr const& eh)
+{
+    switch(eh.e_machine) {
+        case EM_386:
+            return Arch_x86;
+        case EM_X86_64:
+            return Arch_x86_64;
+        case EM_PPC:
+            return Arch_ppc32;
+        case EM_PPC64:
+            return Arch_ppc64;
+        case EM_AARCH64:
+            return Arch_aarch64;
+        default:
+            return Arch_none;
+    }
+}
+
+/* The sized function symbols of the table in scn */
+static void read_symbols(Elf * elf, Elf_Scn * scn, GElf_Shdr const& sh,
+    vector<symbol> & syms)
+{
+    Elf_Data * data = elf_getdata(scn,NULL);
+    if(!data || sh.sh_entsize == 0)
+        return;
+
+    size_t n = sh.sh_size / sh.sh_entsize;
+    for(size_t i=0;i<n;++i) {
+        GElf_Sym s;
+        if(!gelf_getsym(data,i,&s))
+            break;
+        if(GELF_ST_TYPE(s.st_info) != STT_FUNC || s.st_size == 0 ||
+           s.st_shndx == SHN_UNDEF)
+            continue;
+        char const* name = elf_strptr(elf,sh.sh_link,s.st_name);
+        symbol sym = { s.st_value, s.st_size, name ? name : "", i };
+        syms.push_back(sym);
+    }
+}
+
+static bool read_elf(Elf * elf, char const* path, program & p)
+{
+    GElf_Ehdr eh;
+    size_t shstrndx;
+    if(elf_kind(elf) != ELF_K_ELF || !gelf_getehdr(elf,&eh) ||
+       elf_getshdrstrndx(elf,&shstrndx) != 0) {
+        fprintf(stderr,"Can't read %s: %s\n",path,elf_errmsg(-1));
+        return false;
+    }
+
+    builder b(elf_arch(eh),eh.e_ident[EI_CLASS] == ELFCLASS64 ? 8 : 4);
+
+    vector<extent> regions;
+    vector<symbol> syms;
+    vector<symbol> dynsyms;
+
+    Elf_Scn * scn = NULL;
+    while((scn = elf_nextscn(elf,scn)) != NULL) {
+        GElf_Shdr sh;
+        if(!gelf_getshdr(scn,&sh))
+            continue;
+
+        if(sh.sh_type == SHT_SYMTAB)
+            read_symbols(elf,scn,sh,syms);
+        else if(sh.sh_type == SHT_DYNSYM)
+            read_symbols(elf,scn,sh,dynsyms);
+        else if(sh.sh_type == SHT_PROGBITS && (sh.sh_flags & SHF_EXECINSTR)
+                && sh.sh_size > 0) {
+            Elf_Data * data = elf_getdata(scn,NULL);
+            if(!data || !data->d_buf)
+                continue;
+            addr_t len = std::min((addr_t)data->d_size,(addr_t)sh.sh_size);
+            b.add_region(sh.sh_addr,(unsigned char const*)data->d_buf,len);
+            extent r = { sh.sh_addr, sh.sh_addr + len };
+            regions.push_back(r);
+        }
+    }
+    if(syms.empty())
+        syms.swap(dynsyms);
+
+    stable_sort(syms.begin(),syms.end(),
+        [](symbol const& x, symbol const& y) {
+            return x.addr != y.addr ? x.addr < y.addr : x.order < y.order;
+        });
+
+    vector<uint32_t> none;
+    vector<extent> extents(1);
+    for(size_t i=0;i<syms.size();++i) {
+        if(i > 0 && syms[i].addr == syms[i-1].addr)
+            continue;
+
+        // clipped to the region holding the entry, if any
+        extent e = { syms[i].addr, syms[i].addr + syms[i].size };
+        bool code = false;
+        for(unsigned r=0;r<regions.size() && !code;++r) {
+            if(e.start >= regions[r].start && e.start < regions[r].end) {
+                e.end = std::min(e.end,regions[r].end);
+                code = true;
+            }
+        }
+        if(!code)
+            continue;
+
+        extents[0] = e;
+        b.add_function(e.start,syms[i].name,NONE,0,none,none,extents);
+    }
+
+    b.finish(p);
+    return true;
+}
+
+bool
+from_elf(char const* path, program & p)
+{
+    if(elf_version(EV_CURRENT) == EV_NONE) {
+        fprintf(stderr,"libelf is out of date: %s\n",elf_errmsg(-1));
+        return false;
+    }
+
+    int fd = open(path,O_RDONLY);
+    if(fd < 0) {
+        fprintf(stderr,"Can't open %s: %s\n",path,strerror(errno));
+        return false;
+    }
+
+    // the sections are mapped, not read; their bytes are copied once,
+    // into the program
+    Elf * elf = elf_begin(fd,ELF_C_READ_MMAP,NULL);
+    if(!elf) {
+        fprintf(stderr,"Can't read %s: %s\n",path,elf_errmsg(-1));
+        close(fd);
+        return false;
+    }
+
+    bool ok = read_elf(elf,path,p);
+
+    elf_end(elf);
+    close(fd);
+    return ok;
+}
+
+}
+}
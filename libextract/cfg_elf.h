@@ -0,0 +1,33 @@
+#ifndef _CFG_ELF_H_
+#define _CFG_ELF_H_
+
+/*
+ * A cfg::program read straight from the sections and symbol table of an
+ * ELF file, without parsing: enough for the byte n-grams and nothing
+ * else.
+ *
+ * The code regions are the executable sections. Each sized function
+ * symbol in one of them becomes a function with a single extent, its
+ * symbol bounds, and no blocks or edges; where several symbols share an
+ * address the first in the table names it. Functions are in address
+ * order. The static symbol table is used if there is one, the dynamic
+ * one otherwise.
+ *
+ * Symbol bounds are not the extents a parse finds: they include any
+ * padding and data within a function, and code reached only by
+ * traversal has no symbol. The n-grams are close to, but not the same
+ * as, those of a parsed binary.
+ */
+#include "cfg.h"
+
+namespace extract {
+namespace cfg {
+
+/* Read the ELF file at path into p. Returns false, having said why on
+   stderr, if it can't be read. */
+bool from_elf(char const* path, program & p);
+
+}
+}
+
+#endif
@@ -0,0 +1,217 @@
+#include <stdio.h>
+
+#include <map>
+#include <vector>
+
+#include "CodeSource.h"
+#include "CodeObject.h"
+#include "CFG.h"
+
+#include "cfg_parseapi.h"
+
+using namespace std;
+using namespace Dyninst;
+using namespace Dyninst::ParseAPI;
+
+namespace extract {
+namespace cfg {
+
+// cfg.h has these without Dyninst
+static_assert((int)EDGE_CALL == CALL &&
+    (int)EDGE_COND_TAKEN == COND_TAKEN &&
+    (int)EDGE_COND_NOT_TAKEN == COND_NOT_TAKEN &&
+    (int)EDGE_INDIRECT == INDIRECT &&
+    (int)EDGE_DIRECT == DIRECT &&
+    (int)EDGE_FALLTHROUGH == FALLTHROUGH &&
+    (int)EDGE_CATCH == CATCH &&
+    (int)EDGE_CALL_FT == CALL_FT &&
+    (int)EDGE_RET == RET,
+    "cfg edge types differ from ParseAPI's");
+static_assert(ARCH_X86_64 == (uint32_t)Arch_x86_64,
+    "cfg's ARCH_X86_64 differs from Dyninst's");
+
+/*
+ * Blocks are numbered as they are first reached: the blocks of each
+ * function in funcs() order, then any other block at the end of an
+ * edge of one already numbered. Edges are numbered as they are first
+ * seen. The order of every list (functions, blocks of a function, call
+ * edges, sources, targets, extents) is the order ParseAPI gives, so the
+ * kernels see the same sequence whichever backend produced a program.
+ */
+void
+from_parseapi(SymtabCodeSource * sts, CodeObject * co, program & p)
+{
+    builder b(sts->getArch(),sts->getAddressWidth());
+
+    dyn_hash_map<Block *,uint32_t> bmap;
+    dyn_hash_map<Edge *,uint32_t> emap;
+    vector<Block *> blocks;
+
+    auto blk = [&](Block * x) -> uint32_t {
+        auto it = bmap.find(x);
+        if(it != bmap.end())
+            return it->second;
+        uint32_t ind = b.add_block(x->start(),x->end(),x->lastInsnAddr());
+        bmap[x] = ind;
+        blocks.push_back(x);
+        return ind;
+    };
+
+    CodeObject::funclist & funcs = co->funcs();
+    for(auto fit = funcs.begin(); fit != funcs.end(); ++fit) {
+        Function::blocklist & fb = (*fit)->blocks();
+        for(auto bit = fb.begin(); bit != fb.end(); ++bit)
+            (void)blk(*bit);
+    }
+
+    // edges; the neighbours of a block may themselves add blocks
+    auto edg = [&](Edge * e) -> uint32_t {
+        auto it = emap.find(e);
+        if(it != emap.end())
+            return it->second;
+        uint32_t src = blk(e->src());
+        uint32_t trg = e->sinkEdge() ? NONE : blk(e->trg());
+        uint16_t flags = (e->sinkEdge() ? EDGE_SINK : 0) |
+                         (e->interproc() ? EDGE_INTERPROC : 0);
+        uint32_t ind = b.add_edge(src,trg,e->type(),flags);
+        emap[e] = ind;
+        return ind;
+    };
+
+    vector<uint32_t> l;
+    for(size_t i=0;i<blocks.size();++i) {
+        Block * x = blocks[i];
+
+        l.clear();
+        for(auto eit = x->sources().begin(); eit != x->sources().end(); ++eit)
+            l.push_back(edg(*eit));
+        b.set_sources(i,l);
+
+        l.clear();
+        for(auto eit = x->targets().begin(); eit != x->targets().end(); ++eit)
+            l.push_back(edg(*eit));
+        b.set_targets(i,l);
+    }
+
+    // functions
+    vector<uint32_t> fblocks;
+    vector<uint32_t> calls;
+    vector<extent> extents;
+    for(auto fit = funcs.begin(); fit != funcs.end(); ++fit) {
+        Function * f = *fit;
+
+        fblocks.clear();
+        Function::blocklist & fb = f->blocks();
+        for(auto bit = fb.begin(); bit != fb.end(); ++bit)
+            fblocks.push_back(bmap[*bit]);
+
+        calls.clear();
+        auto const& ce = f->callEdges();
+        for(auto eit = ce.begin(); eit != ce.end(); ++eit)
+            calls.push_back(edg(*eit));
+
+        extents.clear();
+        vector<FuncExtent *> const& fe = f->extents();
+        for(unsigned i=0;i<fe.size();++i) {
+            extent e = { fe[i]->start(), fe[i]->end() };
+            extents.push_back(e);
+        }
+
+        uint32_t entry = f->entry() ? blk(f->entry()) : NONE;
+
+        b.add_function(f->addr(),f->name(),entry,
+            f->src() == RT ? FUNC_RT : 0,
+            fblocks,calls,extents);
+    }
+
+    // std::map, so already in address order
+    std::map<Address,std::string> & linkage = sts->linkage();
+    for(auto lit = linkage.begin(); lit != linkage.end(); ++lit)
+        b.add_linkage(lit->first,lit->second);
+
+    // code; only regions ParseAPI would decode from
+    vector<CodeRegion *> const& regions = sts->regions();
+    for(unsigned i=0;i<regions.size();++i) {
+        CodeRegion * cr = regions[i];
+        if(!sts->isCode(cr->offset()))
+            continue;
+        unsigned char * bytes =
+            (unsigned char *)cr->getPtrToInstruction(cr->offset());
+        if(!bytes)
+            continue;
+        b.add_region(cr->offset(),bytes,cr->length());
+    }
+
+    b.finish(p);
+}
+
+/** code_source **/
+
+code_source::code_source(program const& p) :
+    _p(p),
+    _lo(0),
+    _hi(0)
+{
+    span<region> r = p.regions();
+    if(!r.empty()) {
+        _lo = r[0].start;
+        _hi = r[r.size()-1].start + r[r.size()-1].len;
+    }
+}
+
+bool
+code_source::isValidAddress(const Address a) const
+{
+    return _p.code(a) != NULL;
+}
+
+void *
+code_source::getPtrToInstruction(const Address a) const
+{
+    return (void *)_p.code(a);
+}
+
+void *
+code_source::getPtrToData(const Address) const
+{
+    return NULL;
+}
+
+unsigned int
+code_source::getAddressWidth() const
+{
+    return _p.addr_width();
+}
+
+bool
+code_source::isCode(const Address a) const
+{
+    return _p.code(a) != NULL;
+}
+
+bool
+code_source::isData(const Address) const
+{
+    return false;
+}
+
+Address
+code_source::offset() const
+{
+    return _lo;
+}
+
+Address
+code_source::length() const
+{
+    return _hi - _lo;
+}
+
+Architecture
+code_source::getArch() const
+{
+    return (Architecture)_p.arch();
+}
+
+}
+}
@@ -0,0 +1,46 @@
+#ifndef _CFG_PARSEAPI_H_
+#define _CFG_PARSEAPI_H_
+
+/*
+ * The ParseAPI backend for cfg::program, and the reverse direction: a
+ * ParseAPI InstructionSource over the code of a program, for use with
+ * InstructionAPI and libfeat.
+ */
+#include "CodeSource.h"
+#include "CodeObject.h"
+#include "dyntypes.h"
+
+#include "cfg.h"
+
+namespace extract {
+namespace cfg {
+
+/* Copy everything the kernels need out of a parsed CodeObject */
+void from_parseapi(Dyninst::ParseAPI::SymtabCodeSource * sts,
+    Dyninst::ParseAPI::CodeObject * co, program & p);
+
+class code_source : public Dyninst::ParseAPI::InstructionSource {
+ public:
+    code_source(program const& p);
+    ~code_source() { }
+
+    bool isValidAddress(const Dyninst::Address a) const;
+    void * getPtrToInstruction(const Dyninst::Address a) const;
+    void * getPtrToData(const Dyninst::Address a) const;
+    unsigned int getAddressWidth() const;
+    bool isCode(const Dyninst::Address a) const;
+    bool isData(const Dyninst::Address a) const;
+    Dyninst::Address offset() const;
+    Dyninst::Address length() const;
+    Dyninst::Architecture getArch() const;
+
+ private:
+    program const& _p;
+    Dyninst::Address _lo;
+    Dyninst::Address _hi;
+};
+
+}
+}
+
+#endif
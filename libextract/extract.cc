@@ -0,0 +1,1255 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "CodeSource.h"
+#include "CodeObject.h"
+#include "Function.h"
+
+#include "feature.h"
+
+#include "extract.h"
+#include "binfmt.h"
+#include "cfg_elf.h"
+#include "cfg_parseapi.h"
+#include "hash.h"
+#include "kernels.h"
+#include "outbuf.h"
+#include "supergraph.h"
+
+using namespace std;
+using namespace Dyninst;
+using namespace Dyninst::ParseAPI;
+using namespace graphlets;
+
+namespace extract {
+
+options::options() :
+    families(0),
+    exclude(NULL),
+    libmap(NULL),
+    class_tag(NULL),
+    idiom_list(NULL),
+    idiom_len(IDIOM_LEN),
+    commasep(false),
+    ngram_counts(false),
+    ngram_opcodes(false),
+    ngram_operands(false),
+    ngram_topk(0),
+    topk_counters(0),
+    color(false),
+    byfunc(false),
+    merge(0),
+    anon(false),
+    graph(false),
+    nort(false),
+    noplt(false),
+    listall(false),
+    jobs(1),
+    record(false),
+    binary(false),
+    hash_dims(0),
+    raw(false),
+    cache(NULL),
+    fcache(NULL),
+    stats(NULL)
+{ }
+
+void
+features::clear()
+{
+    idioms.clear();
+    graphlets.clear();
+    supergraphlets.clear();
+    calldfa.clear();
+    libcalls.clear();
+    real_funcs.clear();
+    hashed.clear();
+    for(unsigned i=0;i<ngrams.size();++i)
+        ngrams[i].clear();
+    for(unsigned i=0;i<skipgrams.size();++i)
+        skipgrams[i].clear();
+    for(unsigned i=0;i<hitters.size();++i)
+        hitters[i].clear();
+}
+
+void
+features::count_ngrams(options const& opts)
+{
+    int width = opts.ngram_opcodes ? opgram_width(opts.ngram_operands) : 1;
+    ngrams.clear();
+    hitters.clear();
+    if(opts.ngram_topk) {
+        unsigned m = opts.topk_counters ? opts.topk_counters :
+            opts.ngram_topk * TOPK_COUNTERS;
+        for(unsigned i=0;i<opts.ngram_lens.size();++i)
+            hitters.push_back(topk(opts.ngram_lens[i],m));
+    } else {
+        for(unsigned i=0;i<opts.ngram_lens.size();++i)
+            ngrams.push_back(ngram_table(opts.ngram_lens[i] * width));
+    }
+    skipgrams.clear();
+    for(unsigned i=0;i<opts.skipgrams.size();++i)
+        skipgrams.push_back(ngram_table(opts.skipgrams[i].keep.size()));
+}
+
+template<typename K>
+static void merge_counts(map<K,int> & into, map<K,int> const& from)
+{
+    typename map<K,int>::const_iterator it = from.begin();
+    for( ; it != from.end(); ++it)
+        into[it->first] += it->second;
+}
+
+/* For --stats, the distinct features and occurrences of a family */
+template<typename K>
+static void count_produced(stats & st, unsigned family,
+    map<K,int> const& counts)
+{
+    uint64_t n = 0;
+    typename map<K,int>::const_iterator it = counts.begin();
+    for( ; it != counts.end(); ++it)
+        n += it->second;
+    st.produced(family,counts.size(),n);
+}
+
+void
+features::merge(features const& o)
+{
+    merge_counts(idioms,o.idioms);
+    merge_counts(graphlets,o.graphlets);
+    merge_counts(supergraphlets,o.supergraphlets);
+    merge_counts(calldfa,o.calldfa);
+    merge_counts(libcalls,o.libcalls);
+    real_funcs.insert(o.real_funcs.begin(),o.real_funcs.end());
+    merge_counts(hashed,o.hashed);
+    for(unsigned i=0;i<ngrams.size() && i<o.ngrams.size();++i)
+        ngrams[i].merge(o.ngrams[i]);
+    for(unsigned i=0;i<skipgrams.size() && i<o.skipgrams.size();++i)
+        skipgrams[i].merge(o.skipgrams[i]);
+    for(unsigned i=0;i<hitters.size() && i<o.hitters.size();++i)
+        hitters[i].merge(o.hitters[i]);
+}
+
+void
+features::merge(func_counts const& o)
+{
+    merge_counts(idioms,o.idioms);
+    merge_counts(graphlets,o.graphlets);
+    merge_counts(supergraphlets,o.supergraphlets);
+    merge_counts(calldfa,o.calldfa);
+}
+
+/** input helpers **/
+
+void
+chomp(char*s)
+{
+    for( ; *s != '\0'; ++s)
+        if(*s == '\n') {
+            *s = '\0';
+            break;
+        }
+}
+
+void
+load_exclude(char const* file, dyn_hash_map<string,bool> & exclude)
+{
+    char * buf = NULL;
+    size_t n = 0;
+    ssize_t read;
+
+    FILE * exin = fopen(file,"r");
+    if(!exin) {
+        fprintf(stderr,"Can't open exclude file %s: %s\n",
+            file,strerror(errno));
+        return;
+    }
+
+    while(-1 != (read = getline(&buf,&n,exin))) {
+        chomp(buf);
+        exclude[string(buf)] = true;
+    }
+
+    if(buf)
+        free(buf);
+    fclose(exin);
+}
+
+void
+load_libmap(char const* file, dyn_hash_map<string,unsigned short> & libmap)
+{
+    char * buf = NULL;
+    size_t n = 0;
+    ssize_t read;
+    unsigned short ind = 0;
+
+    FILE * exin = fopen(file,"r");
+    if(!exin) {
+        fprintf(stderr,"Can't open library func map file %s: %s\n",
+            file,strerror(errno));
+        return;
+    }
+
+    while(-1 != (read = getline(&buf,&n,exin))) {
+        chomp(buf);
+        libmap[string(buf)] = ++ind;
+    }
+
+    if(buf)
+        free(buf);
+    fclose(exin);
+}
+
+IdiomList *
+load_idiom_list(char const* file)
+{
+    IdiomList * list = new IdiomList();
+    if(!list->load(file)) {
+        fprintf(stderr,"Can't open idiom list %s: %s\n",
+            file,strerror(errno));
+        delete list;
+        return NULL;
+    }
+    if(list->size() == 0) {
+        fprintf(stderr,"No idioms listed in %s\n",file);
+        delete list;
+        return NULL;
+    }
+    return list;
+}
+
+bool
+parse_lengths(char const* s, vector<int> & lens)
+{
+    lens.clear();
+    for(;;) {
+        char * end;
+        long lo = strtol(s,&end,10);
+        long hi = lo;
+        if(end == s || lo <= 0 || lo > MAX_NGRAM_LEN)
+            return false;
+        if(*end == '-') {
+            s = end+1;
+            hi = strtol(s,&end,10);
+            if(end == s || hi < lo || hi > MAX_NGRAM_LEN)
+                return false;
+        }
+        for(long n = lo; n <= hi; ++n)
+            lens.push_back(n);
+        if(*end == '\0')
+            break;
+        if(*end != ',')
+            return false;
+        s = end+1;
+    }
+
+    sort(lens.begin(),lens.end());
+    lens.erase(unique(lens.begin(),lens.end()),lens.end());
+    return true;
+}
+
+bool
+parse_skipgrams(char const* s, vector<skipgram> & skips)
+{
+    for(;;) {
+        skipgram sk;
+        for( ; *s == 'x' || *s == '.'; ++s) {
+            if(*s == 'x')
+                sk.keep.push_back(sk.pattern.size());
+            sk.pattern += *s;
+        }
+        sk.span = sk.pattern.size();
+        if(sk.span == 0 || sk.pattern[0] != 'x' ||
+           sk.pattern[sk.span-1] != 'x')
+            return false;
+        skips.push_back(sk);
+
+        if(*s == '\0')
+            return true;
+        if(*s != ',')
+            return false;
+        ++s;
+    }
+}
+
+unsigned
+parse_dims(char const* s)
+{
+    char * end;
+    unsigned long n;
+
+    if(strncmp(s,"2^",2) == 0) {
+        unsigned long k = strtoul(s+2,&end,10);
+        if(*end != '\0' || end == s+2 || k > 31)
+            return 0;
+        return 1U << k;
+    }
+
+    n = strtoul(s,&end,10);
+    if(*end != '\0' || n == 0 || n > (1UL << 31) || (n & (n-1)))
+        return 0;
+    return n;
+}
+
+int
+parse_idiom_len(char const* s)
+{
+    char * end;
+    long n = strtol(s,&end,10);
+    if(*end != '\0' || end == s || n < 1 || n > MAX_IDIOM_LEN)
+        return 0;
+    return n;
+}
+
+/** output **/
+
+void
+print_idioms(outbuf & out, map<string,int> & counts, char const* class_tag,
+    layout l, vector<string> const* order)
+{
+    if(class_tag && l != RECORD)
+       out.put(class_tag);
+
+    if(order) {
+        for(unsigned i=0;i<order->size();++i) {
+            map<string,int>::const_iterator cit = counts.find((*order)[i]);
+            if(cit == counts.end())
+                continue;
+            out.put(',');
+            out.put((*cit).first);
+            out.put(':');
+            out.dec((*cit).second);
+        }
+    } else {
+        map<string,int>::const_iterator cit= counts.begin();
+        for( ; cit != counts.end(); ++cit) {
+            out.put(',');
+            out.put((*cit).first);
+            out.put(':');
+            out.dec((*cit).second);
+        }
+    }
+
+    if(l != RECORD)
+        out.put('\n');
+}
+
+void
+print_graphlets(outbuf & out, map<graphlet,int> & counts,
+    char const* prefix, bool color, layout l)
+{
+    char const* lead = l == RECORD ? "," : "";
+    char const* sep = l == LINES ? "\n" : l == COMMASEP ? "," : "";
+
+    map<graphlet,int>::const_iterator cit = counts.begin();
+    for( ; cit != counts.end(); ++cit) {
+        out.put(lead);
+        out.put(prefix);
+        (cit->first).compact(out,color);
+        out.put(':');
+        out.dec(cit->second);
+        out.put(sep);
+    }
+
+    if(l == COMMASEP)
+        out.put('\n');
+}
+
+void
+print_ngrams(outbuf & out, features const& f, options const& opts, layout l)
+{
+    char const* lead = l == RECORD ? "," : "";
+    char const* sep = l == LINES ? "\n" : l == COMMASEP ? "," : "";
+    bool opcodes = opts.ngram_opcodes;
+    int width = opcodes ? opgram_width(opts.ngram_operands) : 1;
+
+    vector<ngram_table::entry const*> sorted;
+    vector<unsigned char> gram;
+    for(unsigned t=0;t<f.ngrams.size();++t) {
+        ngram_table const& counts = f.ngrams[t];
+        int n = counts.length() / width;
+        gram.resize(counts.length());
+        counts.sorted(sorted);
+        for(unsigned i=0;i<sorted.size();++i) {
+            out.put(lead);
+            if(f.ngrams.size() > 1) {
+                out.dec(n);
+                out.put('_');
+            }
+            out.put('<');
+            if(opcodes) {
+                counts.get(*sorted[i],&gram[0]);
+                format_opgram(out,&gram[0],n,opts.ngram_operands);
+            } else
+                counts.format(out,*sorted[i]);
+            out.put(">:");
+            out.dec(sorted[i]->count);
+            out.put(sep);
+        }
+    }
+
+    for(unsigned t=0;t<f.skipgrams.size();++t) {
+        ngram_table const& counts = f.skipgrams[t];
+        gram.resize(counts.length());
+        counts.sorted(sorted);
+        for(unsigned i=0;i<sorted.size();++i) {
+            out.put(lead);
+            out.put('<');
+            counts.get(*sorted[i],&gram[0]);
+            format_skipgram(out,&gram[0],opts.skipgrams[t]);
+            out.put(">:");
+            out.dec(sorted[i]->count);
+            out.put(sep);
+        }
+    }
+
+    vector<topk::hitter const*> top;
+    for(unsigned t=0;t<f.hitters.size();++t) {
+        topk const& sketch = f.hitters[t];
+        sketch.top(opts.ngram_topk,top);
+        for(unsigned i=0;i<top.size();++i) {
+            out.put(lead);
+            if(f.hitters.size() > 1) {
+                out.dec(sketch.length());
+                out.put('_');
+            }
+            out.put('<');
+            sketch.format(out,*top[i]);
+            out.put(">:");
+            out.udec(top[i]->count);
+            out.put(':');
+            out.udec(top[i]->err);
+            out.put(sep);
+        }
+    }
+
+    if(l == COMMASEP)
+        out.put('\n');
+}
+
+void
+print_libcalls(outbuf & out, map<string,int> & counts,
+    unordered_map<string,bool> & real_funcs, layout l)
+{
+    char const* lead = l == RECORD ? "," : "";
+    char const* sep = l == LINES ? "\n" : l == COMMASEP ? "," : "";
+
+    map<string,int>::iterator cit = counts.begin();
+    for( ; cit != counts.end(); ++cit) {
+        if(real_funcs.find((*cit).first) == real_funcs.end()) {
+            out.put(lead);
+            out.put((*cit).first);
+            out.put(':');
+            out.dec((*cit).second);
+            out.put(sep);
+        }
+    }
+
+    if(l == COMMASEP)
+        out.put('\n');
+}
+
+void
+print_hashed(outbuf & out, map<uint32_t,int> & counts, char const* class_tag,
+    layout l)
+{
+    char const* lead = l == RECORD ? "," : "";
+    char const* sep = l == LINES ? "\n" : l == COMMASEP ? "," : "";
+
+    if(class_tag && l != RECORD) {
+        out.put(class_tag);
+        lead = ",";
+        sep = "";
+    }
+
+    map<uint32_t,int>::const_iterator cit = counts.begin();
+    for( ; cit != counts.end(); ++cit) {
+        out.put(lead);
+        out.udec(cit->first);
+        out.put(':');
+        out.dec(cit->second);
+        out.put(sep);
+    }
+
+    if((class_tag && l != RECORD) || l == COMMASEP)
+        out.put('\n');
+}
+
+/** feature hashing **/
+
+uint32_t
+idiom_index(IdiomKey const& k, unsigned dims)
+{
+    hasher h(IDIOMS);
+    for(int i=0;i<k.len;++i)
+        h.add(k.t[i]);
+    return h.value() & (dims - 1);
+}
+
+void
+hash_graphlets(map<uint32_t,int> & into, unsigned family,
+    map<graphlet,int> & counts, bool color, unsigned dims)
+{
+    map<graphlet,int>::const_iterator cit = counts.begin();
+    for( ; cit != counts.end(); ++cit) {
+        hasher h(family);
+        (cit->first).hash(h,color);
+        into[h.value() & (dims - 1)] += cit->second;
+    }
+}
+
+void
+hash_libcalls(map<uint32_t,int> & into, map<string,int> & counts,
+    unordered_map<string,bool> & real_funcs, unsigned dims)
+{
+    map<string,int>::iterator cit = counts.begin();
+    for( ; cit != counts.end(); ++cit) {
+        if(real_funcs.find((*cit).first) != real_funcs.end())
+            continue;
+        hasher h(LIBCALLS);
+        h.add((*cit).first.data(),(*cit).first.size());
+        into[h.value() & (dims - 1)] += cit->second;
+    }
+}
+
+void
+add_idioms(bin_writer & bw, map<string,int> & counts,
+    vector<string> const* order)
+{
+    bw.section(IDIOMS);
+    if(order) {
+        for(unsigned i=0;i<order->size();++i) {
+            map<string,int>::const_iterator cit = counts.find((*order)[i]);
+            if(cit != counts.end())
+                bw.add(cit->first,cit->second);
+        }
+        return;
+    }
+    map<string,int>::const_iterator cit = counts.begin();
+    for( ; cit != counts.end(); ++cit)
+        bw.add(cit->first,cit->second);
+}
+
+void
+add_graphlets(bin_writer & bw, unsigned family, map<graphlet,int> & counts,
+    char const* prefix, bool color)
+{
+    bw.section(family);
+
+    map<graphlet,int>::const_iterator cit = counts.begin();
+    for( ; cit != counts.end(); ++cit)
+        bw.add(prefix + (cit->first).compact(color),cit->second);
+}
+
+void
+add_libcalls(bin_writer & bw, map<string,int> & counts,
+    unordered_map<string,bool> & real_funcs)
+{
+    bw.section(LIBCALLS);
+    map<string,int>::iterator cit = counts.begin();
+    for( ; cit != counts.end(); ++cit) {
+        if(real_funcs.find((*cit).first) == real_funcs.end())
+            bw.add(cit->first,cit->second);
+    }
+}
+
+/** extractor **/
+
+// functions handed to the workers between flushes of n-gram output
+#define CHUNK_PER_JOB 256
+
+// bump when any cached family changes what it counts
+#define FCACHE_VERSION 1
+
+/* State private to one thread of the function walk */
+struct extractor::worker {
+    explicit worker(options const& opts) :
+        fv(opts.idiom_list ? new FeatureVector(opts.idiom_list) :
+            new FeatureVector(opts.idiom_len))
+    { }
+
+    features feats;
+    bool sketch = true;     // feeds feats.hitters (else the walk does)
+    unique_ptr<FeatureVector> fv;
+    vector<pair<Address,Address> > blocks;
+    long ninsns = -1;       // rows of fv->insns() that are the function's
+    func_counts fn;         // counts of the current function, if cached
+    stats st;
+};
+
+extractor::extractor(options const& opts, FILE * out) :
+    _opts(opts),
+    _ob(out),
+    _src(NULL),
+    _nid(0),
+    _fcache(NULL),
+    _cached(0),
+    _fcache_seed(0),
+    _bin(NULL),
+    _bin_header(false)
+{
+    if(_opts.byfunc)
+        _opts.commasep = true;
+
+    if(_opts.record)
+        _layout = RECORD;
+    else if(_opts.commasep)
+        _layout = COMMASEP;
+    else
+        _layout = LINES;
+
+    if(_opts.ngram_opcodes || _opts.ngram_topk)
+        _opts.ngram_counts = true;
+    _feats.count_ngrams(_opts);
+
+    if(_opts.exclude)
+        load_exclude(_opts.exclude,_exclude);
+    if(_opts.libmap)
+        load_libmap(_opts.libmap,_libmap);
+    if(_opts.idiom_list) {
+        IdiomList::const_iterator it = _opts.idiom_list->begin();
+        for( ; it != _opts.idiom_list->end(); ++it)
+            _idiom_order.push_back(it->key.format());
+    }
+
+    if(_opts.binary) {
+        _bin = new bin_writer();
+        // batch records go into a stream started by run_batch()
+        _bin_header = _opts.record;
+    }
+
+    // Supergraphlets of merged graphs depend on the random choices of
+    // graph::compact(), and dot output is not counts at all
+    if(_opts.fcache && !_opts.byfunc) {
+        _cached = _opts.families & GRAPHLETS;
+        // hashed idioms are never formatted, and the cache keeps text;
+        // nor does it know which idioms were listed
+        if(!_opts.hash_dims && !_opts.idiom_list)
+            _cached |= _opts.families & IDIOMS;
+        if(!_opts.graph) {
+            _cached |= _opts.families & CALLDFA;
+            if(_opts.merge == 0)
+                _cached |= _opts.families & SUPERGRAPHLETS;
+        }
+    }
+    if(_cached) {
+        _fcache = new feature_cache(_opts.fcache);
+
+        hasher h(FCACHE_VERSION);
+        h.add(_cached);
+        h.add((uint32_t)_opts.color);
+        h.add((uint32_t)_opts.anon);
+
+        // call-DFA colors are the positions of names in the map
+        map<string,unsigned short> libmap(_libmap.begin(),_libmap.end());
+        map<string,unsigned short>::iterator it = libmap.begin();
+        for( ; it != libmap.end(); ++it) {
+            h.add(it->first.c_str(),it->first.size()+1);
+            h.add(it->second);
+        }
+        _fcache_seed = h.value();
+    }
+}
+
+extractor::~extractor()
+{
+    delete _fcache;
+    delete _bin;
+}
+
+void
+extractor::writer(uint64_t id)
+{
+    if(_bin)
+        _bin->name(id);
+}
+
+int
+extractor::run(char * path, char const* tag)
+{
+    struct stat sbuf;
+
+    if(0 != stat(path,&sbuf)) {
+        fprintf(stderr,"Failed to stat %s: ",path);
+        perror("");
+        return -1;
+    }
+    if(!load(path))
+        return -1;
+    _src = new cfg::code_source(_prog);
+
+    begin(tag ? tag : path);
+
+    ++_stats.counts[stats::BINARIES];
+    _stats.counts[stats::FUNCTIONS] += _prog.nfuncs();
+
+    vector<uint32_t> work;
+    for(uint32_t f=0;f<_prog.nfuncs();++f) {
+        if(!skip(f))
+            work.push_back(f);
+    }
+
+    if(_opts.jobs > 1 && !_opts.graph && !_opts.byfunc)
+        walk_parallel(work);
+    else
+        walk(work);
+
+    end();
+
+    _ob.flush();
+    delete _src;
+    _src = NULL;
+
+    return 0;
+}
+
+/*
+ * Fill in _prog from the cache, if there is one holding an entry for the
+ * contents of path; otherwise parse the binary, and add it to the cache.
+ */
+bool
+extractor::load(char * path)
+{
+    uint64_t key = 0;
+    string cached;
+
+    // not a parse, so never cached as one
+    if(_opts.raw) {
+        phase_timer t(timed(_stats),stats::PARSE);
+        return cfg::from_elf(path,_prog);
+    }
+
+    if(_opts.cache && cfg::file_key(path,key)) {
+        phase_timer t(timed(_stats),stats::CFG_CACHE);
+        char name[32];
+        snprintf(name,sizeof(name),"/%016lx.cfg",(unsigned long)key);
+        cached = string(_opts.cache) + name;
+        if(_prog.load(cached.c_str(),key))
+            return true;
+    }
+
+    {
+        phase_timer t(timed(_stats),stats::PARSE);
+        SymtabCodeSource * sts = new SymtabCodeSource( path );
+        CodeObject * co = new CodeObject( sts );
+        co->parse();
+
+        cfg::from_parseapi(sts,co,_prog);
+
+        delete co;
+        delete sts;
+    }
+
+    if(!cached.empty()) {
+        phase_timer t(timed(_stats),stats::CFG_CACHE);
+        if(mkdir(_opts.cache,0777) != 0 && errno != EEXIST) {
+            fprintf(stderr,"Can't create cache directory %s: %s\n",
+                _opts.cache,strerror(errno));
+            return true;
+        }
+        (void)_prog.save(cached.c_str(),key);
+    }
+    return true;
+}
+
+bool
+extractor::skip(uint32_t f)
+{
+    char const* name = _prog.name(_prog.func(f));
+
+    if(_exclude.find(name) != _exclude.end()) {
+        ++_stats.counts[stats::SKIP_EXCLUDE];
+        return true;
+    }
+
+    if(strncmp(name,"std::",5) == 0 ||
+       strncmp(name,"__gnu_cxx::",11) == 0) {
+        ++_stats.counts[stats::SKIP_STD];
+        return true;
+    }
+
+    return false;
+}
+
+void
+extractor::walk(vector<uint32_t> & funcs)
+{
+    worker w(_opts);
+    w.feats.count_ngrams(_opts);
+    vector<ngram_runs> runs;
+
+    for(unsigned i=0;i<funcs.size();++i) {
+        mkruns(funcs[i],runs);
+        function(funcs[i],i,runs,w,_ob);
+    }
+
+    _feats.merge(w.feats);
+    w.st.counts[stats::INSTRUCTIONS] += w.fv->decoded();
+    _stats.merge(w.st);
+}
+
+/*
+ * Functions are handed out to the workers in chunks. Each worker counts
+ * into its own features, which are merged once the walk is done; since
+ * all counts are kept in ordered maps the result does not depend on
+ * which worker saw which function. The only ordered output, the
+ * n-grams, is buffered per function and written in funcs() order at
+ * the end of each chunk. The buffers are kept from chunk to chunk.
+ *
+ * A --topk sketch that has filled up does depend on the order it is
+ * fed, so rather than one per worker there is one, fed here with each
+ * chunk's runs in funcs() order.
+ */
+void
+extractor::walk_parallel(vector<uint32_t> & funcs)
+{
+    // Settle the ownership of shared blocks before any thread looks
+    _claims.build(_prog,funcs);
+
+    vector<worker> workers;
+    for(int t=0;t<_opts.jobs;++t)
+        workers.emplace_back(_opts);
+    for(unsigned t=0;t<workers.size();++t) {
+        workers[t].feats.count_ngrams(_opts);
+        workers[t].sketch = false;
+    }
+
+    size_t chunk = CHUNK_PER_JOB * _opts.jobs;
+    vector<outbuf *> bufs(chunk);
+    for(size_t i=0;i<bufs.size();++i)
+        bufs[i] = new outbuf(NULL,256);
+
+    for(size_t base = 0; base < funcs.size(); base += chunk) {
+        size_t lim = std::min(funcs.size(), base + chunk);
+
+        // which bytes an extent contributes depends on the extents
+        // visited before it, so that much is decided in order here
+        vector< vector<ngram_runs> > runs(lim - base);
+        for(size_t i=base;i<lim;++i)
+            mkruns(funcs[i],runs[i-base]);
+
+        std::atomic<size_t> next(base);
+        vector<std::thread> threads;
+        for(int t=0;t<_opts.jobs;++t) {
+            threads.push_back(std::thread([&,t]() {
+                size_t i;
+                while((i = next++) < lim)
+                    function(funcs[i],i,runs[i-base],workers[t],*bufs[i-base]);
+            }));
+        }
+        for(unsigned t=0;t<threads.size();++t)
+            threads[t].join();
+
+        if(_opts.ngram_topk) {
+            phase_timer t(timed(_stats),stats::NGRAMS);
+            for(size_t i=0;i<lim-base;++i)
+                for(unsigned j=0;j<runs[i].size();++j)
+                    topngrams(_prog,runs[i][j],_feats.hitters);
+        }
+
+        for(size_t i=0;i<lim-base;++i) {
+            _ob.put(bufs[i]->data(),bufs[i]->size());
+            bufs[i]->clear();
+        }
+    }
+
+    for(size_t i=0;i<bufs.size();++i)
+        delete bufs[i];
+
+    for(unsigned t=0;t<workers.size();++t) {
+        _feats.merge(workers[t].feats);
+        workers[t].st.counts[stats::INSTRUCTIONS] += workers[t].fv->decoded();
+        _stats.merge(workers[t].st);
+    }
+}
+
+void
+extractor::mkruns(uint32_t f, vector<ngram_runs> & runs)
+{
+    runs.clear();
+    if(!(_opts.families & NGRAMS) || _opts.ngram_opcodes)
+        return;
+
+    phase_timer t(timed(_stats),stats::NGRAMS);
+    cfg::span<cfg::extent> extents = _prog.extents(_prog.func(f));
+    runs.resize(extents.size());
+    for(unsigned i=0;i<extents.size();++i)
+        mkngram_runs(extents[i],_ngram_visited,runs[i]);
+}
+
+void
+extractor::begin(char const* tag)
+{
+    _ngram_visited.clear();
+    _claims.clear();
+    _feats.clear();
+    _nid = 0;
+    _tag = tag;
+
+    if(_bin && !_bin_header) {
+        bin_writer::header(_ob,_layout,_opts.class_tag);
+        _bin_header = true;
+    }
+
+    if(_opts.record && !_bin)
+        _ob.put(tag);
+    if(_opts.graph)
+        _ob.put("digraph G {\n");
+
+    if(_opts.families & LIBCALLS && _opts.listall) {
+        for(cfg::linkage_entry const& l : _prog.linkage())
+            _feats.libcalls[_prog.linkage_name(l)] = 0;
+    }
+}
+
+bool
+extractor::has_idioms(cfg::function const& fn)
+{
+    if(fn.nblocks == 0)
+        return false;
+    return !((_opts.nort && (fn.flags & cfg::FUNC_RT)) ||
+             (_opts.noplt && _prog.linkage_name(fn.addr)));
+}
+
+void
+extractor::mkidioms(cfg::function const& fn, worker & w,
+    map<string,int> & counts)
+{
+    if(!has_idioms(fn))
+        return;
+
+    // the cache key may have decoded the blocks already
+    if(w.ninsns < 0) {
+        w.blocks.clear();
+        for(uint32_t b : _prog.blocks(fn)) {
+            cfg::block const& bb = _prog.blk(b);
+            w.blocks.push_back(make_pair(bb.start,bb.end));
+        }
+    }
+    IdiomTable<unsigned> const& idioms = w.ninsns < 0 ?
+        w.fv->count_idioms(_src,w.blocks) : w.fv->count_idioms(w.ninsns);
+    IdiomTable<unsigned>::const_iterator it = idioms.begin();
+    for( ; it != idioms.end(); ++it) {
+        if(_opts.hash_dims)
+            w.feats.hashed[idiom_index(it->key,_opts.hash_dims)] += it->value;
+        else
+            counts[it->key.format()] += it->value;
+    }
+}
+
+/*
+ * Counts of the cached families go to w.fn, which is filled from the
+ * feature cache when the function has been seen before and stored to it
+ * otherwise; then they join the rest in w.feats.
+ */
+void
+extractor::function(uint32_t f, int fidx, vector<ngram_runs> const& runs,
+    worker & w, outbuf & out)
+{
+    cfg::function const& fn = _prog.func(f);
+    stats * st = timed(w.st);
+    unsigned long colored = color_insns();
+
+    ++w.st.counts[stats::PROCESSED];
+    w.st.counts[stats::BLOCKS] += fn.nblocks;
+    for(uint32_t b : _prog.blocks(fn))
+        w.st.counts[stats::EDGES] += _prog.blk(b).ntargets;
+
+    uint64_t key = 0;
+    bool hit = false;
+    w.ninsns = -1;
+    if(_fcache) {
+        phase_timer t(st,stats::FEATURE_CACHE);
+        key = function_key(_prog,_src,w.fv->insns(),w.ninsns,f,fidx,
+            _claims,_fcache_seed,
+            (_cached & IDIOMS) && has_idioms(fn) ? _opts.idiom_len : 0,
+            _opts.color);
+        hit = _fcache->get(key,w.fn);
+        ++w.st.counts[hit ? stats::FCACHE_HITS : stats::FCACHE_MISSES];
+    }
+
+    map<string,int> & idioms =
+        _cached & IDIOMS ? w.fn.idioms : w.feats.idioms;
+    map<graphlet,int> & graphlets =
+        _cached & GRAPHLETS ? w.fn.graphlets : w.feats.graphlets;
+    map<graphlet,int> & supergraphlets =
+        _cached & SUPERGRAPHLETS ? w.fn.supergraphlets : w.feats.supergraphlets;
+    map<graphlet,int> & calldfa =
+        _cached & CALLDFA ? w.fn.calldfa : w.feats.calldfa;
+
+    if(_opts.families & NGRAMS) {
+        phase_timer t(st,stats::NGRAMS);
+        if(_opts.ngram_opcodes) {
+            mkopgrams(_prog,f,fidx,_claims,_opts.ngram_operands,
+                w.feats.ngrams);
+        }
+        for(unsigned i=0;i<runs.size();++i) {
+            if(_opts.ngram_topk) {
+                if(w.sketch)
+                    topngrams(_prog,runs[i],w.feats.hitters);
+            } else if(_opts.ngram_counts)
+                countngrams(_prog,runs[i],w.feats.ngrams,_opts.skipgrams,
+                    w.feats.skipgrams);
+            else
+                mkngrams(_prog,runs[i],_opts.ngram_lens,_opts.skipgrams,
+                    _opts.record,out);
+
+            addr_t len = 0;
+            for(unsigned j=0;j<runs[i].size();++j)
+                len += runs[i][j].second - runs[i][j].first;
+            for(unsigned j=0;j<_opts.ngram_lens.size();++j) {
+                addr_t n = _opts.ngram_lens[j];
+                if(len >= n)
+                    w.st.produced(NGRAMS,0,len - n + 1);
+            }
+            for(unsigned j=0;j<_opts.skipgrams.size();++j) {
+                addr_t n = _opts.skipgrams[j].span;
+                if(len >= n)
+                    w.st.produced(NGRAMS,0,len - n + 1);
+            }
+        }
+    }
+
+    if(_opts.families & IDIOMS) {
+        if(_opts.nort && (fn.flags & cfg::FUNC_RT))
+            ++w.st.counts[stats::SKIP_NORT];
+        else if(_opts.noplt && _prog.linkage_name(fn.addr))
+            ++w.st.counts[stats::SKIP_NOPLT];
+
+        if(!(hit && _cached & IDIOMS)) {
+            phase_timer t(st,stats::IDIOMS);
+            mkidioms(fn,w,idioms);
+        }
+    }
+
+    if(_opts.families & GRAPHLETS && !(hit && _cached & GRAPHLETS)) {
+        {
+            phase_timer t(st,stats::GRAPHLETS);
+            mkgraphlets(_prog,f,fidx,graphlets,_claims,_opts.color);
+        }
+
+        if(_opts.byfunc) {
+            phase_timer t(st,stats::OUTPUT);
+            count_produced(w.st,GRAPHLETS,graphlets);
+            if(_bin) {
+                _bin->begin(fn.addr);
+                add_graphlets(*_bin,GRAPHLETS,graphlets,"",_opts.color);
+                _bin->end(_ob);
+            } else if(_opts.hash_dims) {
+                map<uint32_t,int> v;
+                hash_graphlets(v,GRAPHLETS,graphlets,_opts.color,
+                    _opts.hash_dims);
+                _ob.hex(fn.addr);
+                _ob.put(',');
+                print_hashed(_ob,v,NULL,COMMASEP);
+            } else {
+                _ob.hex(fn.addr);
+                _ob.put(',');
+                print_graphlets(_ob,graphlets,"",_opts.color,COMMASEP);
+            }
+            graphlets.clear();
+            _claims.clear();
+        }
+    }
+
+    if(_opts.families & SUPERGRAPHLETS &&
+       !(hit && _cached & SUPERGRAPHLETS)) {
+        graph * g;
+        {
+            phase_timer t(st,stats::SUPERGRAPHLETS);
+            g = func_to_graph(_prog,f,fidx,_claims,_opts.color);
+        }
+
+        // iteratively compress
+        {
+            phase_timer t(st,stats::MERGE);
+            for(int m=0;m<_opts.merge;++m)
+                g->compact();
+        }
+
+        if(_opts.graph) {
+            phase_timer t(st,stats::OUTPUT);
+            g->todot(_nid,false,_ob);
+        } else {
+            phase_timer t(st,stats::SUPERGRAPHLETS);
+            g->mkgraphlets(supergraphlets,_opts.color,_opts.anon);
+        }
+        delete g;
+    }
+
+    if(_opts.families & CALLDFA && !(hit && _cached & CALLDFA)) {
+        graph * g;
+        {
+            phase_timer t(st,stats::CALLDFA);
+            g = mkcalldfa(_prog,f,_libmap);
+        }
+        if(_opts.graph) {
+            phase_timer t(st,stats::OUTPUT);
+            g->todot(_nid,true,_ob);
+        } else {
+            phase_timer t(st,stats::CALLDFA);
+            g->mkgraphlets(calldfa,true,false);  // color, not anonymous
+        }
+        delete g;
+    }
+
+    if(_opts.families & LIBCALLS) {
+        phase_timer t(st,stats::LIBCALLS);
+        mklibcalls(_prog,f,w.feats.libcalls,w.feats.real_funcs);
+    }
+
+    if(_fcache) {
+        phase_timer t(st,stats::FEATURE_CACHE);
+        if(!hit)
+            _fcache->put(key,w.fn);
+        w.feats.merge(w.fn);
+        w.fn.clear();
+    }
+
+    w.st.counts[stats::INSTRUCTIONS] += color_insns() - colored;
+}
+
+void
+extractor::end()
+{
+    phase_timer t(timed(_stats),stats::OUTPUT);
+
+    if(_opts.stats)
+        count_output();
+
+    if(_opts.graph)
+        _ob.put("}\n");
+
+    if(_bin) {
+        end_binary();
+        return;
+    }
+    if(_opts.hash_dims) {
+        end_hashed();
+        return;
+    }
+
+    if(_opts.families & NGRAMS) {
+        if(_opts.ngram_counts)
+            print_ngrams(_ob,_feats,_opts,_layout);
+        else if(!_opts.record)
+            _ob.put('\n');
+    }
+    if(_opts.families & IDIOMS)
+        print_idioms(_ob,_feats.idioms,_opts.class_tag,_layout,
+            _opts.idiom_list ? &_idiom_order : NULL);
+    if(_opts.families & GRAPHLETS && !_opts.byfunc)
+        print_graphlets(_ob,_feats.graphlets,"",_opts.color,_layout);
+    if(_opts.families & SUPERGRAPHLETS)
+        print_graphlets(_ob,_feats.supergraphlets,"SG_",_opts.color,_layout);
+    if(_opts.families & CALLDFA)
+        print_graphlets(_ob,_feats.calldfa,"CD_",true,_layout);
+    if(_opts.families & LIBCALLS)
+        print_libcalls(_ob,_feats.libcalls,_feats.real_funcs,_layout);
+
+    if(_opts.record)
+        _ob.put('\n');
+}
+
+void
+extractor::count_output()
+{
+    // occurrences of byte n-grams were counted as they were found
+    if(_opts.families & NGRAMS && _opts.ngram_counts) {
+        for(unsigned i=0;i<_feats.ngrams.size();++i) {
+            ngram_table const& t = _feats.ngrams[i];
+            _stats.produced(NGRAMS,t.size(),
+                _opts.ngram_opcodes ? t.total() : 0);
+        }
+        for(unsigned i=0;i<_feats.skipgrams.size();++i)
+            _stats.produced(NGRAMS,_feats.skipgrams[i].size(),0);
+        for(unsigned i=0;i<_feats.hitters.size();++i) {
+            _stats.produced(NGRAMS,std::min((size_t)_opts.ngram_topk,
+                _feats.hitters[i].size()),0);
+        }
+    }
+    if(_opts.families & IDIOMS) {
+        if(_opts.hash_dims)
+            count_produced(_stats,IDIOMS,_feats.hashed);
+        else
+            count_produced(_stats,IDIOMS,_feats.idioms);
+    }
+    if(_opts.families & GRAPHLETS && !_opts.byfunc)
+        count_produced(_stats,GRAPHLETS,_feats.graphlets);
+    if(_opts.families & SUPERGRAPHLETS)
+        count_produced(_stats,SUPERGRAPHLETS,_feats.supergraphlets);
+    if(_opts.families & CALLDFA)
+        count_produced(_stats,CALLDFA,_feats.calldfa);
+    if(_opts.families & LIBCALLS) {
+        map<string,int> printed;
+        map<string,int>::const_iterator it = _feats.libcalls.begin();
+        for( ; it != _feats.libcalls.end(); ++it) {
+            if(_feats.real_funcs.find(it->first) == _feats.real_funcs.end())
+                printed.insert(*it);
+        }
+        count_produced(_stats,LIBCALLS,printed);
+    }
+}
+
+void
+extractor::end_binary()
+{
+    unsigned families = _opts.families & ~NGRAMS;
+    if(_opts.byfunc)
+        families &= ~GRAPHLETS;
+    if(!families)
+        return;
+
+    _bin->begin(_tag.c_str());
+    if(families & IDIOMS)
+        add_idioms(*_bin,_feats.idioms,
+            _opts.idiom_list ? &_idiom_order : NULL);
+    if(families & GRAPHLETS)
+        add_graphlets(*_bin,GRAPHLETS,_feats.graphlets,"",_opts.color);
+    if(families & SUPERGRAPHLETS)
+        add_graphlets(*_bin,SUPERGRAPHLETS,_feats.supergraphlets,"SG_",
+            _opts.color);
+    if(families & CALLDFA)
+        add_graphlets(*_bin,CALLDFA,_feats.calldfa,"CD_",true);
+    if(families & LIBCALLS)
+        add_libcalls(*_bin,_feats.libcalls,_feats.real_funcs);
+    _bin->end(_ob);
+}
+
+/* All families go into one vector, printed as a single family would be */
+void
+extractor::end_hashed()
+{
+    unsigned dims = _opts.hash_dims;
+    unsigned families = _opts.families & ~NGRAMS;
+    if(_opts.byfunc)
+        families &= ~GRAPHLETS;
+
+    if(families) {
+        map<uint32_t,int> & v = _feats.hashed;
+        if(families & GRAPHLETS)
+            hash_graphlets(v,GRAPHLETS,_feats.graphlets,_opts.color,dims);
+        if(families & SUPERGRAPHLETS)
+            hash_graphlets(v,SUPERGRAPHLETS,_feats.supergraphlets,
+                _opts.color,dims);
+        if(families & CALLDFA)
+            hash_graphlets(v,CALLDFA,_feats.calldfa,true,dims);
+        if(families & LIBCALLS)
+            hash_libcalls(v,_feats.libcalls,_feats.real_funcs,dims);
+        print_hashed(_ob,v,_opts.class_tag,_layout);
+    }
+
+    if(_opts.record)
+        _ob.put('\n');
+}
+
+}
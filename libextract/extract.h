@@ -0,0 +1,281 @@
+#ifndef _EXTRACT_H_
+#define _EXTRACT_H_
+
+/*
+ * Drives the feature kernels over a parsed binary.
+ *
+ * An extractor parses its target once and makes a single pass over
+ * the functions, producing every feature family enabled in its
+ * options. Output for each family is identical to that of the
+ * corresponding stand-alone utility.
+ *
+ * With raw set, the binary is not parsed at all: its functions and their
+ * bounds come from the symbol table (see cfg_elf.h), which is enough for
+ * the n-grams alone and far cheaper.
+ *
+ * With a cache directory, the parse is kept on disk as a cfg::program
+ * named for the binary's content key, and later runs over the same
+ * contents map it back in instead of parsing again. With a feature
+ * cache, the counts of each function are likewise kept under a key for
+ * its contents (see fcache.h) and reused wherever it turns up again.
+ */
+#include <stdio.h>
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "CodeSource.h"
+#include "dyntypes.h"
+
+#include "cfg.h"
+#include "fcache.h"
+#include "graphlet.h"
+#include "kernels.h"
+#include "ngtable.h"
+#include "outbuf.h"
+#include "stats.h"
+
+class FeatureVector;
+class IdiomList;
+struct IdiomKey;
+
+namespace extract {
+
+class bin_writer;
+
+/* How the counts of a family are laid out */
+enum layout {
+    LINES,          // feature:count, one per line
+    COMMASEP,       // feature:count, ... ending the line
+    RECORD          // ,feature:count ... continuing the current line
+};
+
+enum family {
+    NGRAMS          = 0x01,
+    IDIOMS          = 0x02,
+    GRAPHLETS       = 0x04,
+    SUPERGRAPHLETS  = 0x08,
+    CALLDFA         = 0x10,
+    LIBCALLS        = 0x20,
+
+    ALL_FAMILIES    = 0x3f
+};
+
+/* Counters per n-gram reported by --topk, unless told otherwise */
+static const unsigned TOPK_COUNTERS = 8;
+
+/* The longest n-gram -n accepts */
+static const int MAX_NGRAM_LEN = 1024;
+
+struct options {
+    options();
+
+    unsigned families;      // mask of enabled families
+
+    char * exclude;         // function exclusion list
+    char * libmap;          // calldfa library function list
+    char * class_tag;       // idioms class tag
+    IdiomList const* idiom_list;    // idioms, count only those listed
+                            // (see load_idiom_list), or NULL
+    int idiom_len;          // idioms, at most this many terms
+    bool commasep;
+
+    std::vector<int> ngram_lens;    // ngrams, ascending
+    std::vector<skipgram> skipgrams;    // ngrams, gapped
+    bool ngram_counts;      // ngrams, count rather than list them
+    bool ngram_opcodes;     // ngrams of instructions, always counted
+    bool ngram_operands;    // with the classes of their operands
+    unsigned ngram_topk;    // ngrams, only the most frequent this many
+    unsigned topk_counters; // kept by a sketch of this many counters,
+                            // or 0 for TOPK_COUNTERS per n-gram reported
+    bool color;             // graphlets, supergraphlets
+    bool byfunc;            // graphlets, per-function output
+    int merge;              // supergraphlets merge iterations
+    bool anon;              // supergraphlets anonymous edges
+    bool graph;             // supergraphlets & calldfa, dot output
+    bool nort;              // idioms, skip RT-discovered funcs
+    bool noplt;             // idioms, skip plt stubs
+    bool listall;           // libcalls, list all plt funcs
+
+    int jobs;               // worker threads for the function walk
+                            // (worker processes for a batch)
+
+    bool record;            // print everything on one tagged line
+    bool binary;            // write counts in the format of binfmt.h
+    unsigned hash_dims;     // hash features into this many dimensions
+                            // (a power of two), or 0 to print them
+
+    bool raw;               // ngrams only, read the ELF without parsing
+    char * cache;           // directory of parsed binaries, or NULL
+    char * fcache;          // directory of per-function counts, or NULL
+
+    char * stats;           // where to write run statistics, or NULL
+
+    // byfunc and graph produce output while the functions are being
+    // walked, and so only make sense with a single family enabled.
+    // They are always run serially. Neither graph nor the n-grams,
+    // even when counted, have a binary form.
+};
+
+/* Feature counts accumulated over a binary */
+struct features {
+    std::map<std::string,int> idioms;
+    std::map<graphlets::graphlet,int> graphlets;
+    std::map<graphlets::graphlet,int> supergraphlets;
+    std::map<graphlets::graphlet,int> calldfa;
+    std::map<std::string,int> libcalls;
+    std::unordered_map<std::string,bool> real_funcs;
+    std::map<uint32_t,int> hashed;      // idioms, with hash_dims
+    std::vector<ngram_table> ngrams;    // with ngram_counts, per length
+    std::vector<ngram_table> skipgrams; // and per skip-gram
+    std::vector<topk> hitters;          // or sketched, with ngram_topk
+
+    void clear();
+    /* count the n-grams and skip-grams of opts from here on */
+    void count_ngrams(options const& opts);
+    void merge(features const& o);
+    void merge(func_counts const& o);
+};
+
+class extractor {
+ public:
+    extractor(options const& opts, FILE * out = stdout);
+    ~extractor();
+
+    /* Parse the binary at path, walk it and print the requested
+       families. Records are tagged with tag, or the path if there is
+       none. Returns 0 on success. */
+    int run(char * path, char const* tag = NULL);
+
+    void output(FILE * out) { _ob.target(out); }
+    /* Name the binary output's dictionary (see bin_writer::name) */
+    void writer(uint64_t id);
+
+    /* Gathered over every run, if opts.stats is set */
+    stats const& statistics() const { return _stats; }
+    void clear_statistics() { _stats.clear(); }
+
+    /* Of the last run */
+    features const& counts() const { return _feats; }
+
+ private:
+    struct worker;
+
+    bool load(char * path);
+    bool skip(uint32_t f);
+    stats * timed(stats & s) { return _opts.stats ? &s : NULL; }
+    void walk(std::vector<uint32_t> & funcs);
+    void walk_parallel(std::vector<uint32_t> & funcs);
+    void function(uint32_t f, int fidx,
+        std::vector<ngram_runs> const& runs, worker & w, outbuf & out);
+    void mkruns(uint32_t f, std::vector<ngram_runs> & runs);
+    bool has_idioms(cfg::function const& fn);
+    void mkidioms(cfg::function const& fn, worker & w,
+        std::map<std::string,int> & counts);
+    void begin(char const* tag);
+    void end();
+    void count_output();
+    void end_binary();
+    void end_hashed();
+
+ private:
+    options _opts;
+    outbuf _ob;
+    layout _layout;
+
+    dyn_hash_map<std::string,bool> _exclude;
+    dyn_hash_map<std::string,unsigned short> _libmap;
+    std::vector<std::string> _idiom_order;  // as listed, formatted
+
+    // per-binary state
+    cfg::program _prog;
+    Dyninst::ParseAPI::InstructionSource * _src;
+    extent_set _ngram_visited;
+    claim_table _claims;
+    int _nid;
+
+    features _feats;
+    std::string _tag;
+
+    feature_cache * _fcache;
+    unsigned _cached;       // families whose counts go through _fcache
+    uint64_t _fcache_seed;
+
+    bin_writer * _bin;
+    bool _bin_header;       // whether the stream header has been written
+
+    stats _stats;
+};
+
+/* Input helpers shared by the utilities */
+void chomp(char * s);
+void load_exclude(char const* file, dyn_hash_map<std::string,bool> & exclude);
+void load_libmap(char const* file,
+    dyn_hash_map<std::string,unsigned short> & libmap);
+/* The idioms listed in file, loaded once and shared by every worker;
+   NULL, having said why, if it cannot be read or lists no idiom */
+IdiomList * load_idiom_list(char const* file);
+/* n-gram lengths, as a number, a range m-n or a comma-separated list of
+   either, into ascending lens; false if malformed or one is over
+   MAX_NGRAM_LEN */
+bool parse_lengths(char const* s, std::vector<int> & lens);
+/* Comma-separated skip-gram patterns, appended to skips; false if one
+   is malformed or does not begin and end with a kept byte */
+bool parse_skipgrams(char const* s, std::vector<skipgram> & skips);
+/* A number of hash dimensions, given as 2^k or in full; 0 if it is not
+   a power of two */
+unsigned parse_dims(char const* s);
+/* A number of terms per idiom that libfeat can count; 0 if it is not
+   one */
+int parse_idiom_len(char const* s);
+
+/* Output in the format of each of the stand-alone utilities */
+/* With order, the idioms counted are printed in that order instead */
+void print_idioms(outbuf & out, std::map<std::string,int> & counts,
+    char const* class_tag, layout l,
+    std::vector<std::string> const* order = NULL);
+void print_graphlets(outbuf & out, std::map<graphlets::graphlet,int> & counts,
+    char const* prefix, bool color, layout l);
+/* Counted n-grams, as <ngram>:count in the layout of print_graphlets,
+   by length and prefixed with it as mkngrams() does, then skip-grams;
+   or opcode n-grams, as format_opgram() has them. Sketched n-grams are
+   <ngram>:count:error, the most frequent first. */
+void print_ngrams(outbuf & out, features const& f, options const& opts,
+    layout l);
+void print_libcalls(outbuf & out, std::map<std::string,int> & counts,
+    std::unordered_map<std::string,bool> & real_funcs, layout l);
+
+/* Hashed counts, as index:count in the layout of print_graphlets; with a
+   class tag, as print_idioms would lay them out */
+void print_hashed(outbuf & out, std::map<uint32_t,int> & counts,
+    char const* class_tag, layout l);
+
+/* Feature hashing: each family adds its counts at the index of a hash of
+   the identity of each feature, seeded by the family */
+uint32_t idiom_index(IdiomKey const& k, unsigned dims);
+void hash_graphlets(std::map<uint32_t,int> & into, unsigned family,
+    std::map<graphlets::graphlet,int> & counts, bool color, unsigned dims);
+void hash_libcalls(std::map<uint32_t,int> & into,
+    std::map<std::string,int> & counts,
+    std::unordered_map<std::string,bool> & real_funcs, unsigned dims);
+
+/* The same, as sections of a binary record */
+void add_idioms(bin_writer & bw, std::map<std::string,int> & counts,
+    std::vector<std::string> const* order = NULL);
+void add_graphlets(bin_writer & bw, unsigned family,
+    std::map<graphlets::graphlet,int> & counts, char const* prefix, bool color);
+void add_libcalls(bin_writer & bw, std::map<std::string,int> & counts,
+    std::unordered_map<std::string,bool> & real_funcs);
+
+/* Process every binary listed in manifest, one per line with an
+   optional tab-separated tag, with opts.jobs worker processes. Prints
+   one record per binary in the order they complete. Returns the
+   number of binaries that could not be processed. With opts.binary,
+   the records make up a single binary stream. */
+int run_batch(options const& opts, char const* manifest, FILE * out);
+
+}
+
+#endif
@@ -0,0 +1,388 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "feature.h"
+
+#include "fcache.h"
+#include "hash.h"
+
+using namespace std;
+using namespace Dyninst;
+using namespace Dyninst::ParseAPI;
+using namespace graphlets;
+
+namespace extract {
+
+// bump when the key or the entry format change
+#define FCACHE_MAGIC "ESFC\0\0\0\2"
+
+void
+func_counts::clear()
+{
+    idioms.clear();
+    graphlets.clear();
+    supergraphlets.clear();
+    calldfa.clear();
+}
+
+/** keys **/
+
+/* Rows [first,last) of insns, as libfeat sees them */
+static void
+hash_rows(hasher & h, InsnTable const& insns, long first, long last)
+{
+    for(long i=first;i<last;++i) {
+        h.add(((uint64_t)insns.entry_id[i] << ENTRY_SHIFT) |
+              ((uint64_t)insns.arg1[i] << ARG1_SHIFT) |
+              ((uint64_t)insns.arg2[i] << ARG2_SHIFT));
+        h.add(insns.len[i]);
+    }
+    h.add((uint32_t)(last - first));
+}
+
+/* The instructions after those of rows [first,last) that an idiom of
+   idioms terms starting among them reaches, as idioms_at() follows
+   them; they are appended to insns if they are not there */
+static void
+hash_lookahead(hasher & h, InsnTable & insns, long first, long last,
+    int idioms)
+{
+    uint32_t n = 0;
+    long i = last - 1;
+    if(last > first) {
+        for( ;(int)n<idioms-1;++n) {
+            if(insns.entry_id[i] == ILLEGAL_ENTRY)
+                break;
+            if((i = insns.next(i)) < 0)
+                break;
+            hash_rows(h,insns,i,i+1);
+        }
+    }
+    h.add(n);
+}
+
+/* The instructions of [start,end) outside the function; at() leaves the
+   rows the function's idioms are counted from as they are */
+static void
+hash_outside(hasher & h, InsnTable & insns, addr_t start, addr_t end)
+{
+    uint32_t n = 0;
+    long i = insns.at(start);
+    while(i >= 0 && insns.len[i]) {
+        addr_t next = insns.addr[i] + insns.len[i];
+        if(next > end)
+            break;
+        hash_rows(h,insns,i,i+1);
+        ++n;
+        if(next == end)
+            break;
+        i = insns.at(next);
+    }
+    h.add(n);
+}
+
+/*
+ * Blocks are described by position: those of f by their index in f,
+ * and the blocks outside f that they have edges to by order of first
+ * mention. idioms is 0 for functions whose idioms are not counted.
+ * Outside blocks matter to graphlets through their edges among these
+ * blocks (all others are ignored) and, with colors, their instructions.
+ * The instructions are decoded into insns, the function's blocks first.
+ */
+uint64_t
+function_key(program const& p, InstructionSource * src, InsnTable & insns,
+    long & ninsns, uint32_t f, int fidx, claim_table & claims,
+    uint64_t seed, int idioms, bool color)
+{
+    static const uint32_t SINK = cfg::NONE;
+
+    hasher h(seed);
+    cfg::function const& fn = p.func(f);
+    cfg::span<uint32_t> blocks = p.blocks(fn);
+
+    dyn_hash_map<uint32_t,uint32_t> pos;
+    vector<uint32_t> outside;
+    for(uint32_t i=0;i<blocks.size();++i)
+        pos[blocks[i]] = i;
+
+    auto mention = [&](uint32_t b) -> uint32_t {
+        if(b == cfg::NONE)
+            return SINK;
+        auto it = pos.find(b);
+        if(it != pos.end())
+            return it->second;
+        uint32_t ind = blocks.size() + outside.size();
+        pos[b] = ind;
+        outside.push_back(b);
+        return ind;
+    };
+
+    h.add((uint32_t)idioms);
+    h.add((uint32_t)color);
+    h.add((uint32_t)blocks.size());
+    h.add(fn.entry == cfg::NONE ? SINK : mention(fn.entry));
+
+    // each block's rows, then (once they are all in) what idioms reach
+    vector<long> first;
+    if(idioms || color) {
+        insns.reset(src,false);
+        first.reserve(blocks.size()+1);
+        for(uint32_t b : blocks) {
+            cfg::block const& bb = p.blk(b);
+            first.push_back(insns.size());
+            insns.add_block(bb.start,bb.end);
+        }
+        first.push_back(insns.size());
+        ninsns = insns.size();
+    }
+
+    for(uint32_t i=0;i<blocks.size();++i) {
+        uint32_t b = blocks[i];
+        cfg::block const& bb = p.blk(b);
+
+        h.add((uint32_t)claims.claim(b,fidx));
+        if(idioms || color)
+            hash_rows(h,insns,first[i],first[i+1]);
+        if(idioms)
+            hash_lookahead(h,insns,first[i],first[i+1],idioms);
+
+        h.add(bb.nsources);
+        for(uint32_t e : p.sources(bb)) {
+            cfg::edge const& E = p.edg(e);
+            h.add(E.type);
+            h.add(E.flags);
+            h.add(mention(E.src));
+        }
+        h.add(bb.ntargets);
+        for(uint32_t e : p.targets(bb)) {
+            cfg::edge const& E = p.edg(e);
+            h.add(E.type);
+            h.add(E.flags);
+            h.add(mention(E.trg));
+        }
+    }
+
+    h.add(fn.ncalls);
+    for(uint32_t c : p.calls(fn)) {
+        cfg::edge const& E = p.edg(c);
+        h.add(mention(E.src));
+        char const* plt = E.trg == cfg::NONE ? NULL :
+            p.linkage_name(p.blk(E.trg).start);
+        if(plt)
+            h.add(plt,strlen(plt)+1);
+        else
+            h.add(SINK);
+    }
+
+    // no more blocks are mentioned from here on
+    h.add((uint32_t)outside.size());
+    for(unsigned i=0;i<outside.size();++i) {
+        cfg::block const& bb = p.blk(outside[i]);
+
+        for(uint32_t e : p.sources(bb)) {
+            cfg::edge const& E = p.edg(e);
+            auto it = pos.find(E.src);
+            if(it != pos.end()) {
+                h.add(E.type);
+                h.add(it->second);
+            }
+        }
+        h.add(SINK);
+        for(uint32_t e : p.targets(bb)) {
+            cfg::edge const& E = p.edg(e);
+            auto it = pos.find(E.trg);
+            if(it != pos.end()) {
+                h.add(E.type);
+                h.add(it->second);
+            }
+        }
+        h.add(SINK);
+
+        if(color)
+            hash_outside(h,insns,bb.start,bb.end);
+    }
+
+    return h.value();
+}
+
+/** storage **/
+
+namespace {
+
+void
+put_u32(string & buf, uint32_t v)
+{
+    buf.append((char const*)&v,sizeof(v));
+}
+
+bool
+get_u32(char const*& p, char const* end, uint32_t & v)
+{
+    if(end - p < (long)sizeof(v))
+        return false;
+    memcpy(&v,p,sizeof(v));
+    p += sizeof(v);
+    return true;
+}
+
+void
+put_graphlets(string & buf, map<graphlet,int> const& counts)
+{
+    vector<int> enc;
+
+    put_u32(buf,counts.size());
+    map<graphlet,int>::const_iterator it = counts.begin();
+    for( ; it != counts.end(); ++it) {
+        enc.clear();
+        it->first.encode(enc);
+        put_u32(buf,it->second);
+        put_u32(buf,enc.size());
+        buf.append((char const*)&enc[0],enc.size()*sizeof(int));
+    }
+}
+
+bool
+get_graphlets(char const*& p, char const* end, map<graphlet,int> & counts)
+{
+    uint32_t n, cnt, len;
+    vector<int> enc;
+
+    if(!get_u32(p,end,n))
+        return false;
+    for(uint32_t i=0;i<n;++i) {
+        if(!get_u32(p,end,cnt) || !get_u32(p,end,len) ||
+           (size_t)(end - p) < len*sizeof(int))
+            return false;
+        enc.resize(len);
+        memcpy(enc.data(),p,len*sizeof(int));
+        p += len*sizeof(int);
+
+        graphlet g;
+        int const* ep = enc.data();
+        if(!g.decode(ep,ep+len))
+            return false;
+        counts[g] += cnt;
+    }
+    return true;
+}
+
+}
+
+feature_cache::feature_cache(char const* dir) :
+    _dir(dir)
+{
+    if(mkdir(dir,0777) != 0 && errno != EEXIST)
+        fprintf(stderr,"Can't create feature cache %s: %s\n",
+            dir,strerror(errno));
+}
+
+/* entries are spread over 256 subdirectories by their top byte */
+string
+feature_cache::path(uint64_t key, bool mkdirs) const
+{
+    char buf[32];
+    snprintf(buf,sizeof(buf),"/%02x",(unsigned)(key >> 56));
+    string dir = _dir + buf;
+    if(mkdirs)
+        (void)mkdir(dir.c_str(),0777);
+    snprintf(buf,sizeof(buf),"/%016lx",(unsigned long)key);
+    return dir + buf;
+}
+
+bool
+feature_cache::get(uint64_t key, func_counts & c) const
+{
+    string file = path(key,false);
+    FILE * f = fopen(file.c_str(),"r");
+    if(!f)
+        return false;
+
+    string buf;
+    char chunk[4096];
+    size_t n;
+    while((n = fread(chunk,1,sizeof(chunk),f)) > 0)
+        buf.append(chunk,n);
+    fclose(f);
+
+    char const* p = buf.data();
+    char const* end = p + buf.size();
+
+    uint64_t k;
+    if(buf.size() < 16 || memcmp(p,FCACHE_MAGIC,8) != 0)
+        return false;
+    memcpy(&k,p+8,8);
+    if(k != key)
+        return false;
+    p += 16;
+
+    c.clear();
+
+    // a miss counts into c, so nothing of a bad entry may be left there
+    uint32_t nidioms, cnt, len;
+    if(!get_u32(p,end,nidioms))
+        goto bad;
+    for(uint32_t i=0;i<nidioms;++i) {
+        if(!get_u32(p,end,cnt) || !get_u32(p,end,len) ||
+           (uint32_t)(end - p) < len)
+            goto bad;
+        c.idioms[string(p,len)] += cnt;
+        p += len;
+    }
+
+    if(!get_graphlets(p,end,c.graphlets) ||
+       !get_graphlets(p,end,c.supergraphlets) ||
+       !get_graphlets(p,end,c.calldfa))
+        goto bad;
+    return true;
+
+  bad:
+    c.clear();
+    return false;
+}
+
+void
+feature_cache::put(uint64_t key, func_counts const& c) const
+{
+    string buf(FCACHE_MAGIC,8);
+    buf.append((char const*)&key,sizeof(key));
+
+    put_u32(buf,c.idioms.size());
+    map<string,int>::const_iterator it = c.idioms.begin();
+    for( ; it != c.idioms.end(); ++it) {
+        put_u32(buf,it->second);
+        put_u32(buf,it->first.size());
+        buf.append(it->first);
+    }
+    put_graphlets(buf,c.graphlets);
+    put_graphlets(buf,c.supergraphlets);
+    put_graphlets(buf,c.calldfa);
+
+    // written aside and renamed into place, as other processes and
+    // threads may be reading or writing the same entry; each writer gets
+    // a temporary file of its own
+    string file = path(key,true);
+    string tmpfile = file + ".XXXXXX";
+
+    int fd = mkstemp(&tmpfile[0]);
+    if(fd < 0)
+        return;
+    (void)fchmod(fd,0644);
+    FILE * f = fdopen(fd,"w");
+    if(!f) {
+        close(fd);
+        unlink(tmpfile.c_str());
+        return;
+    }
+    bool ok = fwrite(buf.data(),1,buf.size(),f) == buf.size();
+    if(fclose(f) != 0)
+        ok = false;
+    if(!ok || rename(tmpfile.c_str(),file.c_str()) != 0)
+        unlink(tmpfile.c_str());
+}
+
+}
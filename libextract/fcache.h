@@ -0,0 +1,72 @@
+#ifndef _FCACHE_H_
+#define _FCACHE_H_
+
+/*
+ * Per-function feature cache.
+ *
+ * Statically linked binaries carry the same library functions over and
+ * over. The idiom, graphlet, supergraphlet and call-DFA counts of a
+ * function are a function only of its instructions (as libfeat sees
+ * them: opcode and operand classes, not addresses or displacements),
+ * the shape of its CFG and that of the blocks it touches, the PLT
+ * names it calls and the extraction options. function_key() hashes
+ * exactly that, and the counts are stored under the key in a directory
+ * shared by every run, so a function seen before in any binary is
+ * never decoded or walked again.
+ */
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "CodeSource.h"
+
+#include "cfg.h"
+#include "graphlet.h"
+#include "kernels.h"
+
+class InsnTable;
+
+namespace extract {
+
+/* The counts one function contributes to the cached families */
+struct func_counts {
+    std::map<std::string,int> idioms;
+    std::map<graphlets::graphlet,int> graphlets;
+    std::map<graphlets::graphlet,int> supergraphlets;
+    std::map<graphlets::graphlet,int> calldfa;
+
+    void clear();
+};
+
+/*
+ * Key for function f at position fidx of the walk. Claims the blocks
+ * of f in `claims' as the kernels would. seed covers the options;
+ * idioms (the idiom length, or 0 if f's idioms are not counted) and
+ * color say whether instructions matter; if they do, insns is refilled
+ * and its first ninsns rows are f's blocks in order, as
+ * FeatureVector::count_idioms() wants them on a miss.
+ */
+uint64_t function_key(program const& p,
+    Dyninst::ParseAPI::InstructionSource * src,
+    InsnTable & insns, long & ninsns,
+    uint32_t f, int fidx, claim_table & claims,
+    uint64_t seed, int idioms, bool color);
+
+class feature_cache {
+ public:
+    feature_cache(char const* dir);
+
+    bool get(uint64_t key, func_counts & c) const;
+    void put(uint64_t key, func_counts const& c) const;
+
+ private:
+    std::string path(uint64_t key, bool mkdirs) const;
+
+    std::string _dir;
+};
+
+}
+
+#endif
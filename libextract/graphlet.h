@@ -7,6 +7,9 @@
 #include <sstream>
 #include <unordered_map>
 
+#include "hash.h"
+#include "outbuf.h"
+
 namespace graphlets {
 
 /*
@@ -80,21 +83,60 @@ class edgeset {
         return ret.str();
     }
 
-    std::string compact() const {
-        std::stringstream ret;
+    /* Distinct types, with their multiplicities, in the order of an
+       unordered_map, on which existing feature strings depend; the
+       map is only built when there is more than one type to order */
+    void compact(extract::outbuf & out) const {
+        if(types_.empty())
+            return;
+        if(types_.front() == types_.back()) {
+            out.dec(types_.front());
+            if(types_.size() > 1) {
+                out.put('x');
+                out.udec(types_.size());
+            }
+            return;
+        }
+
         std::unordered_map<int,int> unique;
         std::vector<int>::const_iterator it = types_.begin();
         for( ; it != types_.end(); ++it)
             unique[*it] +=1;
         std::unordered_map<int,int>::iterator uit = unique.begin();
         for( ; uit != unique.end(); ) {
-            ret << (*uit).first;
-            if((*uit).second > 1)
-                ret << "x" << (*uit).second;
+            out.dec((*uit).first);
+            if((*uit).second > 1) {
+                out.put('x');
+                out.dec((*uit).second);
+            }
             if(++uit != unique.end())
-                ret << ".";
+                out.put('.');
         }
-        return ret.str();
+    }
+    std::string compact() const {
+        extract::outbuf ret(NULL,64);
+        compact(ret);
+        return std::string(ret.data(),ret.size());
+    }
+
+    /* the identity compact() prints, without printing it */
+    void hash(extract::hasher & h) const {
+        h.add((uint32_t)types_.size());
+        if(!types_.empty())
+            h.add(&types_[0],types_.size()*sizeof(int));
+    }
+
+    /* flat form, for storing counts; see graphlet::encode */
+    void encode(std::vector<int> & out) const {
+        out.push_back(types_.size());
+        out.insert(out.end(),types_.begin(),types_.end());
+    }
+    bool decode(int const*& p, int const* end) {
+        if(p >= end || *p < 0 || end - (p+1) < *p)
+            return false;
+        types_.assign(p+1,p+1+*p);
+        p += 1 + *p;
+        return true;
     }
 
  private:
@@ -163,14 +205,43 @@ class node {
         return ret.str();
     }
 
+    void compact(extract::outbuf & out, bool colors) const {
+        ins_.compact(out);
+        out.put('/');
+        outs_.compact(out);
+        out.put('/');
+        self_.compact(out);
+        if(colors) {
+            out.put('/');
+            out.udec(color_);
+        }
+    }
     std::string compact(bool colors) const {
-        std::stringstream ret;
-        ret << ins_.compact() << "/" ;
-        ret << outs_.compact() << "/";
-        ret << self_.compact();
+        extract::outbuf ret(NULL,64);
+        compact(ret,colors);
+        return std::string(ret.data(),ret.size());
+    }
+
+    void hash(extract::hasher & h, bool colors) const {
+        ins_.hash(h);
+        outs_.hash(h);
+        self_.hash(h);
         if(colors)
-            ret << "/" << color_;
-        return ret.str();
+            h.add((uint32_t)color_);
+    }
+
+    void encode(std::vector<int> & out) const {
+        out.push_back(color_);
+        ins_.encode(out);
+        outs_.encode(out);
+        self_.encode(out);
+    }
+    bool decode(int const*& p, int const* end) {
+        if(p >= end)
+            return false;
+        color_ = *(p++);
+        return ins_.decode(p,end) && outs_.decode(p,end) &&
+            self_.decode(p,end);
     }
 
  private:
@@ -232,20 +303,52 @@ class graphlet {
         return ret.str();
     }
 
-    std::string compact(bool color) const {
-        std::stringstream ret;
+    void compact(extract::outbuf & out, bool color) const {
         std::multiset<node>::const_iterator it = nodes_.begin();
-
         for( ; it != nodes_.end(); ) {
-            ret << (*it).compact(color);
+            (*it).compact(out,color);
             if(++it != nodes_.end())
-                ret << "_";
+                out.put('_');
         }
-        return ret.str();
+    }
+    std::string compact(bool color) const {
+        extract::outbuf ret(NULL,256);
+        compact(ret,color);
+        return std::string(ret.data(),ret.size());
     }
 
     unsigned size() const { return nodes_.size(); }
 
+    /* Hash of what compact(color) would print */
+    void hash(extract::hasher & h, bool color) const {
+        h.add((uint32_t)nodes_.size());
+        std::multiset<node>::const_iterator it = nodes_.begin();
+        for( ; it != nodes_.end(); ++it)
+            (*it).hash(h,color);
+    }
+
+    /* A flat form that decodes to an equal graphlet, unlike compact(),
+       which may drop the colors */
+    void encode(std::vector<int> & out) const {
+        out.push_back(nodes_.size());
+        std::multiset<node>::const_iterator it = nodes_.begin();
+        for( ; it != nodes_.end(); ++it)
+            (*it).encode(out);
+    }
+    bool decode(int const*& p, int const* end) {
+        nodes_.clear();
+        if(p >= end)
+            return false;
+        int n = *(p++);
+        for(int i=0;i<n;++i) {
+            node nd;
+            if(!nd.decode(p,end))
+                return false;
+            nodes_.insert(nd);
+        }
+        return true;
+    }
+
  private:
     std::multiset<node> nodes_;
 };
@@ -0,0 +1,74 @@
+#ifndef _HASH_H_
+#define _HASH_H_
+
+/*
+ * A fast 64-bit non-cryptographic hash, used to key the on-disk caches
+ * by content. It consumes eight bytes at a time and may be fed
+ * incrementally; feeding the same bytes in differently sized pieces
+ * gives different results, so callers feed fixed-size fields.
+ */
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+
+namespace extract {
+
+class hasher {
+ public:
+    hasher(uint64_t seed = 0) : h_(seed ^ P1), len_(0) { }
+
+    void add(void const* data, size_t n) {
+        unsigned char const* p = (unsigned char const*)data;
+        len_ += n;
+        for( ; n >= 8; n -= 8, p += 8) {
+            uint64_t w;
+            memcpy(&w,p,8);
+            word(w);
+        }
+        if(n) {
+            uint64_t w = 0;
+            memcpy(&w,p,n);
+            word(w ^ ((uint64_t)n << 56));
+        }
+    }
+
+    template<typename T>
+    void add(T const& v) { add(&v,sizeof(T)); }
+
+    uint64_t value() const {
+        uint64_t h = h_ ^ len_;
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+ private:
+    static const uint64_t P1 = 0x9e3779b185ebca87ULL;
+    static const uint64_t P2 = 0xc2b2ae3d27d4eb4fULL;
+
+    void word(uint64_t w) {
+        w *= P2;
+        w = (w << 31) | (w >> 33);
+        w *= P1;
+        h_ ^= w;
+        h_ = ((h_ << 27) | (h_ >> 37)) * P1 + 0x52dce729;
+    }
+
+    uint64_t h_;
+    uint64_t len_;
+};
+
+inline uint64_t
+hash_bytes(void const* data, size_t n, uint64_t seed = 0)
+{
+    hasher h(seed);
+    h.add(data,n);
+    return h.value();
+}
+
+}
+
+#endif
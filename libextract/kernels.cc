@@ -0,0 +1,771 @@
+/*
+ * Per-function feature kernels, formerly private to each of the
+ * extraction utilities.
+ */
+#include <stdio.h>
+#include <assert.h>
+
+#include <algorithm>
+#include <set>
+#include <vector>
+#include <limits>
+
+#include "InstructionDecoder.h"
+#include "Instruction.h"
+
+#include "kernels.h"
+#include "colors.h"
+
+using namespace std;
+using namespace Dyninst;
+using namespace Dyninst::InstructionAPI;
+using namespace graphlets;
+
+namespace extract {
+
+/* ParseAPI's NoSinkPredicate and Intraproc */
+static bool nosink(cfg::edge const& e)
+{
+    return !(e.flags & cfg::EDGE_SINK);
+}
+
+static bool nsi(cfg::edge const& e)
+{
+    return !(e.flags & (cfg::EDGE_SINK | cfg::EDGE_INTERPROC));
+}
+
+/** block ownership **/
+
+void
+claim_table::build(program const& p, vector<uint32_t> const& funcs)
+{
+    for(unsigned i=0;i<funcs.size();++i) {
+        for(uint32_t b : p.blocks(p.func(funcs[i])))
+            (void)claim(b,i);
+    }
+}
+
+bool
+claim_table::claim(uint32_t block, int func)
+{
+    dyn_hash_map<uint32_t,int>::const_iterator it = _owner.find(block);
+    if(it == _owner.end()) {
+        _owner[block] = func;
+        return true;
+    }
+    return it->second == func;
+}
+
+/** ngrams **/
+
+void
+extent_set::insert(cfg::extent const& e)
+{
+    addr_t start = e.start;
+    addr_t end = e.end;
+    if(start >= end)
+        return;
+
+    // absorb everything overlapping or abutting [start,end)
+    map<addr_t,addr_t>::iterator it = _ivals.upper_bound(start);
+    if(it != _ivals.begin()) {
+        map<addr_t,addr_t>::iterator prev = it;
+        --prev;
+        if(prev->second >= start) {
+            start = prev->first;
+            end = std::max(end,prev->second);
+            it = _ivals.erase(prev);
+        }
+    }
+    while(it != _ivals.end() && it->first <= end) {
+        end = std::max(end,it->second);
+        it = _ivals.erase(it);
+    }
+    _ivals[start] = end;
+}
+
+void
+extent_set::uncovered(cfg::extent const& e, ngram_runs & runs) const
+{
+    addr_t a = e.start;
+    if(a >= e.end)
+        return;
+
+    // the interval holding a, if any, then each one after it
+    map<addr_t,addr_t>::const_iterator it = _ivals.upper_bound(a);
+    if(it != _ivals.begin()) {
+        map<addr_t,addr_t>::const_iterator prev = it;
+        --prev;
+        if(a < prev->second)
+            a = prev->second;
+    }
+    for( ; a < e.end; ++it) {
+        if(it == _ivals.end() || it->first >= e.end) {
+            runs.push_back(make_pair(a,e.end));
+            break;
+        }
+        if(a < it->first)
+            runs.push_back(make_pair(a,it->first));
+        a = std::max(a,it->second);
+    }
+}
+
+static void print_ngram(unsigned char const* s, int n, bool prefix,
+    bool record, outbuf & out)
+{
+    if(record)
+        out.put(',');
+    if(prefix) {
+        out.dec(n);
+        out.put('_');
+    }
+    out.put('<');
+    out.hex2(s,n);
+    out.put(record ? ">" : ">,");
+}
+
+void mkngram_runs(cfg::extent const& fe, extent_set & visited,
+    ngram_runs & runs)
+{
+    visited.uncovered(fe,runs);
+    visited.insert(fe);
+}
+
+/*
+ * Calls f(e,avail) at the end e of each byte of runs, in order, with the
+ * avail bytes before e (at most n, the longest length) readable: each
+ * window of length m <= avail ending there starts at e-m. Windows that
+ * lie within a run are passed straight from the code; only those ending
+ * in the first n-1 bytes of a run, which begin in the bytes carried over
+ * from the runs before, are put together in a small buffer.
+ */
+template<typename F>
+static void each_ngram(program const& p, ngram_runs const& runs, int n, F & f)
+{
+    if(n <= 0)
+        return;
+
+    vector<unsigned char> tail;         // the last n-1 bytes seen
+    vector<unsigned char> head;
+    tail.reserve(2*n);
+    head.reserve(2*n);
+
+    for(unsigned i=0;i<runs.size();++i) {
+        addr_t a = runs[i].first;
+        while(a < runs[i].second) {
+            addr_t len;
+            unsigned char const* b = p.code(a,len);
+            if(!b)
+                break;
+            if(len > runs[i].second - a)
+                len = runs[i].second - a;
+
+            // windows ending in the first n-1 bytes
+            addr_t h = std::min(len,(addr_t)(n-1));
+            head.assign(tail.begin(),tail.end());
+            head.insert(head.end(),b,b+h);
+            for(size_t e = tail.size(); e < head.size(); ++e)
+                f(&head[0]+e+1,std::min(e+1,(size_t)n));
+
+            // and the rest
+            for(addr_t e = h; e < len; ++e)
+                f(b+e+1,(size_t)n);
+
+            // carry the last n-1 bytes
+            if(len >= (addr_t)(n-1))
+                tail.assign(b+len-(n-1),b+len);
+            else {
+                tail.insert(tail.end(),b,b+len);
+                if(tail.size() > (size_t)(n-1))
+                    tail.erase(tail.begin(),tail.end()-(n-1));
+            }
+
+            a += len;
+        }
+    }
+}
+
+/* the window each byte needs: the longest length or skip-gram span */
+static int window(vector<int> const& lens, vector<skipgram> const& skips)
+{
+    int n = lens.empty() ? 0 : lens.back();
+    for(unsigned i=0;i<skips.size();++i)
+        n = std::max(n,skips[i].span);
+    return n;
+}
+
+/* the bytes the skip-gram keeps of the window at s */
+static void gather(unsigned char const* s, skipgram const& sk,
+    unsigned char * kept)
+{
+    for(unsigned i=0;i<sk.keep.size();++i)
+        kept[i] = s[sk.keep[i]];
+}
+
+void format_skipgram(outbuf & out, unsigned char const* s,
+    skipgram const& sk)
+{
+    for(int i=0;i<sk.span;++i) {
+        if(sk.pattern[i] == 'x')
+            out.hex2(*s++);
+        else
+            out.put("..");
+    }
+}
+
+void mkngrams(program const& p, ngram_runs const& runs,
+    vector<int> const& lens, vector<skipgram> const& skips,
+    bool record, outbuf & out)
+{
+    bool prefix = lens.size() > 1;
+    vector<unsigned char> kept(window(lens,skips));
+    auto print = [&](unsigned char const* e, size_t avail) {
+        for(unsigned i=0;i<lens.size() && (size_t)lens[i] <= avail;++i)
+            print_ngram(e-lens[i],lens[i],prefix,record,out);
+        for(unsigned i=0;i<skips.size();++i) {
+            if((size_t)skips[i].span > avail)
+                continue;
+            gather(e-skips[i].span,skips[i],&kept[0]);
+            out.put(record ? ",<" : "<");
+            format_skipgram(out,&kept[0],skips[i]);
+            out.put(record ? ">" : ">,");
+        }
+    };
+    each_ngram(p,runs,window(lens,skips),print);
+}
+
+/* Successive windows of a length overlap, so each key is rolled on from
+   the last. The bytes of a skip-gram are not contiguous, and are keyed
+   afresh each time. T is an ngram_table or a topk. */
+template<typename T>
+static void count_windows(program const& p, ngram_runs const& runs,
+    vector<T> & counts, vector<skipgram> const& skips,
+    vector<T> & skipcounts)
+{
+    vector<int> first(counts.size(),-1);    // first byte of the last window
+    vector<uint64_t> key(counts.size(),0);
+    vector<int> lens(counts.size());
+    for(unsigned i=0;i<counts.size();++i)
+        lens[i] = counts[i].length();
+    vector<unsigned char> kept(window(lens,skips));
+
+    auto count = [&](unsigned char const* e, size_t avail) {
+        for(unsigned i=0;i<counts.size();++i) {
+            T & t = counts[i];
+            int n = t.length();
+            if((size_t)n > avail)
+                break;
+            unsigned char const* s = e-n;
+            key[i] = first[i] < 0 ? t.key(s) : t.roll(key[i],first[i],s[n-1]);
+            first[i] = s[0];
+            t.add(key[i],s);
+        }
+        for(unsigned i=0;i<skips.size();++i) {
+            if((size_t)skips[i].span > avail)
+                continue;
+            gather(e-skips[i].span,skips[i],&kept[0]);
+            skipcounts[i].add(skipcounts[i].key(&kept[0]),&kept[0]);
+        }
+    };
+    each_ngram(p,runs,window(lens,skips),count);
+}
+
+void countngrams(program const& p, ngram_runs const& runs,
+    vector<ngram_table> & counts, vector<skipgram> const& skips,
+    vector<ngram_table> & skipcounts)
+{
+    count_windows(p,runs,counts,skips,skipcounts);
+}
+
+void topngrams(program const& p, ngram_runs const& runs,
+    vector<topk> & sketches)
+{
+    vector<skipgram> none;
+    vector<topk> nocounts;
+    count_windows(p,runs,sketches,none,nocounts);
+}
+
+/** opcode n-grams **/
+
+static thread_local unsigned long color_decodes = 0;
+
+enum { NO_OPERAND, REG_OPERAND, IMM_OPERAND, MEM_OPERAND };
+
+int opgram_width(bool operands)
+{
+    return operands ? 3 : 2;
+}
+
+/* as IdiomTerm classifies its arguments */
+static int operand_class(Operand const& op)
+{
+    if(op.readsMemory() || op.writesMemory())
+        return MEM_OPERAND;
+    set<RegisterAST::Ptr> regs;
+    op.getReadSet(regs);
+    op.getWriteSet(regs);
+    return regs.empty() ? IMM_OPERAND : REG_OPERAND;
+}
+
+static void count_opgrams(vector<unsigned char> const& toks, int width,
+    vector<ngram_table> & counts)
+{
+    for(unsigned i=0;i<counts.size();++i) {
+        ngram_table & t = counts[i];
+        size_t len = t.length();
+        for(size_t s = 0; s + len <= toks.size(); s += width)
+            t.add(t.key(&toks[s]),&toks[s]);
+    }
+}
+
+void mkopgrams(program const& p, uint32_t f, int fidx,
+    claim_table & claims, bool operands, vector<ngram_table> & counts)
+{
+    int width = opgram_width(operands);
+
+    vector< pair<addr_t,uint32_t> > blocks;
+    for(uint32_t b : p.blocks(p.func(f))) {
+        if(claims.claim(b,fidx))
+            blocks.push_back(make_pair(p.blk(b).start,b));
+    }
+    sort(blocks.begin(),blocks.end());
+
+    vector<unsigned char> toks;
+    vector<Operand> ops;
+    addr_t end = 0;
+    for(unsigned i=0;i<blocks.size();++i) {
+        cfg::block const& b = p.blk(blocks[i].second);
+        if(b.start != end) {
+            count_opgrams(toks,width,counts);
+            toks.clear();
+        }
+        end = b.end;
+
+        unsigned char const* code = p.code(b.start);
+        if(!code)
+            continue;
+        InstructionDecoder dec(code,b.end - b.start,(Architecture)p.arch());
+        while(Instruction::Ptr insn = dec.decode()) {
+            ++color_decodes;
+            unsigned short id = insn->getOperation().getID() + 1;
+            toks.push_back(id >> 8);
+            toks.push_back(id & 0xff);
+            if(operands) {
+                int c[2] = { NO_OPERAND, NO_OPERAND };
+                ops.clear();
+                insn->getOperands(ops);
+                for(unsigned j=0;j<2 && j<ops.size();++j)
+                    c[j] = operand_class(ops[j]);
+                toks.push_back(c[0] << 4 | c[1]);
+            }
+        }
+    }
+    count_opgrams(toks,width,counts);
+}
+
+void format_opgram(outbuf & out, unsigned char const* s, int n,
+    bool operands)
+{
+    static char const classes[] = { 0, 'r', 'i', 'm' };
+    int width = opgram_width(operands);
+    for(int i=0;i<n;++i, s += width) {
+        if(i)
+            out.put('_');
+        out.hex(s[0] << 8 | s[1]);
+        if(operands) {
+            if(classes[s[2] >> 4])
+                out.put(classes[s[2] >> 4]);
+            if(classes[s[2] & 0xf])
+                out.put(classes[s[2] & 0xf]);
+        }
+    }
+}
+
+/** graphlets **/
+
+unsigned long color_insns()
+{
+    return color_decodes;
+}
+
+unsigned short node_color(program const& p, uint32_t A)
+{
+    unsigned short ret = 0;
+
+    cfg::block const& b = p.blk(A);
+    const unsigned char* bufferBegin = p.code(b.start);
+    if(!bufferBegin)
+        return 0;
+
+    InstructionDecoder dec(bufferBegin, b.end - b.start,
+        (Architecture)p.arch());
+    while(Instruction::Ptr insn = dec.decode()) {
+        ++color_decodes;
+        InsnColor::insn_color c = InsnColor::lookup(insn);
+        if(c != InsnColor::NOCOLOR) {
+            assert(c <= 16);
+            ret |= (1 << c);
+        }
+    }
+    return ret;
+}
+
+// build edge type sets for A given B and C
+node edge_sets(program const& p, uint32_t A, uint32_t B, uint32_t C,
+    bool color)
+{
+    multiset<int> ins;
+    multiset<int> outs;
+    multiset<int> selfs;
+    unsigned short c = 0;
+
+    cfg::block const& a = p.blk(A);
+
+    for(uint32_t e : p.sources(a)) {
+        cfg::edge const& E = p.edg(e);
+        if(E.src == B || E.src == C)
+            ins.insert(E.type);
+        else if(E.src == A)
+            selfs.insert(E.type);
+    }
+    for(uint32_t e : p.targets(a)) {
+        cfg::edge const& E = p.edg(e);
+        if(E.trg == B || E.trg == C)
+            outs.insert(E.type);
+        // don't duplicate self edges
+    }
+
+    if(color)
+        c = node_color(p,A);
+
+    return node(ins,outs,selfs,c);
+}
+
+void mkgraphlets(program const& p, uint32_t f, int fidx,
+    std::map<graphlet,int> & counts,
+    claim_table & claims,
+    bool color)
+{
+    // Foreach block in the function
+    //   for each pair of its neighboring *blocks*
+    //     make a graphlet describing this triple & record it
+    for(uint32_t b : p.blocks(p.func(f))) {
+        if(!claims.claim(b,fidx))
+            continue;
+
+        cfg::block const& bb = p.blk(b);
+
+        // Step one: reduce the edge set to a block set
+        std::set<uint32_t> srcblks;
+        std::set<uint32_t> trgblks;
+
+        for(uint32_t e : p.sources(bb)) {
+            cfg::edge const& E = p.edg(e);
+            if(nosink(E) && E.src != b)
+                srcblks.insert(E.src);
+        }
+        for(uint32_t e : p.targets(bb)) {
+            cfg::edge const& E = p.edg(e);
+            if(nosink(E) && E.trg != b)
+                trgblks.insert(E.trg);
+        }
+
+        // Step two: build graphlets from various pairs:
+        std::set<uint32_t>::iterator A;
+        std::set<uint32_t>::iterator B;
+
+        // 1. source & source
+        for(A=srcblks.begin();A!=srcblks.end();++A) {
+            B=A;++B;
+            for( ; B != srcblks.end(); ++B) {
+                graphlet g;
+                g.addNode( edge_sets(p,*A,*B,b,color) );
+                g.addNode( edge_sets(p,*B,*A,b,color) );
+                g.addNode( edge_sets(p,b,*A,*B,color) );
+                counts[g] += 1;
+            }
+        }
+
+        // 2. trg & trg
+        for(A=trgblks.begin();A!=trgblks.end();++A) {
+            B=A;++B;
+            for( ; B!=trgblks.end();++B) {
+                graphlet g;
+                g.addNode( edge_sets(p,*A,*B,b,color) );
+                g.addNode( edge_sets(p,*B,*A,b,color) );
+                g.addNode( edge_sets(p,b,*A,*B,color) );
+                counts[g] += 1;
+            }
+        }
+
+        // 3. source & trg
+        for(A=srcblks.begin();A!=srcblks.end();++A) {
+            for(B=trgblks.begin();B!=trgblks.end();++B) {
+                if(*A == *B)
+                    continue;
+                graphlet g;
+                g.addNode( edge_sets(p,*A,*B,b,color) );
+                g.addNode( edge_sets(p,*B,*A,b,color) );
+                g.addNode( edge_sets(p,b,*A,*B,color) );
+                counts[g] += 1;
+            }
+        }
+    }
+}
+
+/** supergraphlets **/
+
+// Using `claims' here to avoid duplicating the subgraphs
+// corresponding to the shared areas of functions.
+//
+// This may or may not be sensible
+graph *
+func_to_graph(program const& p, uint32_t f, int fidx, claim_table & claims,
+    bool color)
+{
+    dyn_hash_map<uint32_t,snode*> node_map;
+
+    int nctr = 0;
+
+    graph * g = new graph();
+    cfg::span<uint32_t> blocks = p.blocks(p.func(f));
+
+    dyn_hash_map<uint32_t,bool> done_edges;
+    for(uint32_t b : blocks) {
+            snode * n = g->addNode();
+
+            char nm[16];
+            snprintf(nm,16,"n%d",nctr++);
+            n->name_ = std::string(nm);
+
+            node_map[b] = n;
+            if(color)
+                n->setColor(new InsnColor(node_color(p,b)));
+    }
+
+    unsigned idx = 0;
+
+    for(uint32_t b : blocks) {
+        if(!claims.claim(b,fidx))
+            continue;
+
+        cfg::block const& bb = p.blk(b);
+
+        snode * n = g->nodes()[idx];
+        for(uint32_t e : p.sources(bb)) {
+            cfg::edge const& E = p.edg(e);
+            if(!nsi(E))
+                continue;
+
+            if(done_edges.find(e) != done_edges.end())
+                continue;
+            done_edges[e] = true;
+
+            if(node_map.find(E.src) != node_map.end()) {
+                (void)g->link(node_map[E.src],n,E.type);
+            }
+        }
+        for(uint32_t e : p.targets(bb)) {
+            cfg::edge const& E = p.edg(e);
+            if(!nsi(E))
+                continue;
+
+            if(done_edges.find(e) != done_edges.end())
+                continue;
+            done_edges[e] = true;
+
+            if(node_map.find(E.trg) != node_map.end()) {
+                (void)g->link(n,node_map[E.trg],E.type);
+            }
+        }
+        ++idx;
+    }
+    return g;
+}
+
+/** calldfa **/
+
+static void targets(program const& p, uint32_t b, set<uint32_t> &t)
+{
+    for(uint32_t e : p.targets(p.blk(b))) {
+        cfg::edge const& E = p.edg(e);
+        if(nsi(E))
+            t.insert(E.trg);
+    }
+}
+
+static const int NULLDEF = numeric_limits<int>::max();
+/*
+ * Calls kill other call defs
+ */
+static void reaching_defs(
+    program const& p,
+    cfg::function const& f,
+    vector<uint32_t> & blocks,
+    vector< set<int> > & defs,
+    dyn_hash_map<uint32_t,int> & bmap)
+{
+    vector<int> work;
+    vector<int> call_gen;
+    uint32_t b = f.entry;
+    int bidx = bmap[b];
+
+    // figure out the call generators
+    call_gen.resize(blocks.size(),-1);
+    for(uint32_t c : p.calls(f)) {
+        int cidx = bmap[p.edg(c).src];
+        call_gen[ cidx ] = cidx;
+    }
+
+    // entry block generates the "no call" definition
+    defs[bidx].insert(NULLDEF);
+    work.push_back(bidx);
+
+    while(!work.empty()) {
+        bidx = work.back();
+        work.pop_back();
+        b = blocks[bidx];
+
+        if(call_gen[bidx] != -1)
+            defs[bidx].insert(call_gen[bidx]);
+
+        set<uint32_t> targs;
+        targets(p,b,targs);
+        set<uint32_t>::iterator sit = targs.begin();
+        for( ; sit != targs.end(); ++sit) {
+            uint32_t t = *sit;
+            int tidx = bmap[t];
+
+            // if b makes a call, it kills all calls except that one
+            // else it passes its defs
+
+            set<int> newdefs = defs[tidx];
+            if(call_gen[bidx] != -1)
+                newdefs.insert(call_gen[bidx]);
+            else
+                newdefs.insert(defs[bidx].begin(),defs[bidx].end());
+
+            if(newdefs != defs[tidx]) {
+                defs[tidx] = newdefs;
+                work.push_back(tidx);
+            }
+        }
+    }
+}
+
+/*
+ * Construct a graph of entry, exit and call nodes, where edges indicate
+ * reaching definitions
+ */
+static graph * collapse(
+    program const& p,
+    cfg::function const& f,
+    vector<uint32_t> & blocks,
+    vector< set<int> > & defs,
+    dyn_hash_map<uint32_t,int> & bmap,
+    dyn_hash_map<std::string,unsigned short> & libmap)
+{
+    vector<snode*> callnodes(blocks.size(),NULL);
+    graph * g = new graph();
+    snode * entry = g->addNode();
+
+    // 1. Set up nodes for the call blocks
+    for(uint32_t c : p.calls(f)) {
+        cfg::edge const& E = p.edg(c);
+        int cidx = bmap[E.src];
+        callnodes[ cidx ] = g->addNode();
+
+        // color
+        char const* plt = E.trg == cfg::NONE ? NULL :
+            p.linkage_name(p.blk(E.trg).start);
+        if(plt) {
+            std::string name(plt);
+            LibCallColor * c = new LibCallColor(libmap,name);
+            callnodes[cidx]->setColor(c);
+        } else {
+            LocalCallColor * c = new LocalCallColor();
+            callnodes[cidx]->setColor(c);
+        }
+    }
+
+    // 2. Link the call nodes to one another
+    for(unsigned i=0;i<callnodes.size();++i) {
+        if(callnodes[i]) {
+            set<int> & d = defs[i];
+            set<int>::iterator it = d.begin();
+            for( ; it != d.end(); ++it) {
+                if(*it == NULLDEF)
+                    g->link(entry,callnodes[i],0);
+                else if(*it != (int)i)
+                    g->link(callnodes[*it],callnodes[i],0);
+            }
+        }
+    }
+
+    // 3. Find exit nodes && link according to reaching defs
+    for(unsigned i=0;i<blocks.size();++i) {
+        int tcnt = 0;
+        for(uint32_t e : p.targets(p.blk(blocks[i]))) {
+            if(nsi(p.edg(e)))
+                ++tcnt;
+        }
+        if(tcnt == 0) {
+            snode * exit = g->addNode();
+            set<int> & d = defs[i];
+            set<int>::iterator it = d.begin();
+            for( ; it != d.end(); ++it) {
+                if(*it == NULLDEF)
+                    g->link(entry,exit,0);
+                else
+                    g->link(callnodes[*it],exit,0);
+            }
+        }
+    }
+    return g;
+}
+
+graph * mkcalldfa(program const& p, uint32_t f,
+    dyn_hash_map<std::string,unsigned short> & libmap)
+{
+    vector<uint32_t> blocks;
+    vector< set<int> > defs;
+    dyn_hash_map<uint32_t,int> bmap;
+
+    cfg::function const& fn = p.func(f);
+    for(uint32_t b : p.blocks(fn)) {
+        bmap[b] = blocks.size();
+        blocks.push_back(b);
+    }
+    defs.resize( blocks.size() );
+
+    // 1. Reaching definitions on call blocks
+    reaching_defs(p,fn,blocks,defs,bmap);
+
+    // 2. Node collapse
+    return collapse(p,fn,blocks,defs,bmap,libmap);
+}
+
+/** libcalls **/
+
+void mklibcalls(program const& p, uint32_t f,
+    std::map<std::string,int> & pltcnts,
+    std::unordered_map<std::string,bool> & real_funcs)
+{
+    cfg::function const& fn = p.func(f);
+
+    for(uint32_t c : p.calls(fn)) {
+        cfg::edge const& E = p.edg(c);
+        if(E.trg == cfg::NONE)
+            continue;
+        char const* plt = p.linkage_name(p.blk(E.trg).start);
+        if(plt) {
+            pltcnts[plt] += 1;
+        }
+    }
+
+    if(!p.linkage_name(fn.addr)) {
+        real_funcs[p.name(fn)] = true;
+    }
+}
+
+}
@@ -0,0 +1,143 @@
+#ifndef _KERNELS_H_
+#define _KERNELS_H_
+
+/*
+ * Per-function feature kernels shared by the extraction utilities.
+ *
+ * Each kernel examines a single function of an already-parsed binary
+ * and accumulates into state owned by the caller; nothing here
+ * parses binaries or prints counts.
+ */
+#include <stdio.h>
+
+#include <map>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "dyntypes.h"
+
+#include "cfg.h"
+#include "graphlet.h"
+#include "ngtable.h"
+#include "outbuf.h"
+#include "supergraph.h"
+#include "topk.h"
+
+namespace extract {
+
+using cfg::addr_t;
+using cfg::program;
+
+/*
+ * Blocks shared among several functions are examined only by the
+ * first function (in the order walked) that contains them. claim()
+ * records that ownership as functions are walked in order; for a
+ * parallel walk the table is filled ahead of time with build(), after
+ * which claim() only reads it and may be called from any thread.
+ */
+class claim_table {
+ public:
+    void build(program const& p, std::vector<uint32_t> const& funcs);
+    bool claim(uint32_t block, int func);
+    void clear() { _owner.clear(); }
+ private:
+    dyn_hash_map<uint32_t,int> _owner;
+};
+
+typedef std::vector< std::pair<addr_t,addr_t> > ngram_runs;
+
+/* A gapped n-gram: the bytes at offsets keep of each window of span
+   bytes, written as a pattern of 'x' for a byte kept and '.' for one
+   skipped, as in "x.x" or "xx..x" */
+struct skipgram {
+    std::string pattern;
+    int span;
+    std::vector<int> keep;
+};
+
+/* The addresses covered by the extents seen so far */
+class extent_set {
+ public:
+    /* append the portions of e not covered to runs, in order */
+    void uncovered(cfg::extent const& e, ngram_runs & runs) const;
+    void insert(cfg::extent const& e);
+    void clear() { _ivals.clear(); }
+ private:
+    // disjoint [start,end), keyed by start
+    std::map<addr_t,addr_t> _ivals;
+};
+
+/* n-grams: the portions [start,end) of an extent not already covered
+   by an extent in `visited'. The window is not reset between runs of
+   the same extent. */
+void mkngram_runs(cfg::extent const& fe, extent_set & visited,
+    ngram_runs & runs);
+
+/* prints every window of the bytes in runs of each length in lens, which
+   are ascending, each followed by a comma (or, for records, preceded by
+   one). The windows ending at each byte are printed together, shortest
+   first, and then those of each of skips; with more than one length,
+   each n-gram is prefixed by "<length>_". */
+void mkngrams(program const& p, ngram_runs const& runs,
+    std::vector<int> const& lens, std::vector<skipgram> const& skips,
+    bool record, outbuf & out);
+/* counts the windows instead, of the lengths of counts (ascending) and
+   of skips into skipcounts, whose lengths are the bytes kept */
+void countngrams(program const& p, ngram_runs const& runs,
+    std::vector<ngram_table> & counts,
+    std::vector<skipgram> const& skips,
+    std::vector<ngram_table> & skipcounts);
+/* or feeds them to a sketch of the most frequent, per length */
+void topngrams(program const& p, ngram_runs const& runs,
+    std::vector<topk> & sketches);
+/* a skip-gram of the kept bytes at s, in hex with ".." for each byte
+   skipped */
+void format_skipgram(outbuf & out, unsigned char const* s,
+    skipgram const& sk);
+
+/*
+ * opcode n-grams: each instruction of the function's blocks is a token
+ * of its entry ID, as IdiomTerm has it, and with operands the classes
+ * (register, immediate, memory) of its first two operands. Every block
+ * is decoded once, by the function that claims it; windows run across
+ * blocks laid out back to back and restart wherever there is a gap.
+ * counts are by length in bytes, opgram_width() per instruction.
+ */
+int opgram_width(bool operands);
+void mkopgrams(program const& p, uint32_t f, int fidx,
+    claim_table & claims, bool operands, std::vector<ngram_table> & counts);
+/* an opcode n-gram of n tokens, as entry IDs in hex joined by '_', each
+   followed with operands by a letter per operand (r, i or m) */
+void format_opgram(outbuf & out, unsigned char const* s, int n,
+    bool operands);
+
+/* graphlets over the basic blocks of the function */
+unsigned short node_color(program const& p, uint32_t A);
+/* instructions node_color() and mkopgrams() have decoded in the calling
+   thread */
+unsigned long color_insns();
+graphlets::node edge_sets(program const& p, uint32_t A, uint32_t B,
+    uint32_t C, bool color);
+void mkgraphlets(program const& p, uint32_t f, int fidx,
+    std::map<graphlets::graphlet,int> & counts,
+    claim_table & claims,
+    bool color);
+
+/* supergraphlets: the intraprocedural graph of the function */
+graphlets::graph * func_to_graph(program const& p, uint32_t f, int fidx,
+    claim_table & claims,
+    bool color);
+
+/* call-DFA of the function */
+graphlets::graph * mkcalldfa(program const& p, uint32_t f,
+    dyn_hash_map<std::string,unsigned short> & libmap);
+
+/* library calls made by the function */
+void mklibcalls(program const& p, uint32_t f,
+    std::map<std::string,int> & pltcnts,
+    std::unordered_map<std::string,bool> & real_funcs);
+
+}
+
+#endif
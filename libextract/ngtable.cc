@@ -0,0 +1,168 @@
+#include <string.h>
+
+#include <algorithm>
+
+#include "ngtable.h"
+
+using namespace std;
+
+namespace extract {
+
+static const int INITIAL_BITS = 10;
+
+ngram_key::ngram_key(int n) :
+    _n(n),
+    _mask(n >= MAX_PACKED ? ~0ULL : (1ULL << (8*n)) - 1),
+    _top(1)
+{
+    for(int i=1;i<n;++i)
+        _top *= BASE;
+}
+
+uint64_t
+ngram_key::key(unsigned char const* s) const
+{
+    uint64_t k = 0;
+    if(packed()) {
+        for(int i=0;i<_n;++i)
+            k = (k << 8) | s[i];
+        return k;
+    }
+    for(int i=0;i<_n;++i)
+        k = k * BASE + s[i];
+    return k;
+}
+
+ngram_table::ngram_table(int n) :
+    ngram_key(n),
+    _shift(64),
+    _used(0),
+    _total(0)
+{
+    reset(n);
+}
+
+void
+ngram_table::reset(int n)
+{
+    static_cast<ngram_key &>(*this) = ngram_key(n);
+
+    // allocated on first use
+    _slots.clear();
+    _shift = 64 - INITIAL_BITS;
+    _used = 0;
+    _total = 0;
+    _bytes.clear();
+}
+
+bool
+ngram_table::same(entry const& e, uint64_t key, unsigned char const* s) const
+{
+    return e.key == key && (packed() || memcmp(bytes(e),s,_n) == 0);
+}
+
+void
+ngram_table::add(uint64_t key, unsigned char const* s, uint32_t count)
+{
+    if(_slots.empty())
+        _slots.assign(1 << INITIAL_BITS,entry());
+
+    size_t mask = _slots.size() - 1;
+    size_t i = slot(key);
+    for( ; _slots[i].count; i = (i+1) & mask) {
+        if(same(_slots[i],key,s)) {
+            _slots[i].count += count;
+            _total += count;
+            return;
+        }
+    }
+
+    entry & e = _slots[i];
+    e.key = key;
+    e.count = count;
+    e.bytes = 0;
+    if(!packed()) {
+        e.bytes = _bytes.size();
+        _bytes.insert(_bytes.end(),s,s+_n);
+    }
+    _total += count;
+    if(++_used * 2 > _slots.size())
+        grow();
+}
+
+void
+ngram_table::grow()
+{
+    vector<entry> old;
+    old.swap(_slots);
+    _slots.assign(old.size() * 2,entry());
+    --_shift;
+
+    size_t mask = _slots.size() - 1;
+    for(size_t j=0;j<old.size();++j) {
+        if(!old[j].count)
+            continue;
+        size_t i = slot(old[j].key);
+        while(_slots[i].count)
+            i = (i+1) & mask;
+        _slots[i] = old[j];
+    }
+}
+
+void
+ngram_table::merge(ngram_table const& o)
+{
+    for(size_t j=0;j<o._slots.size();++j) {
+        entry const& e = o._slots[j];
+        if(e.count)
+            add(e.key,o.packed() ? NULL : o.bytes(e),e.count);
+    }
+}
+
+void
+ngram_table::sorted(vector<entry const*> & out) const
+{
+    out.clear();
+    out.reserve(_used);
+    for(size_t j=0;j<_slots.size();++j) {
+        if(_slots[j].count)
+            out.push_back(&_slots[j]);
+    }
+
+    if(packed()) {
+        sort(out.begin(),out.end(),
+            [](entry const* a, entry const* b) { return a->key < b->key; });
+    } else {
+        int n = _n;
+        unsigned char const* base = _bytes.data();
+        sort(out.begin(),out.end(),
+            [n,base](entry const* a, entry const* b) {
+                return memcmp(base + a->bytes,base + b->bytes,n) < 0;
+            });
+    }
+}
+
+void
+ngram_table::format(outbuf & out, entry const& e) const
+{
+    if(!packed()) {
+        out.hex2(bytes(e),_n);
+        return;
+    }
+    unsigned char s[MAX_PACKED];
+    get(e,s);
+    out.hex2(s,_n);
+}
+
+void
+ngram_table::get(entry const& e, unsigned char * s) const
+{
+    if(!packed()) {
+        memcpy(s,bytes(e),_n);
+        return;
+    }
+    for(int i=0;i<_n;++i)
+        s[i] = (e.key >> (8*(_n-1-i))) & 0xff;
+}
+
+}
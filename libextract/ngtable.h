@@ -0,0 +1,101 @@
+#ifndef _NGTABLE_H_
+#define _NGTABLE_H_
+
+/*
+ * Counts of byte n-grams, for ngrams --counts.
+ *
+ * An n-gram of up to eight bytes is its own key, packed big-endian into
+ * a uint64_t, so that keys sort as the n-grams do. A longer n-gram is
+ * keyed by a polynomial hash of its bytes, which can be rolled along a
+ * window one byte at a time; its bytes are kept as well, both to print
+ * it and to tell apart n-grams whose hashes collide.
+ *
+ * Keys are counted in an open-addressing table with linear probing,
+ * grown to keep it at most half full.
+ */
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+#include "outbuf.h"
+
+namespace extract {
+
+/* Keys of the n-grams of one length */
+class ngram_key {
+ public:
+    static const int MAX_PACKED = 8;
+
+    explicit ngram_key(int n = 0);
+
+    int length() const { return _n; }
+    bool packed() const { return _n <= MAX_PACKED; }
+
+    /* the key of the n bytes at s */
+    uint64_t key(unsigned char const* s) const;
+    /* the key of the window one byte on from that of key, which began
+       with out and is followed by in */
+    uint64_t roll(uint64_t key, unsigned char out, unsigned char in) const {
+        if(packed())
+            return ((key << 8) | in) & _mask;
+        return (key - out * _top) * BASE + in;
+    }
+
+ protected:
+    static const uint64_t BASE = 0x100000001b3ULL;
+
+    int _n;
+    uint64_t _mask;                 // packed keys
+    uint64_t _top;                  // BASE^(n-1), for rolling hashes
+};
+
+class ngram_table : public ngram_key {
+ public:
+    struct entry {
+        uint64_t key;
+        uint32_t count;             // 0 if the slot is empty
+        uint32_t bytes;             // offset of the n-gram, if not packed
+    };
+
+    explicit ngram_table(int n = 0);
+
+    /* empty the table and count n-grams of length n from here on */
+    void reset(int n);
+    void clear() { reset(_n); }
+
+    size_t size() const { return _used; }
+    uint64_t total() const { return _total; }
+
+    /* count the n-gram at s, whose key is key */
+    void add(uint64_t key, unsigned char const* s, uint32_t count = 1);
+    void merge(ngram_table const& o);
+
+    /* the occupied entries, in the byte order of their n-grams */
+    void sorted(std::vector<entry const*> & out) const;
+
+    /* the n-gram of e, in hex */
+    void format(outbuf & out, entry const& e) const;
+    /* the n bytes of the n-gram of e, into s */
+    void get(entry const& e, unsigned char * s) const;
+
+ private:
+    unsigned char const* bytes(entry const& e) const {
+        return &_bytes[e.bytes];
+    }
+    size_t slot(uint64_t key) const {
+        return (key * 0x9e3779b97f4a7c15ULL) >> _shift;
+    }
+    bool same(entry const& e, uint64_t key, unsigned char const* s) const;
+    void grow();
+
+    std::vector<entry> _slots;
+    int _shift;                     // 64 - log2 of the number of slots
+    size_t _used;
+    uint64_t _total;
+    std::vector<unsigned char> _bytes;
+};
+
+}
+
+#endif
@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "outbuf.h"
+
+namespace extract {
+
+char const outbuf::digits[] = "0123456789abcdef";
+
+outbuf::outbuf(FILE * out, size_t size) :
+    _out(out),
+    _buf((char *)malloc(size)),
+    _cap(size),
+    _len(0)
+{
+    if(!_buf) {
+        perror("malloc");
+        exit(1);
+    }
+}
+
+outbuf::~outbuf()
+{
+    flush();
+    free(_buf);
+}
+
+void
+outbuf::target(FILE * out)
+{
+    flush();
+    _out = out;
+}
+
+void
+outbuf::flush()
+{
+    if(!_out || _len == 0)
+        return;
+    emit(_buf,_len);
+    _len = 0;
+}
+
+void
+outbuf::room(size_t n)
+{
+    if(_out) {
+        flush();
+        return;
+    }
+
+    size_t cap = _cap;
+    while(cap - _len < n)
+        cap *= 2;
+    char * buf = (char *)realloc(_buf,cap);
+    if(!buf) {
+        perror("realloc");
+        exit(1);
+    }
+    _buf = buf;
+    _cap = cap;
+}
+
+void
+outbuf::emit(char const* s, size_t n)
+{
+    int fd = fileno(_out);
+    if(fd < 0) {
+        fwrite(s,1,n,_out);
+        return;
+    }
+
+    // anything printed to the stream directly goes first
+    fflush(_out);
+    while(n > 0) {
+        ssize_t w = write(fd,s,n);
+        if(w < 0) {
+            if(errno == EINTR)
+                continue;
+            perror("write");
+            return;
+        }
+        s += w;
+        n -= w;
+    }
+}
+
+}
@@ -0,0 +1,129 @@
+#ifndef _OUTBUF_H_
+#define _OUTBUF_H_
+
+/*
+ * Buffered output for the feature printers.
+ *
+ * Output is gathered in one large buffer and handed to the kernel with
+ * write(2) when it fills, or to the stream with fwrite() if it has no
+ * descriptor (an open_memstream()). Numbers are converted by hand, runs
+ * of bytes in hex with hex_bytes() (see libfeat/hex.h), and nothing is
+ * allocated once the buffer exists.
+ *
+ * Without a stream, the buffer instead grows to hold everything put to
+ * it, to be collected with data() and size().
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+
+#include "hex.h"
+
+namespace extract {
+
+class outbuf {
+ public:
+    static const size_t DEFAULT_SIZE = 1 << 20;
+
+    explicit outbuf(FILE * out = NULL, size_t size = DEFAULT_SIZE);
+    ~outbuf();
+
+    /* Flush to the current stream and write to out from here on */
+    void target(FILE * out);
+    void flush();
+
+    char const* data() const { return _buf; }
+    size_t size() const { return _len; }
+    void clear() { _len = 0; }
+
+    void put(char c) {
+        if(_len == _cap)
+            room(1);
+        _buf[_len++] = c;
+    }
+    void put(char const* s, size_t n) {
+        if(_cap - _len < n)
+            room(n);
+        if(_cap - _len < n) {
+            // bigger than the whole buffer
+            emit(s,n);
+            return;
+        }
+        memcpy(_buf + _len,s,n);
+        _len += n;
+    }
+    void put(char const* s) { put(s,strlen(s)); }
+    void put(std::string const& s) { put(s.data(),s.size()); }
+
+    /* as %d, %u and %lx */
+    void dec(long v) {
+        if(v < 0) {
+            put('-');
+            udec(0UL - (unsigned long)v);
+        } else
+            udec(v);
+    }
+    void udec(unsigned long v) {
+        char tmp[20];
+        char * p = tmp + sizeof(tmp);
+        do {
+            *--p = '0' + v % 10;
+            v /= 10;
+        } while(v);
+        put(p,tmp + sizeof(tmp) - p);
+    }
+    void hex(unsigned long v) {
+        char tmp[16];
+        char * p = tmp + sizeof(tmp);
+        do {
+            *--p = digits[v & 0xf];
+            v >>= 4;
+        } while(v);
+        put(p,tmp + sizeof(tmp) - p);
+    }
+    /* as %02x */
+    void hex2(unsigned char b) {
+        if(_cap - _len < 2)
+            room(2);
+        _buf[_len++] = digits[b >> 4];
+        _buf[_len++] = digits[b & 0xf];
+    }
+    /* as %02x, for each of n bytes */
+    void hex2(unsigned char const* s, size_t n) {
+        if(_cap - _len < 2*n)
+            room(2*n);
+        // a stream's buffer may still be too small
+        while(_cap - _len < 2*n) {
+            size_t k = (_cap - _len) / 2;
+            hex_bytes(_buf + _len,s,k);
+            _len += 2*k;
+            s += k;
+            n -= k;
+            flush();
+        }
+        hex_bytes(_buf + _len,s,n);
+        _len += 2*n;
+    }
+
+ private:
+    outbuf(outbuf const&);
+    outbuf & operator=(outbuf const&);
+
+    /* make room for n more bytes, draining or growing the buffer */
+    void room(size_t n);
+    /* send bytes straight to the stream */
+    void emit(char const* s, size_t n);
+
+    static char const digits[];
+
+    FILE * _out;
+    char * _buf;
+    size_t _cap;
+    size_t _len;
+};
+
+}
+
+#endif
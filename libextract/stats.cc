@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "stats.h"
+
+namespace extract {
+
+static char const* phase_names[stats::NPHASES] = {
+    "parse",
+    "cfg_cache",
+    "feature_cache",
+    "ngrams",
+    "idioms",
+    "graphlets",
+    "supergraphlets",
+    "merge",
+    "calldfa",
+    "libcalls",
+    "output"
+};
+
+static char const* family_names[stats::NFAMILIES] = {
+    "ngrams",
+    "idioms",
+    "graphlets",
+    "supergraphlets",
+    "calldfa",
+    "libcalls"
+};
+
+void
+stats::clear()
+{
+    memset(phases,0,sizeof(phases));
+    memset(counts,0,sizeof(counts));
+    memset(families,0,sizeof(families));
+}
+
+void
+stats::merge(stats const& o)
+{
+    for(int i=0;i<NPHASES;++i) {
+        phases[i].wall += o.phases[i].wall;
+        phases[i].cpu += o.phases[i].cpu;
+    }
+    for(int i=0;i<NCOUNTERS;++i)
+        counts[i] += o.counts[i];
+    for(int i=0;i<NFAMILIES;++i) {
+        families[i].distinct += o.families[i].distinct;
+        families[i].occurrences += o.families[i].occurrences;
+    }
+}
+
+void
+stats::produced(unsigned family, uint64_t distinct, uint64_t occurrences)
+{
+    for(int i=0;i<NFAMILIES;++i) {
+        if(family == (1U << i)) {
+            families[i].distinct += distinct;
+            families[i].occurrences += occurrences;
+        }
+    }
+}
+
+double
+stats::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+double
+stats::thread_cpu()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID,&ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double
+tv(struct timeval const& t)
+{
+    return t.tv_sec + t.tv_usec / 1e6;
+}
+
+void
+stats::write(FILE * out, double started) const
+{
+    struct rusage self, children;
+    getrusage(RUSAGE_SELF,&self);
+    getrusage(RUSAGE_CHILDREN,&children);
+
+    double cpu = tv(self.ru_utime) + tv(self.ru_stime) +
+                 tv(children.ru_utime) + tv(children.ru_stime);
+    long rss = self.ru_maxrss > children.ru_maxrss ?
+        self.ru_maxrss : children.ru_maxrss;
+
+    fprintf(out,"{\n");
+    fprintf(out,"  \"wall\": %.6f,\n",now() - started);
+    fprintf(out,"  \"cpu\": %.6f,\n",cpu);
+    fprintf(out,"  \"peak_rss_kb\": %ld,\n",rss);
+
+    fprintf(out,"  \"phases\": {\n");
+    for(int i=0;i<NPHASES;++i) {
+        fprintf(out,"    \"%s\": { \"wall\": %.6f, \"cpu\": %.6f }%s\n",
+            phase_names[i],phases[i].wall,phases[i].cpu,
+            i+1 < NPHASES ? "," : "");
+    }
+    fprintf(out,"  },\n");
+
+    fprintf(out,"  \"binaries\": %lu,\n",(unsigned long)counts[BINARIES]);
+    fprintf(out,"  \"functions\": {\n");
+    fprintf(out,"    \"total\": %lu,\n",(unsigned long)counts[FUNCTIONS]);
+    fprintf(out,"    \"processed\": %lu,\n",(unsigned long)counts[PROCESSED]);
+    fprintf(out,"    \"skipped\": { \"exclude\": %lu, \"std\": %lu, "
+                "\"nort\": %lu, \"noplt\": %lu }\n",
+        (unsigned long)counts[SKIP_EXCLUDE],(unsigned long)counts[SKIP_STD],
+        (unsigned long)counts[SKIP_NORT],(unsigned long)counts[SKIP_NOPLT]);
+    fprintf(out,"  },\n");
+    fprintf(out,"  \"blocks\": %lu,\n",(unsigned long)counts[BLOCKS]);
+    fprintf(out,"  \"edges\": %lu,\n",(unsigned long)counts[EDGES]);
+    fprintf(out,"  \"instructions\": %lu,\n",
+        (unsigned long)counts[INSTRUCTIONS]);
+    fprintf(out,"  \"feature_cache\": { \"hits\": %lu, \"misses\": %lu },\n",
+        (unsigned long)counts[FCACHE_HITS],
+        (unsigned long)counts[FCACHE_MISSES]);
+
+    // n-grams are printed as they are found unless they are counted
+    uint64_t distinct = families[0].distinct;
+    uint64_t occurrences = families[0].occurrences;
+    fprintf(out,"  \"features\": {\n");
+    fprintf(out,"    \"%s\": { \"distinct\": ",family_names[0]);
+    if(distinct)
+        fprintf(out,"%lu",(unsigned long)distinct);
+    else
+        fprintf(out,"null");
+    fprintf(out,", \"occurrences\": %lu },\n",(unsigned long)occurrences);
+    for(int i=1;i<NFAMILIES;++i) {
+        fprintf(out,"    \"%s\": { \"distinct\": %lu, \"occurrences\": %lu },\n",
+            family_names[i],(unsigned long)families[i].distinct,
+            (unsigned long)families[i].occurrences);
+        distinct += families[i].distinct;
+        occurrences += families[i].occurrences;
+    }
+    fprintf(out,"    \"total\": { \"distinct\": %lu, \"occurrences\": %lu }\n",
+        (unsigned long)distinct,(unsigned long)occurrences);
+    fprintf(out,"  }\n");
+    fprintf(out,"}\n");
+}
+
+int
+write_stats(char const* path, stats const& s, double started)
+{
+    FILE * out = fopen(path,"w");
+    if(!out) {
+        fprintf(stderr,"Can't open stats file %s: %s\n",path,strerror(errno));
+        return -1;
+    }
+    s.write(out,started);
+    if(fclose(out) != 0) {
+        fprintf(stderr,"Failed to write stats file %s: %s\n",
+            path,strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+}
@@ -0,0 +1,110 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+/*
+ * Run statistics for --stats: wall and CPU time per phase of the
+ * extraction, and counts of what was processed and produced.
+ *
+ * Phase times are measured per thread and summed, so with --jobs they
+ * may add up to more than the elapsed time. A stats is plain data, so
+ * that batch workers can add theirs into one kept in shared memory.
+ */
+#include <stdint.h>
+#include <stdio.h>
+
+namespace extract {
+
+struct stats {
+    enum phase {
+        PARSE,              // ParseAPI parse and conversion to a program
+        CFG_CACHE,          // loading and saving parsed binaries
+        FEATURE_CACHE,      // per-function keys, lookups and stores
+        NGRAMS,
+        IDIOMS,
+        GRAPHLETS,
+        SUPERGRAPHLETS,     // less the merging of MERGE
+        MERGE,              // graph::compact
+        CALLDFA,
+        LIBCALLS,
+        OUTPUT,
+        NPHASES
+    };
+
+    enum counter {
+        BINARIES,
+        FUNCTIONS,          // all functions of the binaries
+        PROCESSED,          // functions walked
+        SKIP_EXCLUDE,       // on the exclusion list
+        SKIP_STD,           // std:: and __gnu_cxx:: functions
+        SKIP_NORT,          // idioms not counted, --nort
+        SKIP_NOPLT,         // idioms not counted, --noplt
+        BLOCKS,             // of the functions walked
+        EDGES,              // out of those blocks
+        INSTRUCTIONS,       // decoded for idioms and node colors
+        FCACHE_HITS,
+        FCACHE_MISSES,
+        NCOUNTERS
+    };
+
+    struct timing {
+        double wall;
+        double cpu;
+    };
+
+    /* per family, in the order of the family bits */
+    struct output {
+        uint64_t distinct;          // features printed (not for n-grams)
+        uint64_t occurrences;       // sum of their counts
+    };
+    static const int NFAMILIES = 6;
+
+    timing phases[NPHASES];
+    uint64_t counts[NCOUNTERS];
+    output families[NFAMILIES];
+
+    stats() { clear(); }
+    void clear();
+    void merge(stats const& o);
+
+    /* Add the distinct features and occurrences of one family */
+    void produced(unsigned family, uint64_t distinct, uint64_t occurrences);
+
+    /* Write as JSON, along with the time since started (a monotonic
+       clock reading, see now()), the CPU time and the peak resident
+       set of this process and its children. */
+    void write(FILE * out, double started) const;
+
+    static double now();            // CLOCK_MONOTONIC, in seconds
+    static double thread_cpu();     // CLOCK_THREAD_CPUTIME_ID
+};
+
+/* Times a phase from construction to destruction; does nothing without
+   a stats */
+class phase_timer {
+ public:
+    phase_timer(stats * s, stats::phase p) :
+        _s(s),
+        _p(p),
+        _wall(s ? stats::now() : 0),
+        _cpu(s ? stats::thread_cpu() : 0)
+    { }
+    ~phase_timer() {
+        if(_s) {
+            _s->phases[_p].wall += stats::now() - _wall;
+            _s->phases[_p].cpu += stats::thread_cpu() - _cpu;
+        }
+    }
+
+ private:
+    stats * _s;
+    stats::phase _p;
+    double _wall;
+    double _cpu;
+};
+
+/* Write s to the file named path; 0 on success */
+int write_stats(char const* path, stats const& s, double started);
+
+}
+
+#endif
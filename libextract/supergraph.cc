@@ -154,11 +154,12 @@ graph::compact()
 void
 graph::todot(int & nid) const
 {
-    todot(nid,false);
+    extract::outbuf out(stdout);
+    todot(nid,false,out);
 }
 
 void
-graph::todot(int & nid, bool as_str) const
+graph::todot(int & nid, bool as_str, extract::outbuf & out) const
 {
     dyn_hash_map<size_t,int> nmap;
     for(unsigned i=0;i<nodes_.size();++i) {
@@ -167,10 +168,14 @@ graph::todot(int & nid, bool as_str) const
         if(nmap.find((size_t)n) == nmap.end())
             nmap[(size_t)n] = nid++;
 
+        out.put('n');
+        out.dec(nmap[(size_t)n]);
+        out.put(" [label=\"");
         if(as_str)
-            printf("n%d [label=\"%s\"] ;\n",nmap[(size_t)n],n->color()->tostr().c_str());
+            out.put(n->color()->tostr());
         else
-            printf("n%d [label=\"%d\"] ;\n",nmap[(size_t)n],n->color()->toint());
+            out.dec(n->color()->toint());
+        out.put("\"] ;\n");
         //printf("\"%p\" ;\n",n);
         //printf("\"%s\" ;\n",n->name_.c_str());
 
@@ -178,9 +183,11 @@ graph::todot(int & nid, bool as_str) const
             if(nmap.find((size_t)n->outs()[j]->trg()) == nmap.end())
                 nmap[(size_t)n->outs()[j]->trg()] = nid++;            
 
-            printf(" n%d -> n%d ;\n",
-                nmap[(size_t)n],
-                nmap[(size_t)n->outs()[j]->trg()]);
+            out.put(" n");
+            out.dec(nmap[(size_t)n]);
+            out.put(" -> n");
+            out.dec(nmap[(size_t)n->outs()[j]->trg()]);
+            out.put(" ;\n");
             //printf(" \"%p\" -> \"%p\" ;\n",n,n->outs()[j]->trg());
             //printf(" \"%s\" -> \"%s\" ;\n",
                 //n->name_.c_str(),n->outs()[j]->trg()->name_.c_str());
@@ -1,12 +1,15 @@
 #ifndef _SUPERGRAPH_H_
 #define _SUPERGRAPH_H_
 
+#include <stdio.h>
+
 #include <vector>
 #include <string>
 #include <map>
 
 #include "colors.h"
 #include "graphlet.h"
+#include "outbuf.h"
 
 namespace graphlets {
 
@@ -80,7 +83,7 @@ class graph {
 
     void compact();
     void todot(int&) const;
-    void todot(int&,bool string) const;
+    void todot(int&,bool string,extract::outbuf & out) const;
 
     std::vector<edge*> const& edges() const { return edges_; }
     std::vector<snode*> const& nodes() const { return nodes_; }
@@ -0,0 +1,473 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "synth.h"
+
+using namespace std;
+
+namespace extract {
+namespace cfg {
+
+synth_options::synth_options() :
+    kind(RANDOM),
+    funcs(1000),
+    blocks(32),
+    fanout(16),
+    depth(4),
+    plt(64),
+    calls(10),
+    seed(1)
+{ }
+
+bool
+parse_shape(char const* s, synth_options::shape & kind)
+{
+    static struct { char const* name; synth_options::shape kind; } shapes[] = {
+        { "random", synth_options::RANDOM },
+        { "switch", synth_options::SWITCH },
+        { "loops", synth_options::LOOPS },
+        { "huge", synth_options::HUGE_FUNCS }
+    };
+    for(unsigned i=0;i<sizeof(shapes)/sizeof(shapes[0]);++i) {
+        if(strcmp(s,shapes[i].name) == 0) {
+            kind = shapes[i].kind;
+            return true;
+        }
+    }
+    return false;
+}
+
+namespace {
+
+static const addr_t TEXT_BASE = 0x401000;
+static const addr_t JUMP_TABLE = 0x600000;
+
+static char const* libc_names[] = {
+    "malloc", "free", "calloc", "realloc", "memcpy", "memset", "memmove",
+    "memcmp", "strlen", "strcmp", "strncmp", "strcpy", "strncpy", "strchr",
+    "strdup", "printf", "fprintf", "sprintf", "snprintf", "puts", "fputs",
+    "fopen", "fclose", "fread", "fwrite", "fflush", "open", "close", "read",
+    "write", "lseek", "mmap", "munmap", "exit", "abort", "getenv", "atoi",
+    "strtol", "strtoul", "qsort", "time", "rand", "srand", "__stack_chk_fail"
+};
+
+/* splitmix64 */
+class rng {
+ public:
+    explicit rng(uint64_t seed) : _s(seed) { }
+    uint64_t next() {
+        uint64_t z = (_s += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+    /* uniform in [0,n) */
+    uint32_t below(uint32_t n) { return n ? next() % n : 0; }
+ private:
+    uint64_t _s;
+};
+
+/* how a block ends */
+enum term {
+    FALLS,          // into the next block
+    BRANCHES,       // jcc to locals[0], else the next block
+    JUMPS,          // jmp to locals[0]
+    CALLS,          // call callee, returning to the next block
+    SWITCHES,       // jmp through a table to each of locals
+    RETURNS
+};
+
+/* a block of a function being generated; targets are local indices */
+struct sblock {
+    uint8_t term;
+    uint32_t callee;                // function, or nfuncs + PLT entry
+    vector<uint32_t> locals;
+};
+
+/* the blocks of one function */
+class shaper {
+ public:
+    shaper(synth_options const& o, rng & r, vector<sblock> & out) :
+        _o(o), _r(r), _out(out) { }
+
+    void function(uint32_t n);
+
+ private:
+    uint32_t add(term t) {
+        _out.push_back(sblock());
+        _out.back().term = t;
+        _out.back().callee = 0;
+        if(t == CALLS)
+            _out.back().callee = _r.below(_o.funcs + _o.plt);
+        return _out.size()-1;
+    }
+    uint32_t size() const { return _out.size(); }
+
+    void random(uint32_t n);
+    void switches();
+    void loop(uint32_t depth);
+
+    synth_options const& _o;
+    rng & _r;
+    vector<sblock> & _out;
+};
+
+/* n blocks jumping about among themselves and the block after them */
+void
+shaper::random(uint32_t n)
+{
+    uint32_t lo = size();
+    for(uint32_t i=0;i<n;++i) {
+        if(_o.funcs + _o.plt && _r.below(100) < _o.calls) {
+            add(CALLS);
+            continue;
+        }
+
+        uint32_t w = _r.below(100);
+        term t = w < 25 ? FALLS : w < 75 ? BRANCHES :
+                 w < 95 ? JUMPS : RETURNS;
+        uint32_t b = add(t);
+        if(t == BRANCHES || t == JUMPS)
+            _out[b].locals.push_back(lo + _r.below(n+1));
+    }
+}
+
+/* a hub jumping to fanout cases, each of which jumps to the join */
+void
+shaper::switches()
+{
+    uint32_t hub = add(SWITCHES);
+    uint32_t join = hub + 1 + _o.fanout;
+    for(uint32_t i=0;i<_o.fanout;++i) {
+        _out[hub].locals.push_back(hub + 1 + i);
+        if(i+1 < _o.fanout) {
+            uint32_t c = add(JUMPS);
+            _out[c].locals.push_back(join);
+        } else
+            add(FALLS);
+    }
+}
+
+/* header; body (a loop one less deep, or a few blocks); latch */
+void
+shaper::loop(uint32_t depth)
+{
+    uint32_t header = add(BRANCHES);
+    if(depth > 1)
+        loop(depth-1);
+    else
+        random(1 + _r.below(4));
+    uint32_t latch = add(JUMPS);
+    _out[latch].locals.push_back(header);
+    _out[header].locals.push_back(size());      // exit
+}
+
+void
+shaper::function(uint32_t n)
+{
+    if(n < 2)
+        n = 2;
+
+    switch(_o.kind) {
+        case synth_options::RANDOM:
+            random(n-1);
+            break;
+        case synth_options::SWITCH:
+            while(size() + _o.fanout + 4 < n) {
+                random(1 + _r.below(3));
+                switches();
+            }
+            break;
+        case synth_options::LOOPS:
+            while(size() + 1 < n)
+                loop(_o.depth ? _o.depth : 1);
+            break;
+        case synth_options::HUGE_FUNCS:
+            while(size() + 1 < n) {
+                switch(_r.below(3)) {
+                    case 0: random(32); break;
+                    case 1: switches(); break;
+                    case 2: loop(_o.depth ? _o.depth : 1); break;
+                }
+            }
+            break;
+    }
+    if(size() + 1 < n)
+        random(n - 1 - size());
+    add(RETURNS);
+}
+
+/* x86-64 code for the blocks */
+class assembler {
+ public:
+    assembler(rng & r, vector<unsigned char> & code) : _r(r), _c(code) { }
+
+    addr_t here() const { return TEXT_BASE + _c.size(); }
+
+    /* a few ordinary instructions; returns the address of the last */
+    addr_t filler(unsigned n);
+
+    void byte(unsigned char b) { _c.push_back(b); }
+    void imm32(uint32_t v) {
+        for(int i=0;i<4;++i)
+            byte((v >> (8*i)) & 0xff);
+    }
+    /* a rel32 to be patched once the target is placed */
+    void rel32(uint32_t block) {
+        _fix.push_back(make_pair(_c.size(),block));
+        imm32(0);
+    }
+    void align(unsigned a) {
+        while(_c.size() % a)
+            byte(0xcc);
+    }
+
+    /* point each rel32 at the start of its block */
+    void patch(vector<addr_t> const& starts);
+
+ private:
+    rng & _r;
+    vector<unsigned char> & _c;
+    vector< pair<size_t,uint32_t> > _fix;
+};
+
+addr_t
+assembler::filler(unsigned n)
+{
+    addr_t last = here();
+    for(unsigned i=0;i<n;++i) {
+        last = here();
+        unsigned d = _r.below(8);
+        unsigned s = _r.below(8);
+        switch(_r.below(14)) {
+            case 0: byte(0x48); byte(0x89); byte(0xc0|s<<3|d); break; // mov
+            case 1: byte(0x48); byte(0x01); byte(0xc0|s<<3|d); break; // add
+            case 2: byte(0x48); byte(0x29); byte(0xc0|s<<3|d); break; // sub
+            case 3: byte(0x31); byte(0xc0|s<<3|d); break;             // xor
+            case 4: byte(0x48); byte(0x85); byte(0xc0|s<<3|d); break; // test
+            case 5: byte(0x48); byte(0x39); byte(0xc0|s<<3|d); break; // cmp
+            case 6:                                                   // add $i
+                byte(0x48); byte(0x83); byte(0xc0|d); byte(_r.below(128));
+                break;
+            case 7:                                                   // load
+                byte(0x48); byte(0x8b); byte(0x44|d<<3); byte(0x24);
+                byte(_r.below(16) * 8);
+                break;
+            case 8:                                                   // store
+                byte(0x48); byte(0x89); byte(0x44|s<<3); byte(0x24);
+                byte(_r.below(16) * 8);
+                break;
+            case 9:                                                   // lea
+                byte(0x48); byte(0x8d); byte(0x40|d<<3|(s == 4 ? 3 : s));
+                byte(_r.below(128));
+                break;
+            case 10: byte(0x50|d); break;                             // push
+            case 11: byte(0x58|d); break;                             // pop
+            case 12:                                                  // shl $i
+                byte(0x48); byte(0xc1); byte(0xe0|d); byte(1 + _r.below(63));
+                break;
+            case 13:                                                  // imul
+                byte(0x48); byte(0x0f); byte(0xaf); byte(0xc0|d<<3|s);
+                break;
+        }
+    }
+    return last;
+}
+
+void
+assembler::patch(vector<addr_t> const& starts)
+{
+    for(unsigned i=0;i<_fix.size();++i) {
+        size_t off = _fix[i].first;
+        int64_t rel = (int64_t)starts[_fix[i].second] -
+                      (int64_t)(TEXT_BASE + off + 4);
+        uint32_t v = (uint32_t)rel;
+        for(int j=0;j<4;++j)
+            _c[off+j] = (v >> (8*j)) & 0xff;
+    }
+}
+
+}
+
+/*
+ * Blocks are numbered function by function, the PLT stubs last. Each
+ * PLT stub is a function of one block, named for its library function,
+ * as ParseAPI would have it.
+ */
+void
+synthesize(synth_options const& o, program & p)
+{
+    builder b(ARCH_X86_64,8);
+    rng r(o.seed);
+
+    // shapes
+    vector< vector<sblock> > funcs(o.funcs);
+    vector<uint32_t> base(o.funcs + 1,0);
+    for(uint32_t f=0;f<o.funcs;++f) {
+        uint32_t n = o.blocks;
+        if(o.kind != synth_options::HUGE_FUNCS && o.blocks > 1)
+            n = o.blocks/2 + r.below(o.blocks + 1);
+        shaper(o,r,funcs[f]).function(n);
+        base[f+1] = base[f] + funcs[f].size();
+    }
+    uint32_t nblocks = base[o.funcs] + o.plt;
+    auto plt_block = [&](uint32_t i) { return base[o.funcs] + i; };
+    auto callee_block = [&](uint32_t c) {
+        return c < o.funcs ? base[c] : plt_block(c - o.funcs);
+    };
+
+    // code: PLT stubs, then the functions
+    vector<unsigned char> code;
+    assembler as(r,code);
+    vector<addr_t> starts(nblocks), ends(nblocks), lasts(nblocks);
+    vector<extent> fext(o.funcs + o.plt);
+
+    for(uint32_t i=0;i<o.plt;++i) {
+        uint32_t x = plt_block(i);
+        starts[x] = lasts[x] = as.here();
+        as.byte(0xff); as.byte(0x25); as.imm32(0x200000);    // jmp *GOT
+        ends[x] = as.here();
+        as.byte(0x68); as.imm32(i);                         // push $i
+        as.byte(0xe9); as.imm32(0);                        // jmp PLT0
+        fext[o.funcs + i].start = starts[x];
+        fext[o.funcs + i].end = ends[x];
+    }
+
+    for(uint32_t f=0;f<o.funcs;++f) {
+        as.align(16);
+        fext[f].start = as.here();
+        vector<sblock> const& fb = funcs[f];
+        for(uint32_t i=0;i<fb.size();++i) {
+            uint32_t x = base[f] + i;
+            sblock const& s = fb[i];
+            starts[x] = as.here();
+            lasts[x] = as.filler((s.term == FALLS) + r.below(5));
+            if(s.term != FALLS)
+                lasts[x] = as.here();
+            switch(s.term) {
+                case BRANCHES:
+                    as.byte(0x0f); as.byte(0x80 | r.below(16));
+                    as.rel32(base[f] + s.locals[0]);
+                    break;
+                case JUMPS:
+                    as.byte(0xe9);
+                    as.rel32(base[f] + s.locals[0]);
+                    break;
+                case CALLS:
+                    as.byte(0xe8);
+                    as.rel32(callee_block(s.callee));
+                    break;
+                case SWITCHES:
+                    as.byte(0xff); as.byte(0x24); as.byte(0xc5);
+                    as.imm32(JUMP_TABLE);
+                    break;
+                case RETURNS:
+                    as.byte(0xc3);
+                    break;
+            }
+            ends[x] = as.here();
+        }
+        fext[f].end = as.here();
+    }
+    as.patch(starts);
+
+    for(uint32_t x=0;x<nblocks;++x)
+        (void)b.add_block(starts[x],ends[x],lasts[x]);
+
+    // edges, in the order of each block's targets
+    vector< vector<uint32_t> > sources(nblocks);
+    vector< vector<uint32_t> > calls(o.funcs);
+    vector<uint32_t> targets;
+    auto link = [&](uint32_t src, uint32_t trg, uint16_t t,
+        uint16_t flags) {
+        uint32_t e = b.add_edge(src,trg,t,flags);
+        targets.push_back(e);
+        if(trg != NONE)
+            sources[trg].push_back(e);
+        return e;
+    };
+
+    for(uint32_t f=0;f<o.funcs;++f) {
+        vector<sblock> const& fb = funcs[f];
+        for(uint32_t i=0;i<fb.size();++i) {
+            uint32_t x = base[f] + i;
+            sblock const& s = fb[i];
+            targets.clear();
+            switch(s.term) {
+                case FALLS:
+                    link(x,x+1,EDGE_FALLTHROUGH,0);
+                    break;
+                case BRANCHES:
+                    link(x,base[f] + s.locals[0],EDGE_COND_TAKEN,0);
+                    link(x,x+1,EDGE_COND_NOT_TAKEN,0);
+                    break;
+                case JUMPS:
+                    link(x,base[f] + s.locals[0],EDGE_DIRECT,0);
+                    break;
+                case CALLS:
+                    calls[f].push_back(
+                        link(x,callee_block(s.callee),EDGE_CALL,
+                            EDGE_INTERPROC));
+                    link(x,x+1,EDGE_CALL_FT,0);
+                    break;
+                case SWITCHES:
+                    for(uint32_t c : s.locals)
+                        link(x,base[f] + c,EDGE_INDIRECT,0);
+                    break;
+                case RETURNS:
+                    link(x,NONE,EDGE_RET,EDGE_SINK | EDGE_INTERPROC);
+                    break;
+            }
+            b.set_targets(x,targets);
+        }
+    }
+    for(uint32_t i=0;i<o.plt;++i) {
+        targets.clear();
+        link(plt_block(i),NONE,EDGE_INDIRECT,EDGE_SINK | EDGE_INTERPROC);
+        b.set_targets(plt_block(i),targets);
+    }
+    for(uint32_t x=0;x<nblocks;++x)
+        b.set_sources(x,sources[x]);
+
+    // functions
+    vector<uint32_t> fblocks;
+    vector<extent> ext(1);
+    vector<string> plt_names(o.plt);
+    unsigned nlibc = sizeof(libc_names)/sizeof(libc_names[0]);
+    for(uint32_t i=0;i<o.plt;++i) {
+        plt_names[i] = libc_names[i % nlibc];
+        if(i >= nlibc) {
+            char sfx[16];
+            snprintf(sfx,sizeof(sfx),"_%u",i / nlibc);
+            plt_names[i] += sfx;
+        }
+    }
+
+    for(uint32_t f=0;f<o.funcs;++f) {
+        char name[32];
+        snprintf(name,sizeof(name),"targ%lx",(unsigned long)starts[base[f]]);
+        fblocks.clear();
+        for(uint32_t x=base[f];x<base[f+1];++x)
+            fblocks.push_back(x);
+        ext[0] = fext[f];
+        b.add_function(starts[base[f]],name,base[f],0,fblocks,calls[f],ext);
+    }
+    for(uint32_t i=0;i<o.plt;++i) {
+        fblocks.assign(1,plt_block(i));
+        ext[0] = fext[o.funcs + i];
+        b.add_function(starts[plt_block(i)],plt_names[i],plt_block(i),0,
+            fblocks,vector<uint32_t>(),ext);
+    }
+
+    for(uint32_t i=0;i<o.plt;++i)
+        b.add_linkage(starts[plt_block(i)],plt_names[i]);
+
+    b.add_region(TEXT_BASE,code.data(),code.size());
+    b.finish(p);
+}
+
+}
+}
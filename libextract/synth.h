@@ -0,0 +1,53 @@
+#ifndef _SYNTH_H_
+#define _SYNTH_H_
+
+/*
+ * Synthetic programs, for exercising the kernels without a binary.
+ *
+ * A synthetic program is an ordinary cfg::program, built with a
+ * cfg::builder: functions laid out one after another in a single code
+ * region, each block holding a few x86-64 instructions and ending in
+ * the jump, call or return its out-edges call for, and a PLT of stubs
+ * for the calls to library functions. The code decodes, so node colors
+ * and idioms can be taken from it as from a real binary.
+ *
+ * Generation is deterministic in the seed.
+ */
+#include <stdint.h>
+
+#include "cfg.h"
+
+namespace extract {
+namespace cfg {
+
+struct synth_options {
+    synth_options();
+
+    enum shape {
+        RANDOM,         // conditional and direct jumps to random blocks
+        SWITCH,         // indirect jumps to many cases, which rejoin
+        LOOPS,          // nests of loops `depth' deep
+        HUGE_FUNCS      // a mix of the above in very large functions
+    };
+
+    shape kind;
+    uint32_t funcs;     // number of functions
+    uint32_t blocks;    // blocks per function (on average, but for HUGE_FUNCS)
+    uint32_t fanout;    // cases per switch
+    uint32_t depth;     // loop nesting
+    uint32_t plt;       // library functions
+    uint32_t calls;     // percentage of blocks ending in a call
+    uint64_t seed;
+};
+
+/* The shape named s (random, switch, loops or huge); false if there is
+   no such shape */
+bool parse_shape(char const* s, synth_options::shape & kind);
+
+/* Build a program of the given shape into p */
+void synthesize(synth_options const& opts, program & p);
+
+}
+}
+
+#endif
@@ -0,0 +1,325 @@
+#include <string.h>
+
+#include <algorithm>
+
+#include "topk.h"
+
+using namespace std;
+
+namespace extract {
+
+/* The start of a saved sketch, followed by its counters in heap order
+   and then, if its n-grams are not packed, their bytes */
+struct saved_topk {
+    int32_t n;
+    uint32_t m;
+    uint64_t size;
+    uint64_t total;
+};
+
+topk::topk(int n, unsigned counters) :
+    ngram_key(n),
+    _m(0),
+    _shift(64),
+    _total(0)
+{
+    reset(n,counters);
+}
+
+void
+topk::reset(int n, unsigned counters)
+{
+    static_cast<ngram_key &>(*this) = ngram_key(n);
+    _m = counters;
+
+    // at most half full
+    int bits = 4;
+    while((1UL << bits) < 2UL * _m)
+        ++bits;
+    _heap.clear();
+    _heap.reserve(_m);
+    _index.assign(1UL << bits,0);
+    _shift = 64 - bits;
+    _total = 0;
+    _bytes.assign(packed() ? 0 : (size_t)_m * _n,0);
+}
+
+long
+topk::find(uint64_t key, unsigned char const* s) const
+{
+    size_t mask = _index.size() - 1;
+    for(size_t i = slot(key); _index[i]; i = (i+1) & mask) {
+        hitter const& h = _heap[_index[i] - 1];
+        if(h.key == key && (packed() || memcmp(bytes(h),s,_n) == 0))
+            return _index[i] - 1;
+    }
+    return -1;
+}
+
+void
+topk::index(size_t i)
+{
+    size_t mask = _index.size() - 1;
+    size_t j = slot(_heap[i].key);
+    while(_index[j])
+        j = (j+1) & mask;
+    _index[j] = i + 1;
+    _heap[i].slot = j;
+}
+
+/* Entries after the hole that could have been placed in it are moved
+   back, so that no probe stops short of them */
+void
+topk::unindex(size_t i)
+{
+    size_t mask = _index.size() - 1;
+    size_t hole = _heap[i].slot;
+    _index[hole] = 0;
+    for(size_t j = (hole+1) & mask; _index[j]; j = (j+1) & mask) {
+        hitter & h = _heap[_index[j] - 1];
+        size_t home = slot(h.key);
+        if(((j - home) & mask) >= ((j - hole) & mask)) {
+            _index[hole] = _index[j];
+            _index[j] = 0;
+            h.slot = hole;
+            hole = j;
+        }
+    }
+}
+
+void
+topk::place(size_t i, hitter const& h)
+{
+    _heap[i] = h;
+    _index[h.slot] = i + 1;
+}
+
+void
+topk::up(size_t i)
+{
+    while(i > 0) {
+        size_t p = (i-1) / 2;
+        if(_heap[p].count <= _heap[i].count)
+            break;
+        hitter t = _heap[i];
+        place(i,_heap[p]);
+        place(p,t);
+        i = p;
+    }
+}
+
+void
+topk::down(size_t i)
+{
+    for(;;) {
+        size_t c = 2*i + 1;
+        if(c >= _heap.size())
+            break;
+        if(c+1 < _heap.size() && _heap[c+1].count < _heap[c].count)
+            ++c;
+        if(_heap[i].count <= _heap[c].count)
+            break;
+        hitter t = _heap[i];
+        place(i,_heap[c]);
+        place(c,t);
+        i = c;
+    }
+}
+
+void
+topk::insert(uint64_t key, unsigned char const* s, uint64_t count,
+    uint64_t err)
+{
+    hitter h;
+    h.key = key;
+    h.count = count;
+    h.err = err;
+    h.bytes = 0;
+    h.slot = 0;
+    if(!packed()) {
+        h.bytes = _heap.size() * _n;
+        memcpy(&_bytes[h.bytes],s,_n);
+    }
+    _heap.push_back(h);
+    index(_heap.size() - 1);
+    up(_heap.size() - 1);
+}
+
+void
+topk::add(uint64_t key, unsigned char const* s, uint64_t count)
+{
+    _total += count;
+    if(_m == 0)
+        return;
+
+    long i = find(key,s);
+    if(i >= 0) {
+        _heap[i].count += count;
+        down(i);
+        return;
+    }
+    if(_heap.size() < _m) {
+        insert(key,s,count,0);
+        return;
+    }
+
+    // the least counter changes hands, keeping its place in the bytes
+    hitter & h = _heap[0];
+    uint64_t least = h.count;
+    unindex(0);
+    h.key = key;
+    h.count = least + count;
+    h.err = least;
+    if(!packed())
+        memcpy(&_bytes[h.bytes],s,_n);
+    index(0);
+    down(0);
+}
+
+/*
+ * An n-gram held by one sketch but not the other occurred at most the
+ * other's floor() times in its stream, so that much is added to both
+ * its count and its error. Of the union, the m largest are kept.
+ */
+void
+topk::merge(topk const& o)
+{
+    uint64_t ours = floor();
+    uint64_t theirs = o.floor();
+
+    vector<hitter> all;
+    vector<unsigned char> grams;
+    auto take = [&](topk const& t, hitter h, uint64_t count, uint64_t err) {
+        if(!packed()) {
+            unsigned char const* s = t.bytes(h);
+            h.bytes = grams.size();
+            grams.insert(grams.end(),s,s + _n);
+        }
+        h.count = count;
+        h.err = err;
+        all.push_back(h);
+    };
+
+    for(size_t i=0;i<_heap.size();++i) {
+        hitter const& h = _heap[i];
+        long j = o.find(h.key,packed() ? NULL : bytes(h));
+        if(j >= 0)
+            take(*this,h,h.count + o._heap[j].count,h.err + o._heap[j].err);
+        else
+            take(*this,h,h.count + theirs,h.err + theirs);
+    }
+    for(size_t i=0;i<o._heap.size();++i) {
+        hitter const& h = o._heap[i];
+        if(find(h.key,packed() ? NULL : o.bytes(h)) < 0)
+            take(o,h,h.count + ours,h.err + ours);
+    }
+
+    if(all.size() > _m) {
+        nth_element(all.begin(),all.begin() + _m,all.end(),
+            [](hitter const& a, hitter const& b) {
+                return a.count > b.count;
+            });
+        all.resize(_m);
+    }
+
+    uint64_t total = _total + o._total;
+    reset(_n,_m);
+    for(size_t i=0;i<all.size();++i)
+        insert(all[i].key,packed() ? NULL : &grams[all[i].bytes],
+            all[i].count,all[i].err);
+    _total = total;
+}
+
+bool
+topk::less(hitter const& a, hitter const& b) const
+{
+    if(a.count != b.count)
+        return a.count > b.count;
+    if(packed())
+        return a.key < b.key;
+    return memcmp(bytes(a),bytes(b),_n) < 0;
+}
+
+void
+topk::top(size_t k, vector<hitter const*> & out) const
+{
+    out.clear();
+    for(size_t i=0;i<_heap.size();++i)
+        out.push_back(&_heap[i]);
+
+    k = std::min(k,out.size());
+    partial_sort(out.begin(),out.begin() + k,out.end(),
+        [this](hitter const* a, hitter const* b) { return less(*a,*b); });
+    out.resize(k);
+}
+
+void
+topk::get(hitter const& h, unsigned char * s) const
+{
+    if(!packed()) {
+        memcpy(s,bytes(h),_n);
+        return;
+    }
+    for(int i=0;i<_n;++i)
+        s[i] = (h.key >> (8*(_n-1-i))) & 0xff;
+}
+
+void
+topk::format(outbuf & out, hitter const& h) const
+{
+    if(!packed()) {
+        out.hex2(bytes(h),_n);
+        return;
+    }
+    unsigned char s[MAX_PACKED];
+    get(h,s);
+    out.hex2(s,_n);
+}
+
+size_t
+topk::footprint(int n, unsigned counters)
+{
+    size_t sz = sizeof(saved_topk) + (size_t)counters * sizeof(hitter);
+    if(n > MAX_PACKED)
+        sz += (size_t)counters * n;
+    // so that sketches saved one after another stay aligned
+    return (sz + 7) & ~(size_t)7;
+}
+
+void
+topk::save(void * to) const
+{
+    saved_topk * hdr = (saved_topk *)to;
+    hdr->n = _n;
+    hdr->m = _m;
+    hdr->size = _heap.size();
+    hdr->total = _total;
+
+    char * p = (char *)(hdr + 1);
+    if(!_heap.empty())
+        memcpy(p,&_heap[0],_heap.size() * sizeof(hitter));
+    p += (size_t)_m * sizeof(hitter);
+    if(!_bytes.empty())
+        memcpy(p,&_bytes[0],_bytes.size());
+}
+
+void
+topk::load(void const* from)
+{
+    saved_topk const* hdr = (saved_topk const*)from;
+    reset(hdr->n,hdr->m);
+
+    char const* p = (char const*)(hdr + 1);
+    hitter const* h = (hitter const*)p;
+    _heap.assign(h,h + hdr->size);
+    p += (size_t)_m * sizeof(hitter);
+    if(!_bytes.empty())
+        memcpy(&_bytes[0],p,_bytes.size());
+
+    // slots are positions in the saving process's index
+    for(size_t i=0;i<_heap.size();++i)
+        index(i);
+    _total = hdr->total;
+}
+
+}
@@ -0,0 +1,105 @@
+#ifndef _TOPK_H_
+#define _TOPK_H_
+
+/*
+ * The most frequent n-grams of one length in a fixed amount of memory,
+ * for ngrams --topk.
+ *
+ * This is the SpaceSaving sketch of Metwally et al.: m counters, each
+ * holding an n-gram with its count and the most that count can be over.
+ * An n-gram already held has its count raised. One that is not takes a
+ * free counter or, once they are all in use, the one with the least
+ * count c, inheriting c as both the start of its count and its error.
+ * After N n-grams every count is at most N/m over, and never under; any
+ * n-gram that occurred more than N/m times is held.
+ *
+ * The counters are kept as a binary heap on their counts, so the least
+ * is always at hand, indexed by an open-addressing table of their keys
+ * (keyed as in ngram_table). Nothing is allocated once all m are used.
+ *
+ * Sketches merge as Agarwal et al. describe, keeping the same bounds
+ * over the combined stream: this is how the function walk's workers
+ * combine, and how a batch sums its corpus. A sketch can be saved to and
+ * loaded from a flat block of footprint() bytes, to be shared between
+ * processes.
+ */
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+#include "ngtable.h"
+#include "outbuf.h"
+
+namespace extract {
+
+class topk : public ngram_key {
+ public:
+    struct hitter {
+        uint64_t key;
+        uint64_t count;             // at least the true count
+        uint64_t err;               // and at most this much more
+        uint32_t bytes;             // offset of the n-gram, if not packed
+        uint32_t slot;              // in the index
+    };
+
+    explicit topk(int n = 0, unsigned counters = 0);
+
+    /* empty the sketch and keep counters n-grams of length n */
+    void reset(int n, unsigned counters);
+    void clear() { reset(_n,_m); }
+
+    unsigned counters() const { return _m; }
+    size_t size() const { return _heap.size(); }
+    uint64_t total() const { return _total; }
+    /* the most times an n-gram not held can have occurred */
+    uint64_t floor() const {
+        return _heap.size() < _m ? 0 : _heap[0].count;
+    }
+
+    /* count the n-gram at s, whose key is key */
+    void add(uint64_t key, unsigned char const* s, uint64_t count = 1);
+    void merge(topk const& o);
+
+    /* the k largest counts, largest first; ties in byte order */
+    void top(size_t k, std::vector<hitter const*> & out) const;
+
+    /* the n-gram of h, in hex */
+    void format(outbuf & out, hitter const& h) const;
+
+    /* the bytes save() writes for a sketch of this size */
+    static size_t footprint(int n, unsigned counters);
+    void save(void * to) const;
+    void load(void const* from);
+
+ private:
+    unsigned char const* bytes(hitter const& h) const {
+        return &_bytes[h.bytes];
+    }
+    size_t slot(uint64_t key) const {
+        return (key * 0x9e3779b97f4a7c15ULL) >> _shift;
+    }
+    void get(hitter const& h, unsigned char * s) const;
+    bool less(hitter const& a, hitter const& b) const;
+
+    /* the heap position of the n-gram, or -1 */
+    long find(uint64_t key, unsigned char const* s) const;
+    void index(size_t i);
+    void unindex(size_t i);
+    void place(size_t i, hitter const& h);
+    void up(size_t i);
+    void down(size_t i);
+    void insert(uint64_t key, unsigned char const* s, uint64_t count,
+        uint64_t err);
+
+    unsigned _m;
+    std::vector<hitter> _heap;      // least count first
+    std::vector<uint32_t> _index;   // heap position + 1, or 0
+    int _shift;                     // 64 - log2 of the index size
+    uint64_t _total;
+    std::vector<unsigned char> _bytes;  // m n-grams, if not packed
+};
+
+}
+
+#endif
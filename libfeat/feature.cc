@@ -29,6 +29,12 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 #include<assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
 
 #include "InstructionDecoder.h"
 #include "Instruction.h"
@@ -98,30 +104,142 @@ LookupFeature::add_term(LookupTerm *t)
     _terms.push_back(t);
 }
 
-LookupFeature::LookupFeature(vector<LookupTerm *> & t)
+LookupFeature::LookupFeature(const vector<LookupTerm *> & t)
 {
     _terms.insert(_terms.begin(),t.begin(),t.end());
 }
 
 /** feature vector implementation **/
 
-FeatureVector::FeatureVector() :
+FeatureVector::FeatureVector(int idiom_len, int operand_dist) :
     _begin(new iterator(this,-1)),
     _end(new iterator(this,-1)),
-    _limited(false)
+    _limited(false),
+    _idiom_len(idiom_len),
+    oflookup(false,operand_dist),
+    _list(NULL)
+{
+    assert(idiom_len >= 1 && idiom_len <= MAX_IDIOM_LEN);
+    assert(operand_dist >= 1 && operand_dist <= MAX_OPERAND_DIST);
+}
+
+/* Each line of file, a feature as format() prints it, with any count
+   after it cut off; false if file cannot be read */
+template<typename F>
+static bool
+each_feature(const char * file, F f)
 {
+    FILE * in = fopen(file,"r");
+    if(!in)
+        return false;
+
+    char * buf = NULL;
+    size_t n = 0;
+    ssize_t len;
+    while(-1 != (len = getline(&buf,&n,in))) {
+        while(len > 0 && (buf[len-1] == '\n' || buf[len-1] == '\r'))
+            buf[--len] = '\0';
+        char * count = strchr(buf,':');
+        if(count)
+            *count = '\0';
+        if(buf[0] != '\0')
+            f(buf);
+    }
 
+    if(buf)
+        free(buf);
+    fclose(in);
+    return true;
 }
 
-FeatureVector::FeatureVector(char * featfile) :
+/* The key of an idiom line; false if it is not 1 to MAX_IDIOM_LEN terms */
+static bool
+parse_idiom(char * line, IdiomKey & k)
+{
+    IdiomFeature idiom(line);
+    if(idiom.terms().empty() || idiom.terms().size() > MAX_IDIOM_LEN) {
+        fprintf(stderr,"Ignoring idiom %s: not 1 to %d terms\n",
+            line,MAX_IDIOM_LEN);
+        return false;
+    }
+    k = idiom.key();
+    return true;
+}
+
+bool
+IdiomList::load(const char * file) {
+    unsigned at = size();
+    return each_feature(file,[&](char * line) {
+        IdiomKey k;
+        if(line[0] != 'I')
+            fprintf(stderr,"Ignoring %s: not an idiom\n",line);
+        else if(parse_idiom(line,k))
+            add(k,at++);
+    });
+}
+
+void
+IdiomList::add(const IdiomKey & k, unsigned at) {
+    if(_idioms.find(k))
+        return;
+    _idioms[k] = at;
+    _len = max(_len,k.len);
+
+    IdiomKey p = k;
+    for(p.len=1;p.len<k.len;++p.len)
+        _prefixes[p] = true;
+}
+
+FeatureVector::FeatureVector(char * featfile, int operand_dist) :
     _begin(new iterator(this,-1)),
     _end(new iterator(this,-1)),
-    _limited(true)
+    _limited(true),
+    _idiom_len(0),
+    oflookup(true,operand_dist),
+    _list(&_own_list)
 {
-    // FIXME load limited feature descriptions
-    assert(0);
+    assert(operand_dist >= 1 && operand_dist <= MAX_OPERAND_DIST);
+
+    // the first listing of a feature decides its place
+    unsigned at = 0;
+    bool read = each_feature(featfile,[&](char * line) {
+        IdiomKey k;
+        if(line[0] == 'I') {
+            if(parse_idiom(line,k))
+                _own_list.add(k,at++);
+        } else if(line[0] == 'O')
+            _order.emplace(oflookup.add(new OperandFeature(line)),at++);
+        else
+            fprintf(stderr,"Ignoring unknown feature %s\n",line);
+    });
+    if(!read)
+        fprintf(stderr,"Can't open feature file %s: %s\n",
+            featfile,strerror(errno));
+    _idiom_len = _own_list.len();
 }
 
+FeatureVector::FeatureVector(const IdiomList * list) :
+    _begin(new iterator(this,-1)),
+    _end(new iterator(this,-1)),
+    _limited(true),
+    _idiom_len(list->len()),
+    oflookup(true),
+    _list(list)
+{
+
+}
+
+/* The feature of k, added to the pool if it is new */
+IdiomFeature *
+FeatureVector::intern_idiom(const IdiomKey & k) {
+    size_t before = _idioms.size();
+    uint32_t & id = _idioms[k];
+    if(_idioms.size() > before) {
+        id = _idiom_pool.size();
+        _idiom_pool.emplace_back(&_idioms,id);
+    }
+    return &_idiom_pool[id];
+}
 
 FeatureVector::~FeatureVector() {
     if(_begin)
@@ -132,30 +250,58 @@ FeatureVector::~FeatureVector() {
 
 int
 FeatureVector::eval(Function *f, bool idioms, bool operands) {
-    Instruction::Ptr insn;
+    vector<pair<Address,Address> > blocks;
 
+    Function::blocklist::iterator bit = f->blocks().begin();
+    for( ; bit != f->blocks().end(); ++bit)
+        blocks.push_back(make_pair((*bit)->start(),(*bit)->end()));
+
+    return eval(f->isrc(),blocks,idioms,operands);
+}
+
+/* Every block is decoded into _insns first, and the lookups read from
+   there */
+int
+FeatureVector::eval(InstructionSource *isrc,
+    const vector<pair<Address,Address> > & blocks,
+    bool idioms, bool operands) {
     _feats.clear();
     (*_begin) = (*_end);
 
-    Function::blocklist::iterator bit = f->blocks().begin();
-    for( ; bit != f->blocks().end(); ++bit) {
-        Block * b = *bit;
-        Address cur = b->start();
-        void * buf  = b->region()->getPtrToInstruction(b->start());
-        if(!buf) {
+    _insns.reset(isrc,operands);
+    for(unsigned i=0;i<blocks.size();++i)
+        _insns.add_block(blocks[i].first,blocks[i].second);
+
+    // lookups may append instructions beyond the blocks
+    long n = _insns.size();
+    for(long i=0;i<n;++i) {
+        if(!_insns.len[i])
             continue;
+        if(idioms && _limited) {
+            int nk = idioms_at(_insns,i,_keys,_idiom_len,&_list->prefixes());
+            for(int k=0;k<nk;++k) {
+                const unsigned * at = _list->find(_keys[k]);
+                if(at) {
+                    IdiomFeature * f = intern_idiom(_keys[k]);
+                    _order.emplace(f,*at);
+                    _feats.push_back(f);
+                }
+            }
+        } else if(idioms) {
+            int nk = idioms_at(_insns,i,_keys,_idiom_len);
+            for(int k=0;k<nk;++k)
+                _feats.push_back(intern_idiom(_keys[k]));
         }
+        if(operands)
+            oflookup.lookup(_insns,i,_feats);
+    }
 
-        InstructionDecoder dec((unsigned char*)buf,b->size(),
-            b->region()->getArch());
-
-        while((insn = dec.decode())) {
-            if(idioms)
-                iflookup.lookup(f,cur,_feats);
-            if(operands)
-                oflookup.lookup(f,cur,_feats);
-            cur += insn->size(); 
-        }
+    if(_limited) {
+        const unordered_map<Feature *, unsigned> & order = _order;
+        stable_sort(_feats.begin(),_feats.end(),
+            [&order](Feature * a, Feature * b) {
+                return order.find(a)->second < order.find(b)->second;
+            });
     }
 
     if(!_feats.empty())
@@ -165,6 +311,37 @@ FeatureVector::eval(Function *f, bool idioms, bool operands) {
     return _feats.size();
 }
 
+const IdiomTable<unsigned> &
+FeatureVector::count_idioms(InstructionSource *isrc,
+    const vector<pair<Address,Address> > & blocks) {
+    _insns.reset(isrc,false);
+    for(unsigned i=0;i<blocks.size();++i)
+        _insns.add_block(blocks[i].first,blocks[i].second);
+
+    return count_idioms(_insns.size());
+}
+
+const IdiomTable<unsigned> &
+FeatureVector::count_idioms(long n) {
+    _idiom_counts.clear();
+
+    for(long i=0;i<n;++i) {
+        if(!_insns.len[i])
+            continue;
+        if(_limited) {
+            int nk = idioms_at(_insns,i,_keys,_idiom_len,&_list->prefixes());
+            for(int k=0;k<nk;++k)
+                if(_list->find(_keys[k]))
+                    ++_idiom_counts[_keys[k]];
+        } else {
+            int nk = idioms_at(_insns,i,_keys,_idiom_len);
+            for(int k=0;k<nk;++k)
+                ++_idiom_counts[_keys[k]];
+        }
+    }
+    return _idiom_counts;
+}
+
 bool
 FeatureVector::hasmore(int index) {
     return index < ((int)_feats.size())-1;
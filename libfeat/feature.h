@@ -31,8 +31,10 @@
 #ifndef _FEATURE_H_
 #define _FEATURE_H_
 
+#include <deque>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "Symbol.h"
 #include "Operation.h"
@@ -67,6 +69,62 @@ class Feature {
     feature_types _type;
 };
 
+/* InsnTable:
+
+   The instructions of one function, each decoded once, as parallel
+   arrays indexed by position: what IdiomTerm takes of each instruction,
+   and (if asked for) the registers and memory each operand reads or
+   writes, as OperandTerm takes them. Blocks are decoded in the order
+   given; an instruction outside them, which an idiom running past the
+   end of a block reaches, is decoded and appended when first asked for.
+*/
+class InsnTable {
+ public:
+    InsnTable() : _isrc(NULL), _operands(false), _decoded(0) { }
+
+    /* empty the table for code from isrc; with operands, fill the
+       operand columns too */
+    void reset(InstructionSource *isrc, bool operands);
+    /* append the instructions of [start,end) */
+    void add_block(Address start, Address end);
+
+    /* the instruction at a, or -1 if there is no code there */
+    long at(Address a);
+    /* the instruction that follows i, or -1 */
+    long next(long i) {
+        if(!len[i])
+            return -1;
+        Address a = addr[i] + len[i];
+        if(i+1 < (long)addr.size() && addr[i+1] == a)
+            return i+1;
+        return at(a);
+    }
+
+    size_t size() const { return addr.size(); }
+    /* instructions decoded since construction */
+    size_t decoded() const { return _decoded; }
+
+ public:
+    vector<Address> addr;
+    vector<unsigned char> len;              // 0 if it did not decode
+    vector<unsigned short> entry_id;        // as in IdiomTerm
+    vector<unsigned short> arg1;
+    vector<unsigned short> arg2;
+
+    // the operands of instruction i are [op_begin[i],op_begin[i+1])
+    vector<uint32_t> op_begin;
+    vector<unsigned short> op_id;           // register ID, or MEMARG
+    vector<bool> op_write;
+
+ private:
+    void decode(Address a, size_t max);
+
+    InstructionSource * _isrc;
+    bool _operands;
+    size_t _decoded;
+    unordered_map<Address,uint32_t> _index;
+};
+
 /* LookupFeature: 
   
    A feature that the Lookup knows how to look up.
@@ -84,7 +142,7 @@ class LookupTerm {
 class LookupFeature : public Feature {
  public:
     LookupFeature() { }
-    LookupFeature(vector<LookupTerm *> & t);
+    LookupFeature(const vector<LookupTerm *> & t);
     const vector<LookupTerm *> & terms() const { return _terms;}
     void add_term(LookupTerm *t);
 
@@ -114,6 +172,14 @@ class LookupFeature : public Feature {
 class IdiomTerm : public LookupTerm {
  public:
     IdiomTerm(Function *f, Address addr);
+    IdiomTerm(InstructionSource *isrc, Address addr);
+    IdiomTerm(const InsnTable & insns, long i) :
+        entry_id(insns.entry_id[i]),
+        arg1(insns.arg1[i]),
+        arg2(insns.arg2[i]),
+        len(insns.len[i]),
+        _formatted(false)
+    { }
     IdiomTerm(unsigned long it);
     IdiomTerm(const IdiomTerm & it) :
         entry_id(it.entry_id),
@@ -145,29 +211,208 @@ class IdiomTerm : public LookupTerm {
     string _format;
 };
 
+/* IdiomKey:
+
+   An idiom of up to MAX_IDIOM_LEN terms, as the to_int() of each (the
+   wildcard's included), so that idioms can be enumerated and counted
+   arithmetically instead of through terms and a trie. Idioms are of
+   IDIOM_LEN terms unless a FeatureVector is given another length.
+*/
+#define MAX_IDIOM_LEN 5
+#define IDIOM_LEN 3
+#define WILDCARD_TERM 0xaaaaffffffffULL
+
+struct IdiomKey {
+    uint64_t t[MAX_IDIOM_LEN];
+    int len;
+
+    bool operator==(const IdiomKey & k) const {
+        for(int i=0;i<len;++i)
+            if(t[i] != k.t[i])
+                return false;
+        return len == k.len;
+    }
+    uint64_t hash() const {
+        uint64_t h = len;
+        for(int i=0;i<len;++i)
+            h = (h ^ t[i]) * 0x9e3779b97f4a7c15ULL;
+        return h;
+    }
+    string format() const;
+};
+
+/* IdiomFeature::format() of the idiom of these n terms */
+string format_idiom(const uint64_t * terms, int n);
+
+/* IdiomTable:
+
+   A map from IdiomKey, by open addressing with linear probing in an
+   index kept at most half full. Entries are kept in the order they were
+   added, which is the order of iteration; clear() takes time in the
+   number of entries, not the size of the index.
+*/
+template<typename V>
+class IdiomTable {
+ public:
+    struct entry {
+        IdiomKey key;
+        V value;
+        uint32_t at;        // in the index
+    };
+    typedef typename vector<entry>::const_iterator const_iterator;
+
+    IdiomTable() : _index(1 << 10,0), _shift(64 - 10) { }
+
+    /* the value of k, added as V() if it is not there */
+    V & operator[](const IdiomKey & k) {
+        if(2 * (_entries.size() + 1) > _index.size())
+            grow();
+        size_t mask = _index.size() - 1;
+        size_t i = k.hash() >> _shift;
+        for( ; _index[i]; i = (i+1) & mask) {
+            entry & e = _entries[_index[i] - 1];
+            if(e.key == k)
+                return e.value;
+        }
+        entry e = { k, V(), (uint32_t)i };
+        _entries.push_back(e);
+        _index[i] = _entries.size();
+        return _entries.back().value;
+    }
+
+    /* the value of k, or NULL */
+    const V * find(const IdiomKey & k) const {
+        size_t mask = _index.size() - 1;
+        size_t i = k.hash() >> _shift;
+        for( ; _index[i]; i = (i+1) & mask) {
+            const entry & e = _entries[_index[i] - 1];
+            if(e.key == k)
+                return &e.value;
+        }
+        return NULL;
+    }
+
+    void clear() {
+        for(size_t i=0;i<_entries.size();++i)
+            _index[_entries[i].at] = 0;
+        _entries.clear();
+    }
+
+    size_t size() const { return _entries.size(); }
+    /* the key added id-th since the last clear() */
+    const IdiomKey & key(size_t id) const { return _entries[id].key; }
+    const_iterator begin() const { return _entries.begin(); }
+    const_iterator end() const { return _entries.end(); }
+
+ private:
+    void grow() {
+        _index.assign(_index.size() * 2,0);
+        --_shift;
+        size_t mask = _index.size() - 1;
+        for(size_t j=0;j<_entries.size();++j) {
+            size_t i = _entries[j].key.hash() >> _shift;
+            while(_index[i])
+                i = (i+1) & mask;
+            _index[i] = j + 1;
+            _entries[j].at = i;
+        }
+    }
+
+    vector<entry> _entries;
+    vector<uint32_t> _index;        // entry + 1, or 0
+    int _shift;                     // 64 - log2 of the index size
+};
+
+/* The idioms that begin with instruction i: every window of up to len
+   instructions (stopping after one that did not decode), with each term
+   but the last either itself or the wildcard. Fills keys, which must have
+   room for 2^len - 1, and returns how many. Lengths 2 to 4 have kernels
+   of their own, with the window unrolled.
+
+   With prefixes, a window is only carried on to another instruction
+   while what it has so far is in prefixes, so that idioms no listed one
+   begins with are never formed. */
+int idioms_at(InsnTable & insns, long i, IdiomKey * keys, int len,
+    const IdiomTable<bool> * prefixes = NULL);
+
+/* An idiom is either its terms or, for those a FeatureVector finds, an
+   id in the table of idioms it has seen: such a feature has no terms and
+   allocates nothing, and is formatted from its key when asked */
 class IdiomFeature : public LookupFeature {
  public:
-    IdiomFeature() : _formatted(false) { }
-    IdiomFeature(vector<LookupTerm *> & t) : LookupFeature(t),
-        _formatted(false) { }
+    IdiomFeature() : _keys(NULL), _id(0), _owned(false) { }
+    IdiomFeature(const vector<LookupTerm *> & t) : LookupFeature(t),
+        _keys(NULL), _id(0), _owned(false) { }
     IdiomFeature(char * str);
-    ~IdiomFeature() { }
-    
+    /* the idiom added id-th to keys, which must outlive it */
+    IdiomFeature(const IdiomTable<uint32_t> * keys, uint32_t id) :
+        _keys(keys), _id(id), _owned(false) { }
+    ~IdiomFeature();
+
+    /* the terms as to_int() has them; there must be at most
+       MAX_IDIOM_LEN */
+    IdiomKey key() const;
+
     string format();
 
     string human_format();
 
     typedef IdiomTerm term;
  private:
-    bool _formatted;
-    string _format;
+    const IdiomTable<uint32_t> * _keys;     // with _id, if not terms
+    uint32_t _id;
+    bool _owned;            // whether the terms are this feature's own
+};
+
+/* IdiomList:
+
+   Idioms to count and no others, read from a file of one per line as
+   format() prints them (anything from a ':' on is ignored, so counts may
+   be left on). Once loaded it is only read, and may be shared by the
+   FeatureVectors of several threads.
+*/
+class IdiomList {
+ public:
+    IdiomList() : _len(0) { }
+
+    /* false if file cannot be read; lines that are not idioms of 1 to
+       MAX_IDIOM_LEN terms are reported and skipped */
+    bool load(const char * file);
+    /* list k, and the idioms it begins with, unless k is listed */
+    void add(const IdiomKey & k, unsigned at);
+
+    /* where k was first listed, or NULL */
+    const unsigned * find(const IdiomKey & k) const {
+        return _idioms.find(k);
+    }
+    /* the idioms some listed one begins with */
+    const IdiomTable<bool> & prefixes() const { return _prefixes; }
+
+    size_t size() const { return _idioms.size(); }
+    /* the terms of the longest listed */
+    int len() const { return _len; }
+
+    /* in the order listed */
+    typedef IdiomTable<unsigned>::const_iterator const_iterator;
+    const_iterator begin() const { return _idioms.begin(); }
+    const_iterator end() const { return _idioms.end(); }
+
+ private:
+    IdiomTable<unsigned> _idioms;   // where each was first listed
+    IdiomTable<bool> _prefixes;
+    int _len;
 };
 
 /* 
   OperandFeature
 
-  Represents a distant bigram pair of operands
+  Represents a distant bigram pair of operands: an operand of one
+  instruction and one of an instruction up to OPERAND_DIST on (or as
+  far as the lookup is given, at most MAX_OPERAND_DIST)
 */
+#define MAX_OPERAND_DIST 16
+#define OPERAND_DIST 3
+
 class OperandTerm : public LookupTerm {
  public:
     OperandTerm(unsigned short id, bool write) :
@@ -201,15 +446,15 @@ class OperandTerm : public LookupTerm {
 };
 class OperandFeature : public LookupFeature {
  public:    
-    OperandFeature() : _formatted(false) { }
-    ~OperandFeature() { }
+    OperandFeature() : _owned(false) { }
+    OperandFeature(char * str);
+    ~OperandFeature();
 
     string format();
     
     typedef OperandTerm term;
  private:
-    bool _formatted;
-    string _format;
+    bool _owned;            // whether the terms are this feature's own
 };
 
 template<typename T>
@@ -217,26 +462,22 @@ class Lookup {
  public:
     typedef typename T::term LT;
 
-    Lookup(bool f = false) :
-        fixed(false)
+    Lookup(bool f = false, int d = OPERAND_DIST) :
+        fixed(f),
+        dist(d)
     { }
     ~Lookup();
 
-    void lookup(Function * f, Address addr, vector<Feature *> & feats);
+    /* the features that begin with instruction i */
+    void lookup(InsnTable & insns, long i, vector<Feature *> & feats);
 
-    struct lt_hash {
-        size_t operator()(const LT & x) const {
-            return x.hash();
-        }
-    };
-    struct lt_equal {
-        bool operator()(const LT & a, const LT &b) const {
-            return a == b;
-        }
-    };
+    /* make the terms of f a feature a fixed lookup finds, and free f;
+       returns the lookup's own feature of those terms */
+    LookupFeature * add(LookupFeature * f);
 
+    /* trie edges are by the to_int() of their terms */
     class Lnode;
-    typedef unordered_map<LT, Lnode *, lt_hash, lt_equal> lmap_t;
+    typedef unordered_map<uint64_t, Lnode *> lmap_t;
     class Lnode {
      public:
         LookupFeature *f;
@@ -246,17 +487,36 @@ class Lookup {
         ~Lnode();
 
         Lnode * next(LT *nt);
+        /* as next(), but NULL rather than a new node */
+        Lnode * find(LT *nt);
     };
  private:
-    void lookup_idiom(Function *f, Address addr, Lnode * cur, int depth, 
-        vector<LookupTerm *> & stack, vector<Feature *> & feats);
+    /* the child of cur for t; a fixed lookup has only the nodes on the
+       way to its features */
+    Lnode * step(Lnode * cur, LT * t) {
+        return fixed ? cur->find(t) : cur->next(t);
+    }
+    /* the lasting copy of t, for the features that refer to it; terms
+       looked up are the caller's, and do not outlive the lookup */
+    LT * intern(const LT & t);
+    vector<LookupTerm *> intern(const vector<LookupTerm *> & terms);
 
  private:
 
-    unordered_map<Address, vector<LT *> > _term_map;
+    // Every term and feature of the trie, each stored once, by value,
+    // and freed with the lookup
+    unordered_map<uint64_t, LT *> _terms;   // by to_int()
+    deque<LT> _term_pool;
+    deque<T> _features;
+
+    // the terms of the instructions being looked up, reused from one
+    // lookup to the next
+    vector<LT> _first;
+    vector<LT> _second;
 
     Lnode start;
     bool fixed;
+    int dist;           // how many instructions on a term may be
 };
 
 
@@ -269,18 +529,59 @@ class Lookup {
     1. Feature subset provided. In this case, only
        those features indicated will be produced.
        The ordering of features under iteration is fixed.
+       The file lists one feature per line, as format()
+       has it (I... or O...). Lookups are pruned to the
+       listed features: no idiom is carried on that no
+       listed one begins with.
 
     2. All features enabled. There is no guarantee
        of feature ordering in this case.
+
+   Features are kept in pools, one object per distinct
+   feature for the life of the FeatureVector, and an
+   idiom is only an id in the table of those seen. What
+   one function needs (its instructions, the features
+   found) is reused by the next eval, so memory grows
+   with the largest function and the features seen, not
+   with the size of the binary.
 */
 class FeatureVector {
  public:
-    FeatureVector();
-    FeatureVector(char * featfile);
+    /* idioms of up to idiom_len terms, and operand pairs up to
+       operand_dist instructions apart; with a subset, idioms are as
+       long as the longest listed */
+    FeatureVector(int idiom_len = IDIOM_LEN,
+        int operand_dist = OPERAND_DIST);
+    FeatureVector(char * featfile, int operand_dist = OPERAND_DIST);
+    /* a subset of the idioms in list, which must outlive this, and no
+       operand features */
+    FeatureVector(const IdiomList * list);
     ~FeatureVector();
 
     int eval(Function * f, bool idioms = true, bool operands = true);
 
+    /* As above, for a function given by the [start,end) ranges of its
+       blocks, whose code is provided by isrc */
+    int eval(InstructionSource * isrc,
+        const vector<pair<Address,Address> > & blocks,
+        bool idioms = true, bool operands = true);
+
+    /* Idioms alone, counted rather than listed: the distinct idioms of
+       the function, in the order first seen, with their counts (only
+       those listed, with a subset) */
+    const IdiomTable<unsigned> & count_idioms(InstructionSource * isrc,
+        const vector<pair<Address,Address> > & blocks);
+    /* As above, for a function whose blocks the caller has already
+       decoded (without operands) as the first n entries of insns() */
+    const IdiomTable<unsigned> & count_idioms(long n);
+
+    /* the table evaluations decode into; it is reset by each */
+    InsnTable & insns() { return _insns; }
+
+    /* instructions decoded by all evaluations so far; each is decoded
+       once per evaluation */
+    size_t decoded() const { return _insns.decoded(); }
+
     /* iterator */
     class iterator {
      private:
@@ -314,17 +615,30 @@ class FeatureVector {
  private:
     bool hasmore(int index);
     Feature * get(int index);
+    IdiomFeature * intern_idiom(const IdiomKey & k);
 
  private:
     iterator * _begin;
     iterator * _end;
     bool _limited;
+    int _idiom_len;
     vector<Feature *> _feats;
+    InsnTable _insns;
 
     // Generators
-    Lookup<IdiomFeature> iflookup;
+    IdiomKey _keys[1 << MAX_IDIOM_LEN];
+    // every idiom seen (or listed), by key, as its place in _idiom_pool
+    IdiomTable<uint32_t> _idioms;
+    deque<IdiomFeature> _idiom_pool;
+    IdiomTable<unsigned> _idiom_counts;
     Lookup<OperandFeature> oflookup;
 
+    // With a subset, where each listed feature comes, and the idioms
+    // listed (in _own_list if read from a feature file)
+    unordered_map<Feature *, unsigned> _order;
+    IdiomList _own_list;
+    const IdiomList * _list;
+
 
  friend class FeatureVector::iterator;
 };
@@ -0,0 +1,135 @@
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HEX_X86 1
+#endif
+
+#include "hex.h"
+
+/* the digits of every byte value */
+struct hex_pairs {
+    hex_pairs() {
+        static char const digits[] = "0123456789abcdef";
+        for(int i=0;i<256;++i) {
+            p[2*i] = digits[i >> 4];
+            p[2*i+1] = digits[i & 0xf];
+        }
+    }
+    char p[512];
+};
+
+static hex_pairs const pairs;
+
+static void hex_scalar(char * dst, unsigned char const* src, size_t n)
+{
+    for(size_t i=0;i<n;++i) {
+        memcpy(dst,&pairs.p[2*src[i]],2);
+        dst += 2;
+    }
+}
+
+#ifdef HEX_X86
+
+/* nibbles 0-15 to '0'-'9','a'-'f': add '0', and 'a'-'0'-10 more if > 9 */
+__attribute__((target("sse2")))
+static inline __m128i digits128(__m128i nib)
+{
+    __m128i letter = _mm_cmpgt_epi8(nib,_mm_set1_epi8(9));
+    return _mm_add_epi8(_mm_add_epi8(nib,_mm_set1_epi8('0')),
+        _mm_and_si128(letter,_mm_set1_epi8('a' - '0' - 10)));
+}
+
+__attribute__((target("sse2")))
+static size_t hex_sse2(char * dst, unsigned char const* src, size_t n)
+{
+    __m128i low = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+    for( ; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((__m128i const*)(src + i));
+        __m128i hi = digits128(_mm_and_si128(_mm_srli_epi16(v,4),low));
+        __m128i lo = digits128(_mm_and_si128(v,low));
+        _mm_storeu_si128((__m128i *)(dst + 2*i),
+            _mm_unpacklo_epi8(hi,lo));
+        _mm_storeu_si128((__m128i *)(dst + 2*i + 16),
+            _mm_unpackhi_epi8(hi,lo));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i digits256(__m256i nib)
+{
+    __m256i letter = _mm256_cmpgt_epi8(nib,_mm256_set1_epi8(9));
+    return _mm256_add_epi8(_mm256_add_epi8(nib,_mm256_set1_epi8('0')),
+        _mm256_and_si256(letter,_mm256_set1_epi8('a' - '0' - 10)));
+}
+
+/* The unpacks work within each 128-bit lane, so the halves of the
+   result are put back in order afterwards */
+__attribute__((target("avx2")))
+static size_t hex_avx2(char * dst, unsigned char const* src, size_t n)
+{
+    __m256i low = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+    for( ; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((__m256i const*)(src + i));
+        __m256i hi = digits256(_mm256_and_si256(_mm256_srli_epi16(v,4),low));
+        __m256i lo = digits256(_mm256_and_si256(v,low));
+        __m256i a = _mm256_unpacklo_epi8(hi,lo);
+        __m256i b = _mm256_unpackhi_epi8(hi,lo);
+        _mm256_storeu_si256((__m256i *)(dst + 2*i),
+            _mm256_permute2x128_si256(a,b,0x20));
+        _mm256_storeu_si256((__m256i *)(dst + 2*i + 32),
+            _mm256_permute2x128_si256(a,b,0x31));
+    }
+    return i + hex_sse2(dst + 2*i,src + i,n - i);
+}
+
+typedef size_t (*hex_fn)(char *, unsigned char const*, size_t);
+
+static size_t hex_none(char *, unsigned char const*, size_t)
+{
+    return 0;
+}
+
+static hex_fn hex_choose()
+{
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return hex_avx2;
+    if(__builtin_cpu_supports("sse2"))
+        return hex_sse2;
+    return hex_none;
+}
+
+#endif
+
+void hex_bytes(char * dst, unsigned char const* src, size_t n)
+{
+#ifdef HEX_X86
+    static hex_fn const hex_vector = hex_choose();
+    if(n >= 16) {
+        size_t done = hex_vector(dst,src,n);
+        dst += 2*done;
+        src += done;
+        n -= done;
+    }
+#endif
+    hex_scalar(dst,src,n);
+}
+
+size_t hex_u64(char * dst, uint64_t v)
+{
+    unsigned char b[8];
+    char tmp[16];
+    for(int i=0;i<8;++i)
+        b[i] = v >> (56 - 8*i);
+    hex_scalar(tmp,b,8);
+
+    size_t skip = 0;
+    while(skip < 15 && tmp[skip] == '0')
+        ++skip;
+    memcpy(dst,tmp + skip,16 - skip);
+    return 16 - skip;
+}
@@ -0,0 +1,21 @@
+#ifndef _HEX_H_
+#define _HEX_H_
+
+/*
+ * Lower-case hex encoding for the feature formatters here and the
+ * output of libextract.
+ *
+ * hex_bytes() writes two digits per byte, as %02x would. Runs of 16
+ * bytes or more are converted with AVX2 or SSE2 where the CPU has them,
+ * and anything shorter through a table of digit pairs. hex_u64() writes
+ * a number as %lx would.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+void hex_bytes(char * dst, unsigned char const* src, size_t n);
+
+/* Returns the number of digits written, between 1 and 16 */
+size_t hex_u64(char * dst, uint64_t v);
+
+#endif
@@ -38,6 +38,7 @@
 #include "RegisterIDs.h"
 
 #include "feature.h"
+#include "hex.h"
 
 #include "Singleton.h"
 
@@ -50,68 +51,23 @@ using namespace NS_x86;
 /** IdiomFeature implementation **/
 
 IdiomTerm::IdiomTerm(Function *f, Address addr) :
+    IdiomTerm(f->isrc(),addr)
+{
+
+}
+
+IdiomTerm::IdiomTerm(InstructionSource *isrc, Address addr) :
     entry_id(ILLEGAL_ENTRY),
     arg1(NOARG),
     arg2(NOARG),
     len(0),
     _formatted(false)
 {
-    Instruction::Ptr insn;
-    InstructionDecoder dec(
-        (unsigned char*)f->isrc()->getPtrToInstruction(addr),
-        30, // arbitrary
-        f->isrc()->getArch());
-
-    insn = dec.decode();
-    if(insn) { 
-        // set representation
-
-        len = insn->size();
-
-        const Operation & op = insn->getOperation();
-        entry_id = op.getID() + 1;
-
-        //fprintf(stderr,"IT[%d,%d",entry_id,len);
-
-        if(entry_id != ILLEGAL_ENTRY) {
-            vector<Operand> ops;
-            insn->getOperands(ops);
-            //fprintf(stderr,",%ld",ops.size());
-            
-            // we'll take up to two operands... which seems bad. FIXME
-
-            unsigned short args[2] = {NOARG,NOARG};
-            
-            for(unsigned int i=0;i<2 && i<ops.size();++i) {
-                Operand & op = ops[i];
-                if(!op.readsMemory() && !op.writesMemory()) {
-                    // register or immediate
-                    set<RegisterAST::Ptr> regs;
-                    op.getReadSet(regs);
-                    op.getWriteSet(regs);
-
-                    if(!regs.empty()) {
-                        args[i] = (*regs.begin())->getID();
-                    } else {
-                        // immediate
-                        args[i] = IMMARG;
-                    }
-                } else {
-                    args[i] = MEMARG; 
-                }
-            }
-
-            arg1 = args[0];
-            arg2 = args[1];
-        } else {
-            //fprintf(stderr,",0");
-        }
-
-
-        //fprintf(stderr,",%x,%x],%s\n",arg1,arg2,insn->format().c_str());
-    } else {
-        //fprintf(stderr,"IT[no insn decoded]\n");
-    }
+    InsnTable insns;
+    insns.reset(isrc,false);
+    long i = insns.at(addr);
+    if(i >= 0)
+        *this = IdiomTerm(insns,i);
 }
 extern IdiomTerm WILDCARD_IDIOM;
 string
@@ -229,6 +185,15 @@ string
 IdiomFeature::human_format() {
     string ret = "";
     //printf("formatting %s\n",format().c_str());
+    if(_keys) {
+        const IdiomKey & k = _keys->key(_id);
+        for(int i=0;i<k.len;++i) {
+            ret += IdiomTerm(k.t[i]).human_format();
+            if(i<k.len-1)
+                ret += "_";
+        }
+        return ret;
+    }
     for(unsigned i=0;i<_terms.size();++i) {
         ret += ((IdiomTerm*)_terms[i])->human_format();
         if(i<_terms.size()-1)
@@ -238,7 +203,9 @@ IdiomFeature::human_format() {
 }
 
 IdiomFeature::IdiomFeature(char * str) :
-    _formatted(false)
+    _keys(NULL),
+    _id(0),
+    _owned(true)
 {
     vector<uint64_t> terms;
     //printf("init from **%s**\n",str);
@@ -264,30 +231,132 @@ IdiomFeature::IdiomFeature(char * str) :
     }
 }
 
+IdiomFeature::~IdiomFeature()
+{
+    if(_owned)
+        for(unsigned i=0;i<_terms.size();++i)
+            delete _terms[i];
+}
+
+IdiomKey
+IdiomFeature::key() const {
+    if(_keys)
+        return _keys->key(_id);
+
+    IdiomKey k;
+    assert(_terms.size() <= MAX_IDIOM_LEN);
+    k.len = _terms.size();
+    for(int i=0;i<k.len;++i)
+        k.t[i] = ((IdiomTerm*)_terms[i])->to_int();
+    return k;
+}
+
 string
 IdiomFeature::format() {
-    if(_formatted)
-        return _format;
+    if(_keys) {
+        const IdiomKey & k = _keys->key(_id);
+        return format_idiom(k.t,k.len);
+    }
 
+    vector<uint64_t> terms;
+    for(unsigned i=0;i<_terms.size();++i)
+        terms.push_back(((IdiomTerm*)_terms[i])->to_int());
+    return format_idiom(terms.data(),terms.size());
+}
+
+string
+IdiomKey::format() const {
+    return format_idiom(t,len);
+}
+
+string
+format_idiom(const uint64_t * terms, int n) {
     char buf[64];
+    size_t len = 0;
 
-    _format = "I";
+    string ret = "I";
 
-    for(unsigned i=0;i<_terms.size();++i) {
+    for(int i=0;i<n;++i) {
         // XXX shrink output by removing NOARGs from right
-        uint64_t out = ((IdiomTerm*)_terms[i])->to_int();
+        uint64_t out = terms[i];
         if((out & 0xffff) == NOARG)
             out = out >> 16;
         if((out & 0xffff) == NOARG)
             out = out >> 16;
 
-        if(i+1<_terms.size())
-            snprintf(buf,64,"%lx_",out);
-        else
-            snprintf(buf,64,"%lx",out);
-        _format += buf;
+        if(len + 17 > sizeof(buf)) {
+            ret.append(buf,len);
+            len = 0;
+        }
+        len += hex_u64(buf + len,out);
+        if(i+1<n)
+            buf[len++] = '_';
     }
+    ret.append(buf,len);
+    return ret;
+}
 
-    _formatted = true;
-    return _format;
+/* The windows are built a term at a time: each pattern of wildcards
+   over the terms so far that may go on is ended with the newest term, and
+   carried on both with it and with the wildcard in its place. N is the
+   length if it is known here, or 0 to take it from len. */
+template<int N>
+static int
+idioms_upto(InsnTable & insns, long i, IdiomKey * keys, int len,
+    const IdiomTable<bool> * prefixes) {
+    const int L = N ? N : len;
+    IdiomKey live[2][1 << ((N ? N : MAX_IDIOM_LEN) - 1)];
+    int nlive = 1;
+    int cur = 0;
+    int n = 0;
+
+    live[cur][0].len = 0;
+    for(int k=0;k<L && i >= 0 && nlive;++k) {
+        uint64_t t = ((uint64_t)insns.entry_id[i] << ENTRY_SHIFT) |
+                     ((uint64_t)insns.arg1[i] << ARG1_SHIFT) |
+                     ((uint64_t)insns.arg2[i] << ARG2_SHIFT);
+        bool more = k+1 < L && insns.entry_id[i] != ILLEGAL_ENTRY;
+
+        int nnext = 0;
+        for(int p=0;p<nlive;++p) {
+            IdiomKey & key = keys[n++];
+            key = live[cur][p];
+            key.t[k] = t;
+            key.len = k+1;
+            if(!more)
+                continue;
+
+            IdiomKey & wc = live[!cur][nnext];
+            wc = live[cur][p];
+            wc.t[k] = WILDCARD_TERM;
+            wc.len = k+1;
+            if(!prefixes || prefixes->find(wc))
+                ++nnext;
+            if(!prefixes || prefixes->find(key))
+                live[!cur][nnext++] = key;
+        }
+        if(!more)
+            break;
+
+        cur = !cur;
+        nlive = nnext;
+        if(nlive)
+            i = insns.next(i);
+    }
+    return n;
+}
+
+int
+idioms_at(InsnTable & insns, long i, IdiomKey * keys, int len,
+    const IdiomTable<bool> * prefixes) {
+    switch(len) {
+        case 2:
+            return idioms_upto<2>(insns,i,keys,len,prefixes);
+        case 3:
+            return idioms_upto<3>(insns,i,keys,len,prefixes);
+        case 4:
+            return idioms_upto<4>(insns,i,keys,len,prefixes);
+        default:
+            return idioms_upto<0>(insns,i,keys,len,prefixes);
+    }
 }
@@ -0,0 +1,169 @@
+/* 
+ * Copyright (c) 1996-2010 Barton P. Miller
+ * 
+ * We provide the Paradyn Parallel Performance Tools (below
+ * described as "Paradyn") on an AS IS basis, and do not warrant its
+ * validity or performance.  We reserve the right to update, modify,
+ * or discontinue this software at any time.  We shall have no
+ * obligation to supply such updates or modifications or any other
+ * form of support to you.
+ * 
+ * By your use of Paradyn, you understand and agree that we (or any
+ * other person or entity with proprietary rights in Paradyn) are
+ * under no obligation to provide either maintenance services,
+ * update services, notices of latent defects, or correction of
+ * defects for Paradyn.
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+#include <assert.h>
+
+#include "CodeObject.h"
+#include "InstructionDecoder.h"
+#include "Instruction.h"
+
+#include "feature.h"
+#include "iapihax.h"
+
+using namespace std;
+using namespace Dyninst;
+using namespace Dyninst::ParseAPI;
+using namespace Dyninst::InstructionAPI;
+
+/* the most bytes one instruction can take */
+#define MAX_INSN_LEN 30
+
+void
+InsnTable::reset(InstructionSource *isrc, bool operands)
+{
+    _isrc = isrc;
+    _operands = operands;
+    addr.clear();
+    len.clear();
+    entry_id.clear();
+    arg1.clear();
+    arg2.clear();
+    op_begin.assign(1,0);
+    op_id.clear();
+    op_write.clear();
+    _index.clear();
+}
+
+void
+InsnTable::add_block(Address start, Address end)
+{
+    Address cur = start;
+    while(cur < end && _isrc->getPtrToInstruction(cur)) {
+        size_t n = size();
+        decode(cur,end - cur);
+        if(!len[n])
+            break;
+        cur += len[n];
+    }
+}
+
+long
+InsnTable::at(Address a)
+{
+    unordered_map<Address,uint32_t>::const_iterator it = _index.find(a);
+    if(it != _index.end())
+        return it->second;
+    if(!_isrc->getPtrToInstruction(a))
+        return -1;
+    decode(a,MAX_INSN_LEN);
+    return size() - 1;
+}
+
+/* Registers and immediates of the first two operands, as IdiomTerm has
+   them */
+static unsigned short idiom_arg(Operand & op)
+{
+    if(op.readsMemory() || op.writesMemory())
+        return MEMARG;
+
+    set<RegisterAST::Ptr> regs;
+    op.getReadSet(regs);
+    op.getWriteSet(regs);
+    if(!regs.empty())
+        return (*regs.begin())->getID();
+    return IMMARG;
+}
+
+/* Appends the instruction at a, of at most max bytes */
+void
+InsnTable::decode(Address a, size_t max)
+{
+    InstructionDecoder dec(
+        (unsigned char*)_isrc->getPtrToInstruction(a),
+        max,
+        _isrc->getArch());
+    Instruction::Ptr insn = dec.decode();
+    ++_decoded;
+
+    _index[a] = size();
+    addr.push_back(a);
+    len.push_back(insn ? insn->size() : 0);
+    entry_id.push_back(insn ? insn->getOperation().getID() + 1 :
+        ILLEGAL_ENTRY);
+    arg1.push_back(NOARG);
+    arg2.push_back(NOARG);
+
+    vector<Operand> ops;
+    if(insn && (entry_id.back() != ILLEGAL_ENTRY || _operands))
+        insn->getOperands(ops);
+
+    // we'll take up to two operands... which seems bad. FIXME
+    if(entry_id.back() != ILLEGAL_ENTRY) {
+        if(ops.size() > 0)
+            arg1.back() = idiom_arg(ops[0]);
+        if(ops.size() > 1)
+            arg2.back() = idiom_arg(ops[1]);
+    }
+
+    if(_operands) {
+        ExpTyper typer;
+        for(unsigned int i=0;i<ops.size();++i) {
+            Operand & op = ops[i];
+            unsigned short opid;
+            bool write = false;
+
+            op.getValue()->apply(&typer);
+            if(typer.reg()) {
+                set<RegisterAST::Ptr> w_regs, r_regs;
+                op.getReadSet(r_regs);
+                op.getWriteSet(w_regs);
+                write = !w_regs.empty();
+
+                if(!r_regs.empty())
+                    opid = (*r_regs.begin())->getID();
+                else if(!w_regs.empty())
+                    opid = (*w_regs.begin())->getID();
+                else {
+                    assert(0); // XXX Debugging
+                    continue;
+                }
+            } else if(!typer.imm()) {
+                write = op.writesMemory();
+                opid = MEMARG;
+            } else {
+                continue;
+            }
+
+            op_id.push_back(opid);
+            op_write.push_back(write);
+        }
+    }
+    op_begin.push_back(op_id.size());
+}
@@ -37,16 +37,18 @@
 #include "Instruction.h"
 
 #include "feature.h"
-#include "iapihax.h"
 
-#define MAX_IDIOM_LEN 3
-IdiomTerm WILDCARD_IDIOM(0xaaaaffffffff);
+IdiomTerm WILDCARD_IDIOM(WILDCARD_TERM);
 
-/* op1 x x op2 */
-#define MAX_OPERAND_DIST 3
-OperandTerm WILDCARD_OPERAND_D1(0x1ffff);
-OperandTerm WILDCARD_OPERAND_D2(0x2ffff);
-OperandTerm * OP_WC[] = { &WILDCARD_OPERAND_D1, &WILDCARD_OPERAND_D2 };
+/* op1 x x op2: the wildcard for d instructions between is OP_WC[d-1] */
+static vector<OperandTerm> make_op_wildcards()
+{
+    vector<OperandTerm> wc;
+    for(uint64_t d=1;d<MAX_OPERAND_DIST;++d)
+        wc.push_back(OperandTerm((d << 16) | 0xffff));
+    return wc;
+}
+static vector<OperandTerm> OP_WC = make_op_wildcards();
 
 
 using namespace std;
@@ -62,167 +64,59 @@ void Lookup<T>::lookup(Address addr, vector<Feature *> & feats)
 }
 */
 
-template<>
-void Lookup<IdiomFeature>::lookup_idiom(
-    Function * f,
-    Address addr,
-    Lookup<IdiomFeature>::Lnode * cur,
-    int depth,
-    vector<LookupTerm *> & stack,
-    vector<Feature *> & feats)
-{
-    Lookup<IdiomFeature>::Lnode * next;
-    IdiomTerm * ct;
-
-
-    if(depth >= MAX_IDIOM_LEN || !f->isrc()->getPtrToInstruction(addr))
-        return;
-
-    if(_term_map.find(addr) == _term_map.end())
-        _term_map[addr].push_back(new IdiomTerm(f,addr));
-    ct = *_term_map[addr].begin();
-
-    stack.push_back(ct);
-
-    // non-wildcard
-    next = cur->next(ct);
-    if(!next->f && !fixed)
-        next->f = new IdiomFeature( stack );
-    if(next->f)
-        feats.push_back(next->f);
-    if(ct->entry_id != ILLEGAL_ENTRY)
-        lookup_idiom(f,addr+ct->len,next,depth+1,stack,feats);
-
-    stack.pop_back();
-
-    // wildcard
-    stack.push_back(&WILDCARD_IDIOM);
-    next = cur->next(&WILDCARD_IDIOM);
-    if(!next->f && !fixed)
-        next->f = new IdiomFeature( stack );
-    if(ct->entry_id != ILLEGAL_ENTRY)
-        lookup_idiom(f,addr+ct->len,next,depth+1,stack,feats);
-    
-    stack.pop_back();
-}
-
-template<>
-void Lookup<IdiomFeature>::lookup(
-    Function * f, Address addr, vector<Feature *> & feats)
+/* The operands of instruction i */
+static void
+get_operands(const InsnTable & insns, long i, vector<OperandTerm> & operands)
 {
-    vector<LookupTerm *> stack;
-    lookup_idiom(f,addr,&start,0,stack,feats);
-}
-
-void
-get_operands(
-    Function *f, Address addr, 
-    vector<OperandTerm *> & operands)
-{
-    Instruction::Ptr insn;
-
-    if(!f->isrc()->getPtrToInstruction(addr))
-        return;
-    
-    InstructionDecoder dec(
-        (unsigned char*)f->isrc()->getPtrToInstruction(addr),
-        30, //arbitrary
-        f->isrc()->getArch());
-    insn = dec.decode();
-    if(insn) {
-        vector<Operand> ops;
-        ExpTyper typer;
-        insn->getOperands(ops);
-        for(unsigned int i=0;i<ops.size();++i) {
-            Operand & op = ops[i];
-            unsigned short opid;
-            bool write = false;
-
-            op.getValue()->apply(&typer);
-            if(typer.reg()) {
-                set<RegisterAST::Ptr> w_regs, r_regs;
-                op.getReadSet(r_regs);
-                op.getWriteSet(w_regs);
-                write = !w_regs.empty();
-
-                if(!r_regs.empty()) 
-                    opid = (*r_regs.begin())->getID();
-                else if(!w_regs.empty())
-                    opid = (*w_regs.begin())->getID();
-                else {
-                    assert(0); // XXX Debugging
-                    continue;
-                }
-            } else if(!typer.imm()) { 
-                write = op.writesMemory();
-                opid = MEMARG;
-            } else {
-                continue;
-            }
-
-
-            OperandTerm * ot = new OperandTerm(opid,write);
-            //fprintf(stderr,"    %s [%lx] %d %d\n",op.format().c_str(),ot->to_int(), op.readsMemory(), op.writesMemory());
-
-            operands.push_back(ot);
-        }
-    }
+    operands.clear();
+    for(uint32_t k=insns.op_begin[i];k<insns.op_begin[i+1];++k)
+        operands.push_back(OperandTerm(insns.op_id[k],insns.op_write[k]));
 }
 
-
 template<>
 void Lookup<OperandFeature>::lookup(
-    Function *f, Address addr, vector<Feature *> & feats)
+    InsnTable & insns, long i, vector<Feature *> & feats)
 {
-    Instruction::Ptr insn;
-
     /* for each operand here, we want to record a new feature for bigrams
-       with operands up to MAX_OPERAND_DIST away */
+       with operands up to dist away */
 
-    if(_term_map.find(addr) == _term_map.end())
-        get_operands(f,addr,_term_map[addr]);
+    vector<OperandTerm> & terms1 = _first;
+    vector<OperandTerm> & terms2 = _second;
+    get_operands(insns,i,terms1);
 
-    vector<OperandTerm *> & terms1 = _term_map[addr];
-    
-    Address cur = addr;
-    InstructionDecoder dec(
-        (unsigned char *)f->isrc()->getPtrToInstruction(addr),
-        f->isrc()->offset() + f->isrc()->length() - addr,
-        f->isrc()->getArch());
-
-    for(unsigned d=0;d<MAX_OPERAND_DIST;++d) {
-        if(!f->isrc()->getPtrToInstruction(cur))
+    long cur = i;
+    for(int d=0;d<dist;++d) {
+        cur = insns.next(cur);
+        if(cur < 0)
             return;
-        insn = dec.decode((unsigned char*)f->isrc()->getPtrToInstruction(addr));
-        cur += insn->size(); 
-
-        if(_term_map.find(cur) == _term_map.end())
-            get_operands(f,cur,_term_map[cur]);
-
-        vector<OperandTerm *> & terms2 = _term_map[cur];
+        get_operands(insns,cur,terms2);
 
         // need a distance-d wildcard
         OperandTerm * wc = NULL;
         if(d > 0) {
-            wc = OP_WC[d-1];
+            wc = &OP_WC[d-1];
         } 
 
         for(unsigned i=0;i<terms1.size();++i) {
-            OperandTerm * ot1 = terms1[i];
-            Lnode * node = start.next(ot1);
-            if(wc)
-                node = node->next(wc);
+            OperandTerm * ot1 = &terms1[i];
+            Lnode * node = step(&start,ot1);
+            if(node && wc)
+                node = step(node,wc);
  
-            for(unsigned j=0;j<terms2.size();++j) {
-                OperandTerm * ot2 = terms2[j];
-                node = node->next(ot2); 
+            for(unsigned j=0;node && j<terms2.size();++j) {
+                OperandTerm * ot2 = &terms2[j];
+                node = step(node,ot2);
+                if(!node)
+                    break;
 
                 if(!node->f && !fixed) {
-                    node->f = new OperandFeature();
-                    node->f->add_term(ot1);
+                    _features.emplace_back();
+                    OperandFeature * f = &_features.back();
+                    f->add_term(intern(*ot1));
                     if(wc)
-                        node->f->add_term(wc);
-                    node->f->add_term(ot2);
+                        f->add_term(wc);
+                    f->add_term(intern(*ot2));
+                    node->f = f;
                 }
                 if(node->f)
                     feats.push_back(node->f);
@@ -231,26 +125,73 @@ void Lookup<OperandFeature>::lookup(
     }
 }
 
+template<typename T>
+LookupFeature *
+Lookup<T>::add(LookupFeature * f)
+{
+    vector<LookupTerm *> terms = intern(f->terms());
+    delete f;
+
+    Lnode * node = &start;
+    for(unsigned i=0;i<terms.size();++i)
+        node = node->next((LT *)terms[i]);
+
+    if(!node->f) {
+        _features.emplace_back();
+        for(unsigned i=0;i<terms.size();++i)
+            _features.back().add_term(terms[i]);
+        node->f = &_features.back();
+    }
+    return node->f;
+}
+
+template<typename T>
+typename Lookup<T>::LT *
+Lookup<T>::intern(const LT & t)
+{
+    LT *& lt = _terms[t.to_int()];
+    if(!lt) {
+        _term_pool.push_back(t);
+        lt = &_term_pool.back();
+    }
+    return lt;
+}
+
+template<typename T>
+vector<LookupTerm *>
+Lookup<T>::intern(const vector<LookupTerm *> & terms)
+{
+    vector<LookupTerm *> ret;
+    for(unsigned i=0;i<terms.size();++i)
+        ret.push_back(intern(*(LT *)terms[i]));
+    return ret;
+}
+
 template<typename T>
 Lookup<T>::~Lookup() 
 {
-    typename unordered_map<Address, vector<LT *> >::iterator tit = _term_map.begin();
-    for( ; tit != _term_map.end(); ++tit)
-        for(unsigned i=0;i<tit->second.size();++i) 
-            delete (tit->second)[i];
+
 }
 
 template<typename T>
 typename Lookup<T>::Lnode *
 Lookup<T>::Lnode::next(LT *t)
 {
-    if(_next.find(*t) == _next.end()) {
-        _next[*t] = new Lnode();
-    }
-    return _next[*t];
+    Lnode *& n = _next[t->to_int()];
+    if(!n)
+        n = new Lnode();
+    return n;
 }
 
 
+template<typename T>
+typename Lookup<T>::Lnode *
+Lookup<T>::Lnode::find(LT *t)
+{
+    typename lmap_t::iterator it = _next.find(t->to_int());
+    return it == _next.end() ? NULL : it->second;
+}
+
 template<typename T>
 Lookup<T>::Lnode::Lnode() :
     f(NULL)
@@ -261,9 +202,7 @@ Lookup<T>::Lnode::Lnode() :
 template<typename T>
 Lookup<T>::Lnode::~Lnode()
 {
-    if(f)
-        delete f;
-
+    // f is the lookup's
     typename lmap_t::iterator nit = _next.begin();
     for( ; nit != _next.end(); ++nit) {
         delete (*nit).second;
@@ -272,5 +211,4 @@ Lookup<T>::Lnode::~Lnode()
 
 
 /* Required because of partial specialization of lookup */
-template class Lookup<IdiomFeature>;
 template class Lookup<OperandFeature>;
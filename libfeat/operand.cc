@@ -29,6 +29,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 #include <assert.h>
+#include <stdlib.h>
 
 #include "CodeObject.h"
 #include "Function.h"
@@ -36,6 +37,7 @@
 #include "Instruction.h"
 
 #include "feature.h"
+#include "hex.h"
 
 using namespace std;
 using namespace Dyninst;
@@ -110,23 +112,44 @@ OperandTerm::from_int(uint64_t it)
     _id = it & 0xffff;
 }
 
+OperandFeature::OperandFeature(char * str) :
+    _owned(true)
+{
+    // O, then the to_int() of each term in hex, joined by '_'
+    char * s = str + 1;
+    while(*s) {
+        char * e;
+        uint64_t t = strtoull(s,&e,16);
+        if(e == s)
+            break;
+        add_term(new OperandTerm(t));
+        s = *e == '_' ? e+1 : e;
+    }
+}
+
+OperandFeature::~OperandFeature()
+{
+    if(_owned)
+        for(unsigned i=0;i<_terms.size();++i)
+            delete _terms[i];
+}
+
 string
 OperandFeature::format() {
-    if(_formatted)
-        return _format;
-
     char buf[64];
+    size_t len = 0;
 
-    _format = "O";
+    string ret = "O";
 
     for(unsigned i=0;i<_terms.size();++i) {
+        if(len + 17 > sizeof(buf)) {
+            ret.append(buf,len);
+            len = 0;
+        }
+        len += hex_u64(buf + len,((OperandTerm*)_terms[i])->to_int());
         if(i+1<_terms.size())
-            snprintf(buf,64,"%lx_",((OperandTerm*)_terms[i])->to_int());
-        else
-            snprintf(buf,64,"%lx",((OperandTerm*)_terms[i])->to_int());
-        _format += buf;
+            buf[len++] = '_';
     }
-
-    _formatted = true;
-    return _format;
+    ret.append(buf,len);
+    return ret;
 }
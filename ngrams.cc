@@ -3,38 +3,29 @@
  * the given program binary. 
  */
 #include <stdio.h>
-#include <sys/types.h>
-#include <sys/stat.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <getopt.h>
-#include <errno.h>
 
-#include <string>
-#include <vector>
-#include <unordered_map>
-
-#include "InstructionDecoder.h"
-#include "Instruction.h"
-
-#include "CodeSource.h"
-#include "CodeObject.h"
-#include "Function.h"
-
-using namespace std;
-using namespace __gnu_cxx;
-using namespace Dyninst;
-using namespace Dyninst::ParseAPI;
-using namespace Dyninst::InstructionAPI;
+#include "extract.h"
 
 void usage(char *s)
 {
     printf("Usage: %s [options] <binary>\n"
-           "       -n <n> [length of ngrams]\n"
-           "       --exclude <file> [exclusion list]\n",s);
+           "       -n <n|m-n|list> [lengths of ngrams]\n"
+           "       --skip <patterns> [gapped ngrams, e.g. x.x,xx..x]\n"
+           "       --counts [print ngram:count, not each occurrence]\n"
+           "       --opcodes [ngrams of instruction entry IDs, counted]\n"
+           "       --operands [opcodes with their operand classes]\n"
+           "       --topk <k> [the k most frequent, counted approximately]\n"
+           "       --topk-counters <m> [in m counters; default 8k]\n"
+           "       --jobs <n> [extract with n threads]\n"
+           "       --cache <dir> [keep parsed binaries in dir]\n"
+           "       --raw [read functions from the symbol table; no parse]\n"
+           "       --exclude <file> [exclusion list]\n"
+           "       --stats <file> [write run statistics as JSON]\n",s);
 }
 
-FILE * out;
-
 /* getopt declarations */
 extern char *optarg;
 extern int optind;
@@ -43,8 +34,7 @@ extern int opterr;
 extern int optreset;
 
 /* options */
-int N = 0;
-char * EXCLUDE = NULL;
+extract::options opts;
 
 int parse_options(int argc, char**argv)
 {
@@ -53,7 +43,18 @@ int parse_options(int argc, char**argv)
     static struct option long_options[] = {
         {"help",no_argument,0,'h' },
         {"exclude",required_argument,0,'e' },
-        {"commasep",no_argument,0,'c' }
+        {"commasep",no_argument,0,'c' },
+        {"jobs",required_argument,0,'j' },
+        {"cache",required_argument,0,'K' },
+        {"stats",required_argument,0,'S' },
+        {"skip",required_argument,0,'k' },
+        {"counts",no_argument,0,'N' },
+        {"raw",no_argument,0,'R' },
+        {"opcodes",no_argument,0,'O' },
+        {"operands",no_argument,0,'P' },
+        {"topk",required_argument,0,'T' },
+        {"topk-counters",required_argument,0,'W' },
+        {0,0,0,0 }
     };
 
     int option_index = 0;
@@ -63,10 +64,58 @@ int parse_options(int argc, char**argv)
     {
         switch(ch) {
             case 'n':
-                N = strtoul(optarg,NULL,10);
+                if(!extract::parse_lengths(optarg,opts.ngram_lens)) {
+                    printf("Bad ngram lengths %s\n",optarg);
+                    usage(argv[0]);
+                    exit(1);
+                }
                 break;
             case 'e':
-                EXCLUDE = optarg;
+                opts.exclude = optarg;
+                break;
+            case 'j':
+                opts.jobs = atoi(optarg);
+                break;
+            case 'K':
+                opts.cache = optarg;
+                break;
+            case 'S':
+                opts.stats = optarg;
+                break;
+            case 'k':
+                if(!extract::parse_skipgrams(optarg,opts.skipgrams)) {
+                    printf("Bad skip-gram patterns %s\n",optarg);
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'N':
+                opts.ngram_counts = true;
+                break;
+            case 'R':
+                opts.raw = true;
+                break;
+            case 'P':
+                opts.ngram_operands = true;
+                // fall through
+            case 'O':
+                opts.ngram_opcodes = true;
+                break;
+            case 'T':
+                if(atoi(optarg) <= 0) {
+                    printf("--topk must be positive\n");
+                    usage(argv[0]);
+                    exit(1);
+                }
+                opts.ngram_topk = atoi(optarg);
+                break;
+            case 'W':
+                if(atoi(optarg) <= 0) {
+                    printf("--topk-counters must be positive\n");
+                    usage(argv[0]);
+                    exit(1);
+                }
+                opts.topk_counters = atoi(optarg);
                 break;
             default:
                 printf("Illegal option %c\n",ch);
@@ -76,150 +125,57 @@ int parse_options(int argc, char**argv)
         }
     }
 
-    if(0 == N) {
-        printf("Length of ngrams is required\n");
+    if(opts.ngram_opcodes && !opts.skipgrams.empty()) {
+        printf("--skip does not apply to --opcodes\n");
         usage(argv[0]);
         exit(1);
     }
 
-    return optind;
-}
-
-inline void
-chomp(char*s)
-{
-    for( ; *s != '\0'; ++s)
-        if(*s == '\n') {
-            *s = '\0';
-            break;
-        }
-}
-
-
-void load_exclude(unordered_map<string,bool> & exclude)
-{
-    char * buf = NULL;
-    size_t n = 0;
-    ssize_t read;
-
-    FILE * exin = fopen(EXCLUDE,"r");
-    if(!exin) {
-        fprintf(stderr,"Can't open exclude file %s: %s\n",
-            EXCLUDE,strerror(errno));
-        return;
+    if(opts.ngram_topk && (opts.ngram_opcodes || !opts.skipgrams.empty())) {
+        printf("--topk applies to byte ngrams alone\n");
+        usage(argv[0]);
+        exit(1);
     }
 
-    while(-1 != (read = getline(&buf,&n,exin))) {
-        chomp(buf);            
-        exclude[string(buf)] = true;
+    if(opts.topk_counters && opts.topk_counters < opts.ngram_topk) {
+        printf("--topk-counters must be at least --topk\n");
+        usage(argv[0]);
+        exit(1);
     }
-    
-    if(buf) 
-        free(buf); 
-}
 
-void print_ngram(unsigned char * ngstart, unsigned char * ngbuf)
-{
-    printf("<");
-    for(int i=0;i<N;++i) {
-        printf("%02x",*(ngstart++));
-        if(ngstart - ngbuf >= N)
-            ngstart = ngbuf;
+    if(opts.raw && opts.ngram_opcodes) {
+        printf("--raw has no instructions for --opcodes\n");
+        usage(argv[0]);
+        exit(1);
     }
-    printf(">,");
-}
-
-void mkngrams(SymtabCodeSource * sts, FuncExtent * fe, 
-    IBSTree<FuncExtent> & visited)
-{
-    Address a;
-    unsigned char ngrambuf[N];
-    unsigned char * ngstart = ngrambuf;
-    unsigned char * ngcur = ngrambuf;
-    int cnt = 0;
-    set<FuncExtent*> lookup;
-
-    for(a = fe->start(); a < fe->end(); ++a) {
-
-        if(visited.find(a,lookup) > 0) {
-            // already visited, skip
-            lookup.clear();
-            continue;
-        }
 
-        unsigned char * byte = (unsigned char*)sts->getPtrToInstruction(a);
-        *(ngcur++) = *byte;
-
-        ++cnt;
-
-        if(ngcur - ngrambuf >= N)
-            ngcur = ngrambuf;
-        
-        if(cnt >= N) {
-            print_ngram(ngstart++,ngrambuf); 
-            if(ngstart - ngrambuf >= N)
-                ngstart = ngrambuf; 
-        }
-    } 
+    if(opts.ngram_lens.empty() && opts.skipgrams.empty()) {
+        printf("Length of ngrams is required\n");
+        usage(argv[0]);
+        exit(1);
+    }
 
-    visited.insert(fe);
+    return optind;
 }
 
 int main(int argc, char **argv)
 {
-    unordered_map<string, bool> exclude;
-    SymtabCodeSource *sts;
-    CodeObject *co;
-    struct stat sbuf;
+    double started = extract::stats::now();
 
-    // to ensure we don't duplicate addresses
-    IBSTree<FuncExtent> visited;
+    opts.families = extract::NGRAMS;
 
     int binindex = parse_options(argc, argv);
     if(argc-1<binindex) {
         usage(argv[0]);
         exit(1);
     }
-    
-    if(0 != stat(argv[binindex],&sbuf)) {
-        fprintf(stderr,"Failed to stat %s: ",argv[binindex]);
-        perror("");
-        exit(1);
-    }
-    sts = new SymtabCodeSource( argv[binindex] );
-    co = new CodeObject( sts );
-    co->parse();
-
-    auto & funcs = co->funcs();
-
-    if(EXCLUDE)
-        load_exclude(exclude);    
-
-    CodeObject::funclist::iterator fit = funcs.begin();
-    for( ; fit != funcs.end(); ++fit) {
-        Function * f = *fit;
-        if(exclude.find(f->name()) != exclude.end()) {
-            //fprintf(stderr,"skipped %s\n",f->name().c_str());
-            continue; 
-        }
 
-        if(strncmp(f->name().c_str(),"std::",5) == 0 ||
-           strncmp(f->name().c_str(),"__gnu_cxx::",11) == 0) {
-            //fprintf(stderr,"skipped %s\n",f->name().c_str());
-            continue;
-        }
-
-        vector<FuncExtent *> const& extents = f->extents();
-        for(unsigned i=0;i<extents.size();++i) {
-            FuncExtent * fe = extents[i];
-    
-            mkngrams(sts,fe,visited);        
-        }
-    }
-    printf("\n");
-
-    delete co;
-    delete sts;
+    extract::extractor ex(opts);
+    int ret = ex.run(argv[binindex]);
+    if(opts.stats)
+        extract::write_stats(opts.stats,ex.statistics(),started);
+    if(ret)
+        exit(1);
 
     return 0;
 }